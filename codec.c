@@ -27,6 +27,7 @@
 #include <assert.h>
 
 #include <getopt.h>
+#include <process.h>
 
 const named_str_t x264vfw_preset_table[COUNT_PRESET] =
 {
@@ -135,6 +136,12 @@ const char * const x264vfw_log_level_names[] = { "none", "error", "warning", "in
 
 const char * const x264vfw_range_names[] = { "auto", "tv", "pc", 0 };
 
+const char * const x264vfw_static_frames_names[] = { "off", "reuse", "drop", 0 };
+
+const char * const x264vfw_decoder_thread_type_names[] = { "slice", "frame", 0 };
+
+const char * const x264vfw_decoder_convert_names[] = { "accurate", "fast", 0 };
+
 typedef enum
 {
     RANGE_AUTO = -1,
@@ -142,6 +149,13 @@ typedef enum
     RANGE_PC
 } range_enum;
 
+typedef enum
+{
+    STATIC_FRAMES_OFF,
+    STATIC_FRAMES_REUSE,    /* skip the conversion of unchanged input */
+    STATIC_FRAMES_DROP      /* don't encode unchanged input at all (timestamped 'File' output only) */
+} static_frames_enum;
+
 #ifdef _WIN32
 /* Functions for dealing with Unicode on Windows. */
 FILE *x264vfw_fopen(const char *filename, const char *mode)
@@ -198,9 +212,15 @@ static int get_csp(BITMAPINFOHEADER *hdr)
         case FOURCC_YV12:
             return X264VFW_CSP_YV12 | i_vflip;
 
+        case FOURCC_Y42B:
+            return X264VFW_CSP_I422 | i_vflip;
+
         case FOURCC_YV16:
             return X264VFW_CSP_YV16 | i_vflip;
 
+        case FOURCC_444P:
+            return X264VFW_CSP_I444 | i_vflip;
+
         case FOURCC_YV24:
             return X264VFW_CSP_YV24 | i_vflip;
 
@@ -215,6 +235,24 @@ static int get_csp(BITMAPINFOHEADER *hdr)
         case FOURCC_HDYC:
             return X264VFW_CSP_UYVY | i_vflip;
 
+        case FOURCC_P010:
+            return X264VFW_CSP_P010 | i_vflip;
+
+        case FOURCC_P210:
+            return X264VFW_CSP_P210 | i_vflip;
+
+        case FOURCC_V210:
+            return X264VFW_CSP_V210 | i_vflip;
+
+        case FOURCC_Y416:
+            return X264VFW_CSP_Y416 | i_vflip;
+
+        case FOURCC_B48R:
+            return X264VFW_CSP_B48R | i_vflip;
+
+        case FOURCC_B64A:
+            return X264VFW_CSP_B64A | i_vflip;
+
         case BI_RGB:
         {
             i_vflip = hdr->biHeight < 0 ? 0 : X264VFW_CSP_VFLIP;
@@ -242,62 +280,86 @@ static int get_allowed_csp(CODEC *codec, BITMAPINFOHEADER *hdr)
         case X264VFW_CSP_YV12:
             return (i_csp_keep == CSP_KEEP_I420) ? i_csp : X264VFW_CSP_NONE;
 
-        //case X264VFW_CSP_I422:
+        case X264VFW_CSP_I422:
         case X264VFW_CSP_YV16:
             return (i_csp_keep == CSP_KEEP_I422) ? i_csp : X264VFW_CSP_NONE;
 
-        //case X264VFW_CSP_I444:
+        case X264VFW_CSP_I444:
         case X264VFW_CSP_YV24:
             return (i_csp_keep == CSP_KEEP_I444) ? i_csp : X264VFW_CSP_NONE;
 
         case X264VFW_CSP_NV12:
+        case X264VFW_CSP_P010:
             return (i_csp_keep == CSP_KEEP_I420) ? i_csp : X264VFW_CSP_NONE;
 
         case X264VFW_CSP_YUYV:
         case X264VFW_CSP_UYVY:
+        case X264VFW_CSP_P210:
+        case X264VFW_CSP_V210:
             return (i_csp_keep == CSP_KEEP_I422) ? i_csp : X264VFW_CSP_NONE;
 
+        case X264VFW_CSP_Y416:
+            return (i_csp_keep == CSP_KEEP_I444) ? i_csp : X264VFW_CSP_NONE;
+
+        /* RGB is also converted directly to 4:4:4 or 4:2:2 when those are kept */
         case X264VFW_CSP_BGR:
         case X264VFW_CSP_BGRA:
-            return (i_csp_keep == CSP_KEEP_RGB) ? i_csp : X264VFW_CSP_NONE;
+        case X264VFW_CSP_B48R:
+        case X264VFW_CSP_B64A:
+            return (i_csp_keep == CSP_KEEP_RGB || i_csp_keep == CSP_KEEP_I444 || i_csp_keep == CSP_KEEP_I422) ? i_csp : X264VFW_CSP_NONE;
 
         default:
             return X264VFW_CSP_NONE;
     }
 }
 
-static int choose_output_csp(int i_csp, int b_keep_input_csp)
+/* i_csp_keep - CSP_* mode, b_nv12 - convert to 4:2:0 with interleaved chroma which is also the x264 internal layout */
+static int choose_output_csp(int i_csp, int i_csp_keep, int b_nv12)
 {
+    int i_csp_420 = b_nv12 ? X264_CSP_NV12 : X264_CSP_I420;
+    int b_keep_input_csp = i_csp_keep != CSP_CONVERT_TO_I420;
+    int i_csp_rgb = i_csp_keep == CSP_KEEP_I444 ? X264_CSP_I444 :
+                    i_csp_keep == CSP_KEEP_I422 ? X264_CSP_I422 :
+                    b_keep_input_csp            ? 0             : i_csp_420;
+
     i_csp &= X264VFW_CSP_MASK;
     switch (i_csp)
     {
         case X264VFW_CSP_I420:
         case X264VFW_CSP_YV12:
-            return X264_CSP_I420;
+            return i_csp_420;
 
-        //case X264VFW_CSP_I422:
+        case X264VFW_CSP_I422:
         case X264VFW_CSP_YV16:
-            return b_keep_input_csp ? X264_CSP_I422 : X264_CSP_I420;
+            return b_keep_input_csp ? X264_CSP_I422 : i_csp_420;
 
-        //case X264VFW_CSP_I444:
+        case X264VFW_CSP_I444:
         case X264VFW_CSP_YV24:
-            return b_keep_input_csp ? X264_CSP_I444 : X264_CSP_I420;
+            return b_keep_input_csp ? X264_CSP_I444 : i_csp_420;
 
         case X264VFW_CSP_NV12:
+        case X264VFW_CSP_P010:
             return X264_CSP_NV12;
 
         case X264VFW_CSP_YUYV:
         case X264VFW_CSP_UYVY:
-            return b_keep_input_csp ? X264_CSP_I422 : X264_CSP_I420;
+        case X264VFW_CSP_P210:
+        case X264VFW_CSP_V210:
+            return b_keep_input_csp ? X264_CSP_I422 : i_csp_420;
+
+        case X264VFW_CSP_Y416:
+            return b_keep_input_csp ? X264_CSP_I444 : i_csp_420;
 
         case X264VFW_CSP_BGR:
-            return b_keep_input_csp ? X264_CSP_BGR : X264_CSP_I420;
+        case X264VFW_CSP_B48R:
+            return i_csp_rgb ? i_csp_rgb : X264_CSP_BGR;
 
         case X264VFW_CSP_BGRA:
-            return b_keep_input_csp ? X264_CSP_BGRA : X264_CSP_I420;
+        case X264VFW_CSP_B64A:
+            return i_csp_rgb ? i_csp_rgb : X264_CSP_BGRA;
 
         default:
-            return X264_CSP_I420;
+            return i_csp_420;
     }
 }
 
@@ -319,7 +381,7 @@ static int x264vfw_img_fill(x264_image_t *img, uint8_t *ptr, int i_csp, int widt
             img->plane[2]    = img->plane[1] + img->i_stride[1] * height / 2;
             break;
 
-        //case X264VFW_CSP_I422:
+        case X264VFW_CSP_I422:
         case X264VFW_CSP_YV16:
             width = (width + 1) & ~1;
             img->i_plane     = 3;
@@ -331,7 +393,7 @@ static int x264vfw_img_fill(x264_image_t *img, uint8_t *ptr, int i_csp, int widt
             img->plane[2]    = img->plane[1] + img->i_stride[1] * height;
             break;
 
-        //case X264VFW_CSP_I444:
+        case X264VFW_CSP_I444:
         case X264VFW_CSP_YV24:
             img->i_plane     = 3;
             img->i_stride[0] =
@@ -372,12 +434,117 @@ static int x264vfw_img_fill(x264_image_t *img, uint8_t *ptr, int i_csp, int widt
             img->plane[0]    = ptr;
             break;
 
+        case X264VFW_CSP_P010:
+            height = (height + 1) & ~1;
+            width = (width + 1) & ~1;
+            img->i_plane     = 2;
+            img->i_stride[0] =
+            img->i_stride[1] = 2 * width;
+            img->plane[0]    = ptr;
+            img->plane[1]    = img->plane[0] + img->i_stride[0] * height;
+            break;
+
+        case X264VFW_CSP_P210:
+            width = (width + 1) & ~1;
+            img->i_plane     = 2;
+            img->i_stride[0] =
+            img->i_stride[1] = 2 * width;
+            img->plane[0]    = ptr;
+            img->plane[1]    = img->plane[0] + img->i_stride[0] * height;
+            break;
+
+        case X264VFW_CSP_V210:
+            /* Rows are aligned to 48 pixels (128 bytes) */
+            img->i_plane     = 1;
+            img->i_stride[0] = (width + 47) / 48 * 128;
+            img->plane[0]    = ptr;
+            break;
+
+        case X264VFW_CSP_Y416:
+        case X264VFW_CSP_B64A:
+            img->i_plane     = 1;
+            img->i_stride[0] = 8 * width;
+            img->plane[0]    = ptr;
+            break;
+
+        case X264VFW_CSP_B48R:
+            img->i_plane     = 1;
+            img->i_stride[0] = 6 * width;
+            img->plane[0]    = ptr;
+            break;
+
         default:
             return -1;
     }
     return 0;
 }
 
+/* Make the image reference the input frame planes in place of conversion if x264 can read them as is.
+ * x264_encoder_encode copies the picture into its own frame (including frames held for lookahead)
+ * before returning, so the input buffer doesn't have to outlive the call.
+ * x264 accepts I420 input for NV12 encoding too (both are stored as NV12 internally) unless b_exact_csp
+ * is set because the picture is also read by x264vfw in the layout of the encoder colorspace */
+static int x264vfw_img_direct(x264_image_t *img, int i_x264_csp, int b_exact_csp)
+{
+    int b_swap_UV = 0;
+
+    /* Vertically flipped input always needs conversion */
+    switch (img->i_csp)
+    {
+        case X264VFW_CSP_I420:
+            if (i_x264_csp != X264_CSP_I420 && (i_x264_csp != X264_CSP_NV12 || b_exact_csp))
+                return 0;
+            i_x264_csp = X264_CSP_I420;
+            break;
+
+        case X264VFW_CSP_YV12:
+            if (i_x264_csp != X264_CSP_I420 && (i_x264_csp != X264_CSP_NV12 || b_exact_csp))
+                return 0;
+            i_x264_csp = X264_CSP_I420;
+            b_swap_UV = 1;
+            break;
+
+        case X264VFW_CSP_I422:
+            if (i_x264_csp != X264_CSP_I422)
+                return 0;
+            break;
+
+        case X264VFW_CSP_YV16:
+            if (i_x264_csp != X264_CSP_I422)
+                return 0;
+            b_swap_UV = 1;
+            break;
+
+        case X264VFW_CSP_I444:
+            if (i_x264_csp != X264_CSP_I444)
+                return 0;
+            break;
+
+        case X264VFW_CSP_YV24:
+            if (i_x264_csp != X264_CSP_I444)
+                return 0;
+            b_swap_UV = 1;
+            break;
+
+        case X264VFW_CSP_NV12:
+            if (i_x264_csp != X264_CSP_NV12)
+                return 0;
+            break;
+
+        default:
+            return 0;
+    }
+
+    if (b_swap_UV)
+    {
+        uint8_t *tmp = img->plane[1];
+        img->plane[1] = img->plane[2];
+        img->plane[2] = tmp;
+    }
+    img->i_csp = i_x264_csp;
+    return 1;
+}
+
 #if defined(HAVE_FFMPEG) && X264VFW_USE_DECODER
 static enum AVPixelFormat csp_to_pix_fmt(int i_csp)
 {
@@ -388,11 +555,11 @@ static enum AVPixelFormat csp_to_pix_fmt(int i_csp)
         case X264VFW_CSP_YV12:
             return AV_PIX_FMT_YUV420P;
 
-        //case X264VFW_CSP_I422:
+        case X264VFW_CSP_I422:
         case X264VFW_CSP_YV16:
             return AV_PIX_FMT_YUV422P;
 
-        //case X264VFW_CSP_I444:
+        case X264VFW_CSP_I444:
         case X264VFW_CSP_YV24:
             return AV_PIX_FMT_YUV444P;
 
@@ -652,58 +819,15 @@ LRESULT x264vfw_compress_query(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *
 }
 
 /* Log functions */
-void x264vfw_log_create(CODEC *codec)
-{
-    x264vfw_log_destroy(codec);
-    if (codec->config.i_log_level > X264VFW_LOG_NONE)
-        codec->hCons = CreateDialogW(x264vfw_hInst, MAKEINTRESOURCEW(IDD_LOG), GetDesktopWindow(), x264vfw_callback_log);
-}
-
-void x264vfw_log_destroy(CODEC *codec)
-{
-    if (codec->hCons)
-    {
-        DestroyWindow(codec->hCons);
-        codec->hCons = NULL;
-    }
-    codec->b_visible = FALSE;
-}
-
-static void x264vfw_log_internal(CODEC *codec, const char *name, int i_level, const char *psz_fmt, va_list arg)
+/* Writes formatted message to the debug output and the log window (called by the logger thread if there is one) */
+static void x264vfw_log_output(void *opaque, const char *msg)
 {
-    char msg[2048];
-    wchar_t utf16_msg[2048];
-    char *s_level;
-
-    switch (i_level)
-    {
-        case X264_LOG_ERROR:
-            s_level = "error";
-            break;
-
-        case X264_LOG_WARNING:
-            s_level = "warning";
-            break;
-
-        case X264_LOG_INFO:
-            s_level = "info";
-            break;
-
-        case X264_LOG_DEBUG:
-            s_level = "debug";
-            break;
-
-        default:
-            s_level = "unknown";
-            break;
-    }
-    memset(msg, 0, sizeof(msg));
-    snprintf(msg, sizeof(msg) - 1, "%s [%s]: ", name, s_level);
-    vsnprintf(msg + strlen(msg), sizeof(msg) - strlen(msg) - 1, psz_fmt, arg);
+    CODEC *codec = opaque;
+    wchar_t utf16_msg[X264VFW_LOGGER_MSG_SIZE];
 
     /* convert UTF-8 to wide chars */
-    if (!MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, msg, -1, utf16_msg, sizeof(utf16_msg)) &&
-        !MultiByteToWideChar(CP_ACP, 0, msg, -1, utf16_msg, sizeof(utf16_msg)))
+    if (!MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, msg, -1, utf16_msg, ARRAY_ELEMS(utf16_msg)) &&
+        !MultiByteToWideChar(CP_ACP, 0, msg, -1, utf16_msg, ARRAY_ELEMS(utf16_msg)))
     {
 #if X264VFW_DEBUG_OUTPUT
         OutputDebugString("x264vfw [error]: log msg to unicode conversion failed\n");
@@ -757,6 +881,51 @@ static void x264vfw_log_internal(CODEC *codec, const char *name, int i_level, co
     }
 }
 
+void x264vfw_log_create(CODEC *codec)
+{
+    x264vfw_log_destroy(codec);
+    if (codec->config.i_log_level > X264VFW_LOG_NONE)
+    {
+        codec->hCons = CreateDialogW(x264vfw_hInst, MAKEINTRESOURCEW(IDD_LOG), GetDesktopWindow(), x264vfw_callback_log);
+        /* Without the consumer thread messages are written out synchronously */
+        if (codec->hCons && x264vfw_logger_init(&codec->logger, x264vfw_log_output, codec) < 0)
+            codec->logger = NULL;
+    }
+}
+
+void x264vfw_log_destroy(CODEC *codec)
+{
+    /* Write out queued messages before the window goes away */
+    x264vfw_logger_delete(codec->logger);
+    codec->logger = NULL;
+    if (codec->hCons)
+    {
+        DestroyWindow(codec->hCons);
+        codec->hCons = NULL;
+    }
+    codec->b_visible = FALSE;
+}
+
+static void x264vfw_log_internal(CODEC *codec, const char *name, int i_level, const char *psz_fmt, va_list arg)
+{
+    char msg[X264VFW_LOGGER_MSG_SIZE];
+
+    if (codec && !codec->hCons)
+        codec = NULL;
+    /* Don't format messages nobody will see */
+    if (!codec && !X264VFW_DEBUG_OUTPUT)
+        return;
+
+    /* The encoding threads only queue the message, the rest is done by the logger thread */
+    if (codec && codec->logger)
+    {
+        x264vfw_logger_write(codec->logger, name, i_level, psz_fmt, arg);
+        return;
+    }
+    x264vfw_log_format(msg, sizeof(msg), name, i_level, psz_fmt, arg);
+    x264vfw_log_output(codec, msg);
+}
+
 void x264vfw_cli_log(void *p_private, const char *name, int i_level, const char *psz_fmt, ...)
 {
     CODEC *codec = p_private;
@@ -788,6 +957,7 @@ void x264vfw_log(CODEC *codec, int i_level, const char *psz_fmt, ...)
     va_end(arg);
 }
 
+/* x264 checks its own i_log_level (which may be raised by --log-level) before calling this */
 static void x264vfw_log_callback(void *p_private, int i_level, const char *psz_fmt, va_list arg)
 {
     x264vfw_log_internal(p_private, "x264vfw", i_level, psz_fmt, arg);
@@ -824,7 +994,23 @@ typedef enum
 #if X264VFW_USE_VIRTUALDUB_HACK
     OPT_VD_HACK,
 #endif
-    OPT_NO_OUTPUT
+    OPT_NO_OUTPUT,
+    OPT_CSP_THREADS,
+    OPT_ASYNC_PICS,
+    OPT_CONVERT_NV12,
+    OPT_STATIC_FRAMES,
+    OPT_TRACE,
+    OPT_STATS_SIDECAR,
+    OPT_TELEMETRY,
+    OPT_NO_ENCODER_REUSE,
+    OPT_SPEED_CONTROL,
+    OPT_DEADLINE,
+    OPT_SPILL_2PASS,
+    OPT_RENDITION,
+    OPT_DECODER_THREADS,
+    OPT_DECODER_THREAD_TYPE,
+    OPT_DECODER_CONVERT,
+    OPT_DECODER_ADAPTIVE
 } OptionsOPT;
 
 static char short_options[] = "8A:B:b:f:hI:i:m:o:p:q:r:t:Vvw";
@@ -995,6 +1181,22 @@ static struct option long_options[] =
     { "vd-hack",           no_argument,       NULL, OPT_VD_HACK         },
 #endif
     { "no-output",         no_argument,       NULL, OPT_NO_OUTPUT       },
+    { "csp-threads",       required_argument, NULL, OPT_CSP_THREADS     },
+    { "async-pics",        required_argument, NULL, OPT_ASYNC_PICS      },
+    { "convert-nv12",      no_argument,       NULL, OPT_CONVERT_NV12    },
+    { "static-frames",     required_argument, NULL, OPT_STATIC_FRAMES   },
+    { "trace",             required_argument, NULL, OPT_TRACE           },
+    { "stats-sidecar",     required_argument, NULL, OPT_STATS_SIDECAR   },
+    { "telemetry",         no_argument,       NULL, OPT_TELEMETRY       },
+    { "no-encoder-reuse",  no_argument,       NULL, OPT_NO_ENCODER_REUSE },
+    { "speed-control",     required_argument, NULL, OPT_SPEED_CONTROL   },
+    { "deadline",          required_argument, NULL, OPT_DEADLINE        },
+    { "spill-2pass",       required_argument, NULL, OPT_SPILL_2PASS     },
+    { "rendition",         required_argument, NULL, OPT_RENDITION       },
+    { "decoder-threads",   required_argument, NULL, OPT_DECODER_THREADS },
+    { "decoder-thread-type", required_argument, NULL, OPT_DECODER_THREAD_TYPE },
+    { "decoder-convert",   required_argument, NULL, OPT_DECODER_CONVERT },
+    { "decoder-adaptive",  no_argument,       NULL, OPT_DECODER_ADAPTIVE },
     { NULL,                0,                 NULL, 0                   }
 };
 
@@ -1108,7 +1310,75 @@ static int split_cmdline(const char *cmdline, char **argv, char *arg_mem)
     return argc;
 }
 
-static int select_output(const char *muxer, char *filename, x264_param_t *param, CODEC *codec)
+/* Relative names of side files (trace, stats) are placed next to the output file, suffix is inserted before the extension */
+static void side_filename(char *buf, int size, const char *name, const char *output_file, const char *suffix)
+{
+    const char *dir_end = NULL;
+    const char *ext = strrchr(name, '.');
+    int b_absolute = name[0] == '\\' || name[0] == '/' || (name[0] && name[1] == ':');
+    int i_dir = 0;
+
+    if (!b_absolute && output_file && strcmp(output_file, "-"))
+    {
+        const char *p;
+        for (p = output_file; *p; p++)
+            if (*p == '\\' || *p == '/')
+                dir_end = p + 1;
+        if (dir_end)
+            i_dir = dir_end - output_file;
+    }
+    if (!suffix || !ext || strpbrk(ext, "\\/"))
+        ext = name + strlen(name);
+    snprintf(buf, size, "%.*s%.*s%s%s", i_dir, i_dir ? output_file : "", (int)(ext - name), name, suffix ? suffix : "", ext);
+}
+
+/* Reduce the reference frame count to fit the DPB of the target level */
+static void limit_frame_reference(x264_param_t *param)
+{
+    int i;
+    int mbs = (((param->i_width)+15)>>4) * (((param->i_height)+15)>>4);
+    for (i = 0; x264_levels[i].level_idc != 0; i++)
+        if (param->i_level_idc == x264_levels[i].level_idc)
+        {
+            while (mbs * param->i_frame_reference > x264_levels[i].dpb &&
+                   param->i_frame_reference > 1)
+            {
+                param->i_frame_reference--;
+            }
+            break;
+        }
+}
+
+/* Pass the encoder parameters and the stream headers to the opened CLI output */
+static int cli_output_start(CODEC *codec, x264_t *h, const cli_output_t *output, hnd_t hout, x264_param_t *param)
+{
+    if (output->set_param(hout, param) < 0)
+    {
+        x264vfw_log(codec, X264_LOG_ERROR, "can't set outfile param\n");
+        return -1;
+    }
+    if (!param->b_repeat_headers)
+    {
+        /* Write SPS/PPS/SEI */
+        x264_nal_t *headers;
+        int i_nal;
+
+        if (x264_encoder_headers(h, &headers, &i_nal) < 0)
+        {
+            x264vfw_log(codec, X264_LOG_ERROR, "x264_encoder_headers failed\n");
+            return -1;
+        }
+        if (output->write_headers(hout, headers) < 0)
+        {
+            x264vfw_log(codec, X264_LOG_ERROR, "can't write SPS/PPS/SEI to outfile\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Returns 1 if filename is a CLI output, 0 for VFW output ("-") */
+static int select_output(const char *muxer, char *filename, x264_param_t *param, CODEC *codec, cli_output_t *output)
 {
     const char *ext = get_filename_extension(filename);
 
@@ -1120,7 +1390,7 @@ static int select_output(const char *muxer, char *filename, x264_param_t *param,
 
     if (!strcasecmp(ext, "mp4"))
     {
-        codec->cli_output = mp4_output;
+        *output = mp4_output;
         param->b_annexb = 0;
         param->b_repeat_headers = 0;
         if (param->i_nal_hrd == X264_NAL_HRD_CBR)
@@ -1131,20 +1401,20 @@ static int select_output(const char *muxer, char *filename, x264_param_t *param,
     }
     else if (!strcasecmp(ext, "mkv"))
     {
-        codec->cli_output = mkv_output;
+        *output = mkv_output;
         param->b_annexb = 0;
         param->b_repeat_headers = 0;
     }
     else if (!strcasecmp(ext, "flv"))
     {
-        codec->cli_output = flv_output;
+        *output = flv_output;
         param->b_annexb = 0;
         param->b_repeat_headers = 0;
     }
     else if (!strcasecmp(ext, "avi"))
     {
 #if defined(HAVE_FFMPEG)
-        codec->cli_output = avi_output;
+        *output = avi_output;
         param->b_annexb = 1;
         param->b_repeat_headers = 1;
         if (param->b_vfr_input)
@@ -1158,41 +1428,141 @@ static int select_output(const char *muxer, char *filename, x264_param_t *param,
 #endif
     }
     else
-        codec->cli_output = raw_output;
-    codec->b_cli_output = TRUE;
-    return 0;
+        *output = raw_output;
+    return 1;
+}
+
+/* Reentrant replacement of getopt_long with opterr = 0: all the state is in opt_state_t so several
+ * encoder instances can parse their command lines at the same time (getopt needs a global lock).
+ * Non-option arguments are skipped and "--" ends the options like with getopt_long. */
+typedef struct
+{
+    int i_ind;          /* next argv element */
+    int i_pos;          /* next character in a group of short options ("-Vv"), 0 - none */
+    int i_opt;          /* argv element of the returned option (for messages) */
+    char *arg;          /* argument of the returned option */
+} opt_state_t;
+
+static void opt_init(opt_state_t *st)
+{
+    memset(st, 0, sizeof(opt_state_t));
+    st->i_ind = 1;
+}
+
+static int opt_long(opt_state_t *st, int argc, char **argv, const struct option *longopts, int *longindex)
+{
+    char *name = argv[st->i_opt] + 2;
+    char *value = strchr(name, '=');
+    size_t len = value ? (size_t)(value - name) : strlen(name);
+    int i, i_match = -1;
+
+    for (i = 0; longopts[i].name; i++)
+        if (!strncmp(longopts[i].name, name, len))
+        {
+            if (strlen(longopts[i].name) == len)
+            {
+                i_match = i;
+                break;
+            }
+            /* Abbreviations are accepted unless the candidates differ (getopt_long picks the first one) */
+            if (i_match == -1)
+                i_match = i;
+            else if (i_match >= 0 && (longopts[i].has_arg != longopts[i_match].has_arg || longopts[i].val != longopts[i_match].val))
+                i_match = -2;
+        }
+    if (i_match < 0)
+        return '?';
+    if (longindex)
+        *longindex = i_match;
+    switch (longopts[i_match].has_arg)
+    {
+        case no_argument:
+            if (value)
+                return '?';
+            break;
+
+        case required_argument:
+            if (value)
+                st->arg = value + 1;
+            else if (st->i_ind < argc)
+                st->arg = argv[st->i_ind++];
+            else
+                return '?';
+            break;
+
+        default:
+            st->arg = value ? value + 1 : NULL;
+            break;
+    }
+    return longopts[i_match].val;
+}
+
+/* Returns the option value, '?' for unknown option or absent argument and -1 at the end */
+static int opt_next(opt_state_t *st, int argc, char **argv, const char *shortopts, const struct option *longopts, int *longindex)
+{
+    const char *spec;
+    char *p;
+    int c;
+
+    st->arg = NULL;
+    if (!st->i_pos)
+    {
+        while (st->i_ind < argc && (argv[st->i_ind][0] != '-' || !argv[st->i_ind][1]))
+            st->i_ind++;
+        if (st->i_ind >= argc)
+            return -1;
+        st->i_opt = st->i_ind++;
+        if (!strcmp(argv[st->i_opt], "--"))
+            return -1;
+        if (argv[st->i_opt][1] == '-')
+            return opt_long(st, argc, argv, longopts, longindex);
+        st->i_pos = 1;
+    }
+    p = argv[st->i_opt] + st->i_pos;
+    c = (unsigned char)*p++;
+    st->i_pos = *p ? st->i_pos + 1 : 0;
+    spec = c != ':' ? strchr(shortopts, c) : NULL;
+    if (!spec)
+        return '?';
+    if (spec[1] == ':')
+    {
+        st->i_pos = 0;
+        if (*p)
+            st->arg = p;
+        else if (st->i_ind < argc)
+            st->arg = argv[st->i_ind++];
+        else
+            return '?';
+    }
+    return c;
 }
 
 /* Parse command line for preset/tune options */
 static int parse_preset_tune(int argc, char **argv, x264_param_t *param, CODEC *codec)
 {
-    EnterCriticalSection(&x264vfw_CS);
-
-    opterr = 0; /* Suppress error messages printing in getopt */
-    optind = 0; /* Initialize getopt */
+    opt_state_t st;
 
+    opt_init(&st);
     for (;;)
     {
-        int checked_optind = optind > 0 ? optind : 1;
-        int c = getopt_long(argc, argv, short_options, long_options, NULL);
+        int c = opt_next(&st, argc, argv, short_options, long_options, NULL);
         if (c == -1)
             break;
         if (c == OPT_PRESET)
-            codec->preset = optarg;
+            codec->preset = st.arg;
         else if (c == OPT_TUNE)
-            codec->tune = optarg;
+            codec->tune = st.arg;
+        else if (c == OPT_CONVERT_NV12) /* needed to choose the output colorspace */
+            codec->b_convert_nv12 = TRUE;
+        else if (c == OPT_SPILL_2PASS) /* needed to set up the rate control */
+            codec->spill_file = st.arg;
         else if (c == '?')
         {
-            x264vfw_log(codec, X264_LOG_ERROR, "unknown option or absent argument: '%s'\n", argv[checked_optind]);
-            goto fail;
+            x264vfw_log(codec, X264_LOG_ERROR, "unknown option or absent argument: '%s'\n", argv[st.i_opt]);
+            return -1;
         }
     }
-
-    LeaveCriticalSection(&x264vfw_CS);
     return 0;
-fail:
-    LeaveCriticalSection(&x264vfw_CS);
-    return -1;
 }
 
 static int parse_enum_name(const char *arg, const char * const *names, const char **dst)
@@ -1219,20 +1589,38 @@ static int parse_enum_value(const char *arg, const char * const *names, int *dst
     return -1;
 }
 
+/* --rendition <width>x<height>:<bitrate>:<file> */
+static int parse_rendition(CODEC *codec, char *arg)
+{
+    x264vfw_rendition_t *r;
+    int i_len = 0;
+
+    if (codec->i_renditions >= MAX_RENDITIONS)
+    {
+        x264vfw_log(codec, X264_LOG_ERROR, "too many renditions (%d at most)\n", MAX_RENDITIONS);
+        return -1;
+    }
+    r = &codec->rendition[codec->i_renditions];
+    memset(r, 0, sizeof(x264vfw_rendition_t));
+    if (sscanf(arg, "%dx%d:%d:%n", &r->i_width, &r->i_height, &r->i_bitrate, &i_len) < 3 || !i_len || !arg[i_len] ||
+        r->i_width <= 0 || r->i_height <= 0 || r->i_bitrate <= 0)
+        return -1;
+    r->file = arg + i_len;
+    codec->i_renditions++;
+    return 0;
+}
+
 /* Parse command line for all other options */
 static int parse_cmdline(int argc, char **argv, x264_param_t *param, CODEC *codec)
 {
-    EnterCriticalSection(&x264vfw_CS);
-
-    opterr = 0; /* Suppress error messages printing in getopt */
-    optind = 0; /* Initialize getopt */
+    opt_state_t st;
 
+    opt_init(&st);
     for (;;)
     {
         int b_error = 0;
         int long_options_index = -1;
-        int checked_optind = optind > 0 ? optind : 1;
-        int c = getopt_long(argc, argv, short_options, long_options, &long_options_index);
+        int c = opt_next(&st, argc, argv, short_options, long_options, &long_options_index);
 
         if (c == -1)
             break;
@@ -1255,17 +1643,17 @@ static int parse_cmdline(int argc, char **argv, x264_param_t *param, CODEC *code
             case OPT_TIMEBASE:
             case OPT_PULLDOWN:
             case OPT_OUTPUT_CSP:
-                x264vfw_log(codec, X264_LOG_WARNING, "not supported option: '%s'\n", argv[checked_optind]);
+                x264vfw_log(codec, X264_LOG_WARNING, "not supported option: '%s'\n", argv[st.i_opt]);
                 break;
 
             case 'o':
-                codec->cli_output_file = optarg;
+                codec->cli_output_file = st.arg;
                 break;
 
             case OPT_MUXER:
-                if (parse_enum_name(optarg, x264vfw_muxer_names, &codec->cli_output_muxer) < 0)
+                if (parse_enum_name(st.arg, x264vfw_muxer_names, &codec->cli_output_muxer) < 0)
                 {
-                    x264vfw_log(codec, X264_LOG_ERROR, "unknown muxer '%s'\n", optarg);
+                    x264vfw_log(codec, X264_LOG_ERROR, "unknown muxer '%s'\n", st.arg);
                     goto fail;
                 }
                 break;
@@ -1279,18 +1667,19 @@ static int parse_cmdline(int argc, char **argv, x264_param_t *param, CODEC *code
                 break;
 
             case OPT_LOG_LEVEL:
-                if (!parse_enum_value(optarg, x264vfw_log_level_names, &param->i_log_level))
+                if (!parse_enum_value(st.arg, x264vfw_log_level_names, &param->i_log_level))
                     param->i_log_level += X264_LOG_NONE;
                 else
-                    param->i_log_level = atoi(optarg);
+                    param->i_log_level = atoi(st.arg);
                 break;
 
             case OPT_TUNE:
             case OPT_PRESET:
+            case OPT_CONVERT_NV12:
                 break;
 
             case OPT_PROFILE:
-                codec->profile = optarg;
+                codec->profile = st.arg;
                 break;
 
             case OPT_FASTFIRSTPASS:
@@ -1319,62 +1708,913 @@ static int parse_cmdline(int argc, char **argv, x264_param_t *param, CODEC *code
                 codec->b_no_output = TRUE;
                 break;
 
-            case OPT_RANGE:
-                if (parse_enum_value(optarg, x264vfw_range_names, &param->vui.b_fullrange) < 0)
+            case OPT_CSP_THREADS:
+                codec->i_csp_threads = atoi(st.arg);
+                if (codec->i_csp_threads < 0)
                 {
-                    x264vfw_log(codec, X264_LOG_ERROR, "unknown range '%s'\n", optarg);
+                    x264vfw_log(codec, X264_LOG_ERROR, "invalid argument: '%s' = '%s'\n", argv[st.i_opt], st.arg);
                     goto fail;
                 }
-                param->vui.b_fullrange += RANGE_AUTO;
                 break;
 
-            default:
-generic_option:
-                if (long_options_index < 0)
+            case OPT_ASYNC_PICS:
+                codec->i_async_pics = atoi(st.arg);
+                if (codec->i_async_pics < 0 || codec->i_async_pics > MAX_ASYNC_PICS)
                 {
-                    int i;
+                    x264vfw_log(codec, X264_LOG_ERROR, "invalid argument: '%s' = '%s'\n", argv[st.i_opt], st.arg);
+                    goto fail;
+                }
+                break;
 
-                    for (i = 0; long_options[i].name; i++)
-                        if (long_options[i].val == c)
-                        {
-                            long_options_index = i;
-                            break;
-                        }
-                    if (long_options_index < 0)
-                    {
-                        x264vfw_log(codec, X264_LOG_ERROR, "unknown option or absent argument: '%s'\n", argv[checked_optind]);
-                        goto fail;
-                    }
+            case OPT_STATIC_FRAMES:
+                if (parse_enum_value(st.arg, x264vfw_static_frames_names, &codec->i_static_frames) < 0)
+                {
+                    x264vfw_log(codec, X264_LOG_ERROR, "unknown static frames mode '%s'\n", st.arg);
+                    goto fail;
                 }
-                b_error = x264_param_parse(param, long_options[long_options_index].name, optarg);
                 break;
-        }
 
-        if (b_error)
-        {
-            switch (b_error)
-            {
-                case X264_PARAM_BAD_NAME:
-                    x264vfw_log(codec, X264_LOG_ERROR, "unknown option: '%s'\n", argv[checked_optind]);
-                    break;
+            case OPT_TRACE:
+                codec->trace_file = st.arg;
+                break;
 
-                case X264_PARAM_BAD_VALUE:
-                    x264vfw_log(codec, X264_LOG_ERROR, "invalid argument: '%s' = '%s'\n", argv[checked_optind], optarg);
-                    break;
+            case OPT_STATS_SIDECAR:
+                codec->sidecar_file = st.arg;
+                break;
 
-                default:
-                    x264vfw_log(codec, X264_LOG_ERROR, "unknown error with option: '%s'\n", argv[checked_optind]);
-                    break;
-            }
-            goto fail;
-        }
-    }
+            case OPT_TELEMETRY:
+                codec->b_telemetry = TRUE;
+                break;
+
+            case OPT_NO_ENCODER_REUSE:
+                codec->b_encoder_reuse = FALSE;
+                break;
+
+            case OPT_DEADLINE:
+                codec->i_deadline = atoi(st.arg);
+                if (codec->i_deadline <= 0)
+                {
+                    x264vfw_log(codec, X264_LOG_ERROR, "invalid argument: '%s' = '%s'\n", argv[st.i_opt], st.arg);
+                    goto fail;
+                }
+                break;
+
+            case OPT_SPILL_2PASS:
+                codec->spill_file = st.arg;
+                break;
+
+            case OPT_DECODER_THREADS:
+            case OPT_DECODER_THREAD_TYPE:
+            case OPT_DECODER_CONVERT:
+            case OPT_DECODER_ADAPTIVE:
+                /* Used by x264vfw_decompress_begin */
+                break;
+
+            case OPT_RENDITION:
+                if (parse_rendition(codec, st.arg) < 0)
+                {
+                    x264vfw_log(codec, X264_LOG_ERROR, "invalid argument: '%s' = '%s'\n", argv[st.i_opt], st.arg);
+                    goto fail;
+                }
+                break;
+
+            case OPT_SPEED_CONTROL:
+                codec->f_speed = atof(st.arg);
+                if (codec->f_speed <= 0.0f)
+                {
+                    x264vfw_log(codec, X264_LOG_ERROR, "invalid argument: '%s' = '%s'\n", argv[st.i_opt], st.arg);
+                    goto fail;
+                }
+                break;
+
+            case OPT_RANGE:
+                if (parse_enum_value(st.arg, x264vfw_range_names, &param->vui.b_fullrange) < 0)
+                {
+                    x264vfw_log(codec, X264_LOG_ERROR, "unknown range '%s'\n", st.arg);
+                    goto fail;
+                }
+                param->vui.b_fullrange += RANGE_AUTO;
+                break;
+
+            default:
+generic_option:
+                if (long_options_index < 0)
+                {
+                    int i;
+
+                    for (i = 0; long_options[i].name; i++)
+                        if (long_options[i].val == c)
+                        {
+                            long_options_index = i;
+                            break;
+                        }
+                    if (long_options_index < 0)
+                    {
+                        x264vfw_log(codec, X264_LOG_ERROR, "unknown option or absent argument: '%s'\n", argv[st.i_opt]);
+                        goto fail;
+                    }
+                }
+                b_error = x264_param_parse(param, long_options[long_options_index].name, st.arg);
+                break;
+        }
+
+        if (b_error)
+        {
+            switch (b_error)
+            {
+                case X264_PARAM_BAD_NAME:
+                    x264vfw_log(codec, X264_LOG_ERROR, "unknown option: '%s'\n", argv[st.i_opt]);
+                    break;
+
+                case X264_PARAM_BAD_VALUE:
+                    x264vfw_log(codec, X264_LOG_ERROR, "invalid argument: '%s' = '%s'\n", argv[st.i_opt], st.arg);
+                    break;
+
+                default:
+                    x264vfw_log(codec, X264_LOG_ERROR, "unknown error with option: '%s'\n", argv[st.i_opt]);
+                    break;
+            }
+            goto fail;
+        }
+    }
+
+    return 0;
+fail:
+    return -1;
+}
+
+typedef struct
+{
+    x264vfw_csp_t convert;
+    x264_image_t *img_dst;
+    x264_image_t *img_src;
+    int i_width;
+    int i_height;
+    int i_band_height;
+    volatile LONG b_error;
+} csp_band_job_t;
+
+static void convert_band(void *arg, int i_job)
+{
+    csp_band_job_t *job = arg;
+    int i_y0 = i_job * job->i_band_height;
+    int i_y1 = X264_MIN(i_y0 + job->i_band_height, job->i_height);
+
+    if (i_y0 < i_y1 && job->convert(job->img_dst, job->img_src, job->i_width, job->i_height, i_y0, i_y1) < 0)
+        InterlockedExchange(&job->b_error, 1);
+}
+
+/* Convert the whole picture, split into row bands between the colorspace conversion threads */
+static int convert_picture(CODEC *codec, int i_csp, x264_image_t *img_dst, x264_image_t *img_src, int i_width, int i_height)
+{
+    csp_band_job_t job;
+    int i_bands = x264vfw_threadpool_threads(codec->csp_pool);
+
+    if (i_bands <= 1)
+        return codec->csp.convert[i_csp](img_dst, img_src, i_width, i_height, 0, i_height);
+
+    job.convert = codec->csp.convert[i_csp];
+    job.img_dst = img_dst;
+    job.img_src = img_src;
+    job.i_width = i_width;
+    job.i_height = i_height;
+    /* Band borders must be even for 4:2:0 */
+    job.i_band_height = ((i_height + i_bands - 1) / i_bands + 1) & ~1;
+    job.b_error = 0;
+    x264vfw_threadpool_run(codec->csp_pool, convert_band, &job, (i_height + job.i_band_height - 1) / job.i_band_height);
+    return job.b_error ? -1 : 0;
+}
+
+typedef struct
+{
+    CODEC *codec;
+    x264_image_t *img_dst;
+    x264_image_t *img_src;
+    int i_width;
+    int i_height;
+    volatile LONG b_error;
+} csp_tile_job_t;
+
+/* Convert the changed tiles of a row of tiles, adjacent ones at once */
+static void convert_tile_row(void *arg, int i_job)
+{
+    csp_tile_job_t *job = arg;
+    x264vfw_framediff_t *fd = &job->codec->framediff;
+    uint8_t *map = fd->map + i_job * fd->i_tiles_x;
+    int i_y0 = i_job * X264VFW_TILE_HEIGHT;
+    int i_y1 = X264_MIN(i_y0 + X264VFW_TILE_HEIGHT, job->i_height);
+    int x0 = 0;
+
+    while (x0 < fd->i_tiles_x)
+    {
+        int x1 = x0 + 1;
 
-    LeaveCriticalSection(&x264vfw_CS);
+        if (!map[x0])
+        {
+            x0++;
+            continue;
+        }
+        while (x1 < fd->i_tiles_x && map[x1])
+            x1++;
+        if (x264vfw_csp_convert_rect(&job->codec->csp, job->img_dst, job->img_src, job->i_width, job->i_height,
+                                     x0 * fd->i_tile_width, X264_MIN(x1 * fd->i_tile_width, job->i_width), i_y0, i_y1) < 0)
+            InterlockedExchange(&job->b_error, 1);
+        x0 = x1;
+    }
+}
+
+/* With static frame detection img_dst keeps the previous converted frame so only the tiles
+ * changed since then are converted, tile rows are split between the conversion threads */
+static int convert_changed_tiles(CODEC *codec, x264_image_t *img_dst, x264_image_t *img_src, int i_width, int i_height)
+{
+    csp_tile_job_t job;
+
+    job.codec = codec;
+    job.img_dst = img_dst;
+    job.img_src = img_src;
+    job.i_width = i_width;
+    job.i_height = i_height;
+    job.b_error = 0;
+    x264vfw_threadpool_run(codec->csp_pool, convert_tile_row, &job, codec->framediff.i_tiles_y);
+    return job.b_error ? -1 : 0;
+}
+
+/* Mostly changed pictures are faster to convert in whole */
+static int use_changed_tiles(CODEC *codec)
+{
+    x264vfw_framediff_t *fd = &codec->framediff;
+
+    return codec->i_static_frames != STATIC_FRAMES_OFF && fd->i_tiles_changed * 2 <= fd->i_tiles_x * fd->i_tiles_y;
+}
+
+/* Speed control: steps down (and back up) a ladder of analysis settings with x264_encoder_reconfig
+ * so that encoding keeps up with the frame rate. The buffer holds the time the encoder has in
+ * reserve: every frame adds its duration and takes away the time x264_encoder_encode took. */
+typedef struct
+{
+    int i_subme;
+    int i_me;
+    int i_ref;
+    int i_trellis;
+    int b_mixed_refs;
+} speed_level_t;
+
+/* Levels only lower the configured settings, SPEED_LEVELS is the configuration itself.
+ * b-adapt would be next but the lookahead can't be reconfigured. */
+static const speed_level_t speed_ladder[] =
+{
+    { 1, X264_ME_DIA, 1, 0, 0 },
+    { 2, X264_ME_DIA, 1, 0, 0 },
+    { 4, X264_ME_HEX, 1, 0, 0 },
+    { 5, X264_ME_HEX, 2, 0, 0 },
+    { 6, X264_ME_HEX, 2, 1, 1 },
+    { 7, X264_ME_HEX, 3, 1, 1 },
+    { 7, X264_ME_UMH, 4, 1, 1 },
+    { 8, X264_ME_UMH, 5, 2, 1 },
+    { 9, X264_ME_UMH, 8, 2, 1 },
+};
+#define SPEED_LEVELS ((int)ARRAY_ELEMS(speed_ladder))
+
+struct x264vfw_speed_t
+{
+    x264_param_t param;     /* configured settings */
+    int i_level;
+    int i_hold;             /* frames until the next step is allowed */
+    int i_steps;
+    int64_t i_freq;
+    double f_budget;        /* seconds per frame */
+    double f_size;          /* buffer size in seconds */
+    double f_fill;
+    double f_avg;           /* smoothed encode time per frame */
+};
+
+static x264vfw_speed_t *speed_create(CODEC *codec)
+{
+    x264vfw_speed_t *speed = calloc(1, sizeof(x264vfw_speed_t));
+    LARGE_INTEGER freq;
+
+    if (!speed)
+        return NULL;
+    x264_encoder_parameters(codec->h, &speed->param);
+    QueryPerformanceFrequency(&freq);
+    speed->i_freq = freq.QuadPart;
+    speed->i_level = SPEED_LEVELS;
+    speed->f_budget = (double)speed->param.i_fps_den / speed->param.i_fps_num / codec->f_speed;
+    speed->f_size = speed->f_budget * SPEED_BUFFER_FRAMES;
+    speed->f_fill = speed->f_size;
+    return speed;
+}
+
+static void speed_apply(CODEC *codec, x264vfw_speed_t *speed, int i_level)
+{
+    x264_param_t param = speed->param;
+
+    if (i_level < SPEED_LEVELS)
+    {
+        const speed_level_t *level = &speed_ladder[i_level];
+
+        /* x264 can't leave subme 0 */
+        if (param.analyse.i_subpel_refine)
+            param.analyse.i_subpel_refine = X264_MIN(param.analyse.i_subpel_refine, level->i_subme);
+        param.analyse.i_me_method = X264_MIN(param.analyse.i_me_method, level->i_me);
+        param.i_frame_reference = X264_MIN(param.i_frame_reference, level->i_ref);
+        param.analyse.i_trellis = X264_MIN(param.analyse.i_trellis, level->i_trellis);
+        param.analyse.b_mixed_references &= level->b_mixed_refs;
+    }
+    if (x264_encoder_reconfig(codec->h, &param) < 0)
+    {
+        x264vfw_log(codec, X264_LOG_WARNING, "speed control: x264_encoder_reconfig failed\n");
+        return;
+    }
+    speed->i_level = i_level;
+    speed->i_hold = SPEED_HOLD_FRAMES;
+    speed->i_steps++;
+    x264vfw_log(codec, X264_LOG_INFO, "speed control: level %d/%d (subme %d, me %s, ref %d, trellis %d), buffer %.0f%%, %.1f ms/frame\n",
+                i_level, SPEED_LEVELS, param.analyse.i_subpel_refine, x264_motion_est_names[param.analyse.i_me_method],
+                param.i_frame_reference, param.analyse.i_trellis, 100.0 * speed->f_fill / speed->f_size, speed->f_avg * 1000.0);
+}
+
+static void speed_update(CODEC *codec, x264vfw_speed_t *speed, int64_t i_ticks)
+{
+    double f_time = (double)i_ticks / speed->i_freq;
+
+    speed->f_avg = speed->f_avg > 0.0 ? speed->f_avg * 0.9 + f_time * 0.1 : f_time;
+    speed->f_fill = X264_MAX(X264_MIN(speed->f_fill + speed->f_budget - f_time, speed->f_size), 0.0);
+    if (speed->i_hold > 0)
+        speed->i_hold--;
+    /* Behind: the reserve is running out */
+    else if (speed->f_fill < speed->f_size * 0.25 && speed->i_level > 0)
+        speed_apply(codec, speed, speed->i_level - 1);
+    /* Headroom: the reserve is full and frames take clearly less than their duration */
+    else if (speed->f_fill > speed->f_size * 0.75 && speed->f_avg < speed->f_budget * 0.8 && speed->i_level < SPEED_LEVELS)
+        speed_apply(codec, speed, speed->i_level + 1);
+}
+
+/* Rows of plane i of a picture in one of the colorspaces passed to x264 */
+static int plane_rows(int i_csp, int i, int i_height)
+{
+    i_csp &= X264_CSP_MASK;
+    return i > 0 && (i_csp == X264_CSP_I420 || i_csp == X264_CSP_YV12 || i_csp == X264_CSP_NV12)
+           ? i_height / 2
+           : i_height;
+}
+
+/* A spill record is the pts followed by the planes without padding (keeps them 16-byte aligned) */
+#define SPILL_HEADER_SIZE 16
+
+/* Append a picture passed to the first pass encoder to the spill file */
+static int spill_picture(CODEC *codec, x264_picture_t *pic)
+{
+    uint8_t *dst = x264vfw_spill_append(codec->spill);
+    int i, y;
+
+    if (!dst)
+        return -1;
+    *(int64_t *)dst = pic->i_pts;
+    dst += SPILL_HEADER_SIZE;
+    /* The picture may be the input itself (zero-copy) so copy row by row */
+    for (i = 0; i < codec->spill_planes; i++)
+        for (y = 0; y < codec->spill_rows[i]; y++, dst += codec->spill_stride[i])
+            memcpy(dst, pic->img.plane[i] + y * pic->img.i_stride[i], codec->spill_stride[i]);
+    return 0;
+}
+
+/* Open the encoder and the output of a rendition, param - parameters of the primary encoder */
+static int rendition_open(CODEC *codec, x264vfw_rendition_t *r, const x264_param_t *param)
+{
+    x264_param_t rparam = *param;
+    char filename[MAX_PATH * 4];
+
+    /* Only the size and the rate control differ from the primary encoder */
+    rparam.i_width = r->i_width;
+    rparam.i_height = r->i_height;
+    rparam.rc.i_rc_method = X264_RC_ABR;
+    rparam.rc.i_bitrate = r->i_bitrate;
+    rparam.rc.i_vbv_max_bitrate = 0;
+    rparam.rc.i_vbv_buffer_size = 0;
+    rparam.i_nal_hrd = X264_NAL_HRD_NONE;
+    rparam.rc.b_stat_write = 0;
+    rparam.rc.b_stat_read = 0;
+    rparam.rc.psz_stat_out = NULL;
+    rparam.rc.psz_stat_in = NULL;
+    rparam.psz_dump_yuv = NULL;
+    /* Keep the display aspect ratio */
+    if ((int64_t)r->i_width * param->i_height != (int64_t)r->i_height * param->i_width)
+    {
+        int64_t i_sar_w = (int64_t)(param->vui.i_sar_width > 0 ? param->vui.i_sar_width : 1) * param->i_width * r->i_height;
+        int64_t i_sar_h = (int64_t)(param->vui.i_sar_height > 0 ? param->vui.i_sar_height : 1) * param->i_height * r->i_width;
+        int64_t a = i_sar_w, b = i_sar_h;
+
+        while (b)
+        {
+            int64_t t = a % b;
+            a = b;
+            b = t;
+        }
+        i_sar_w /= a;
+        i_sar_h /= a;
+        /* H.264 stores 16-bit values */
+        while (i_sar_w > 65535 || i_sar_h > 65535)
+        {
+            i_sar_w >>= 1;
+            i_sar_h >>= 1;
+        }
+        rparam.vui.i_sar_width = (int)i_sar_w;
+        rparam.vui.i_sar_height = (int)i_sar_h;
+    }
+    limit_frame_reference(&rparam);
+
+    side_filename(filename, sizeof(filename), r->file, codec->b_cli_output ? codec->cli_output_file : NULL, NULL);
+    r->file = NULL; /* points into the command line buffer */
+    if (x264vfw_scale_init(&r->scale, param->i_csp, param->i_width, param->i_height, r->i_width, r->i_height, param->cpu) < 0)
+    {
+        x264vfw_log(codec, X264_LOG_ERROR, "rendition %dx%d: can't scale %dx%d to it\n", r->i_width, r->i_height, param->i_width, param->i_height);
+        return -1;
+    }
+    if (x264_picture_alloc(&r->pic, rparam.i_csp, r->i_width, r->i_height) < 0)
+    {
+        x264vfw_log(codec, X264_LOG_ERROR, "x264_picture_alloc failed\n");
+        return -1;
+    }
+    if (select_output("auto", filename, &rparam, codec, &r->output) <= 0)
+    {
+        x264vfw_log(codec, X264_LOG_ERROR, "rendition %dx%d: invalid output file '%s'\n", r->i_width, r->i_height, filename);
+        return -1;
+    }
+    r->output_opt.p_private = codec;
+    if (r->output.open_file(filename, &r->hout, &r->output_opt) < 0)
+    {
+        r->hout = NULL;
+        x264vfw_log(codec, X264_LOG_ERROR, "could not open output file: '%s'\n", filename);
+        return -1;
+    }
+    r->h = x264_encoder_open(&rparam);
+    if (!r->h)
+    {
+        x264vfw_log(codec, X264_LOG_ERROR, "rendition %dx%d: x264_encoder_open failed\n", r->i_width, r->i_height);
+        return -1;
+    }
+    x264_encoder_parameters(r->h, &rparam);
+    if (cli_output_start(codec, r->h, &r->output, r->hout, &rparam) < 0)
+        return -1;
+    x264vfw_log(codec, X264_LOG_INFO, "rendition %dx%d at %d kb/s: '%s'\n", r->i_width, r->i_height, r->i_bitrate, filename);
+    return 0;
+}
+
+/* Scale the picture of the primary encoder and encode it, NULL flushes a delayed frame */
+static void rendition_encode(CODEC *codec, x264vfw_rendition_t *r, x264_picture_t *pic, int64_t i_pts, int i_type)
+{
+    x264_nal_t *nal;
+    int i_nal;
+    x264_picture_t pic_out;
+    int i_frame_size;
+
+    if (r->b_error)
+        return;
+    if (pic)
+    {
+        x264vfw_scale_image(r->scale, &r->pic.img, &pic->img);
+        r->pic.i_pts = i_pts;
+        r->pic.i_type = i_type;
+    }
+    i_frame_size = x264_encoder_encode(r->h, &nal, &i_nal, pic ? &r->pic : NULL, &pic_out);
+    if (i_frame_size > 0)
+    {
+        r->i_frames++;
+        r->i_bytes += i_frame_size;
+        i_frame_size = r->output.write_frame(r->hout, nal[0].p_payload, i_frame_size, &pic_out);
+    }
+    if (i_frame_size < 0)
+    {
+        x264vfw_log(codec, X264_LOG_ERROR, "rendition %dx%d: encoding failed, no more frames are written\n", r->i_width, r->i_height);
+        r->b_error = TRUE;
+    }
+}
+
+static void rendition_flush(void *arg, int i_job)
+{
+    CODEC *codec = arg;
+    x264vfw_rendition_t *r = &codec->rendition[i_job];
+
+    while (r->h && !r->b_error && x264_encoder_delayed_frames(r->h))
+        rendition_encode(codec, r, NULL, 0, X264_TYPE_AUTO);
+}
+
+/* Flush (unless b_flush is 0) and close all renditions */
+static void rendition_close_all(CODEC *codec, int b_flush)
+{
+    int i;
+
+    if (b_flush && codec->rendition_pool)
+        x264vfw_threadpool_run(codec->rendition_pool, rendition_flush, codec, codec->i_renditions);
+    for (i = 0; i < codec->i_renditions; i++)
+    {
+        x264vfw_rendition_t *r = &codec->rendition[i];
+
+        if (r->hout)
+        {
+            int64_t largest_pts = codec->conv_pic.i_pts - 1;
+            r->output.close_file(r->hout, largest_pts, largest_pts - 1);
+        }
+        if (r->h)
+        {
+            x264_encoder_close(r->h);
+            if (codec->i_fps_num > 0 && codec->i_fps_den > 0 && r->i_frames > 0)
+                x264vfw_log(codec, X264_LOG_INFO, "rendition %dx%d: %d frames, %.2f kb/s\n", r->i_width, r->i_height, r->i_frames,
+                            r->i_bytes * 8.0 / 1000.0 * codec->i_fps_num / codec->i_fps_den / r->i_frames);
+        }
+        x264vfw_scale_close(r->scale);
+        x264_picture_clean(&r->pic);
+        memset(r, 0, sizeof(x264vfw_rendition_t));
+    }
+    codec->i_renditions = 0;
+    x264vfw_threadpool_delete(codec->rendition_pool);
+    codec->rendition_pool = NULL;
+}
+
+/* x264_encoder_encode of the primary encoder, timed for speed control */
+static int primary_encode(CODEC *codec, x264_nal_t **nal, int *i_nal, x264_picture_t *pic, x264_picture_t *pic_out)
+{
+    int i_frame_size;
+
+    /* x264 stops the lookahead thread on the first flush, the encoder can't take new frames after it */
+    if (!pic)
+        codec->b_encoder_flushed = TRUE;
+    if (pic && codec->speed)
+    {
+        LARGE_INTEGER start, end;
+
+        QueryPerformanceCounter(&start);
+        i_frame_size = x264_encoder_encode(codec->h, nal, i_nal, pic, pic_out);
+        QueryPerformanceCounter(&end);
+        speed_update(codec, codec->speed, end.QuadPart - start.QuadPart);
+    }
+    else
+        i_frame_size = x264_encoder_encode(codec->h, nal, i_nal, pic, pic_out);
+    return i_frame_size;
+}
+
+typedef struct
+{
+    CODEC *codec;
+    x264_nal_t **nal;
+    int *i_nal;
+    x264_picture_t *pic;
+    x264_picture_t *pic_out;
+    int i_type;                 /* of the picture before the primary encoder changes */
+    int i_frame_size;
+} rendition_job_t;
+
+/* Job 0 is the primary encoder, the others are the renditions */
+static void rendition_job(void *arg, int i_job)
+{
+    rendition_job_t *job = arg;
+    CODEC *codec = job->codec;
+
+    if (!i_job)
+        job->i_frame_size = primary_encode(codec, job->nal, job->i_nal, job->pic, job->pic_out);
+    else
+        rendition_encode(codec, &codec->rendition[i_job - 1], job->pic, job->pic->i_pts - codec->i_pts_base, job->i_type);
+}
+
+/* An encoder reused by the next session continues its timeline, x264 sees the timestamps shifted by i_pts_base */
+static int encoder_encode(CODEC *codec, x264_nal_t **nal, int *i_nal, x264_picture_t *pic, x264_picture_t *pic_out)
+{
+    int i_frame_size;
+    int i_type = 0;
+
+    if (pic && codec->spill && spill_picture(codec, pic) < 0)
+    {
+        x264vfw_log(codec, X264_LOG_ERROR, "can't write picture to spill file\n");
+        return -1;
+    }
+    if (pic)
+    {
+        pic->i_pts += codec->i_pts_base;
+        i_type = pic->i_type;
+        /* The new session must not reference the pictures of the previous one */
+        if (codec->b_force_idr)
+            pic->i_type = X264_TYPE_IDR;
+    }
+    if (pic && codec->rendition_pool)
+    {
+        rendition_job_t job = { codec, nal, i_nal, pic, pic_out, i_type, 0 };
+
+        x264vfw_threadpool_run(codec->rendition_pool, rendition_job, &job, codec->i_renditions + 1);
+        i_frame_size = job.i_frame_size;
+    }
+    else
+        i_frame_size = primary_encode(codec, nal, i_nal, pic, pic_out);
+    if (pic)
+    {
+        pic->i_pts -= codec->i_pts_base;
+        pic->i_type = i_type;
+        codec->b_force_idr = FALSE;
+    }
+    if (i_frame_size > 0)
+    {
+        pic_out->i_pts -= codec->i_pts_base;
+        pic_out->i_dts -= codec->i_pts_base;
+    }
+    return i_frame_size;
+}
+
+/* Pipelined compress: the calling thread converts the input into one of the queued pictures
+ * and returns, while the encoder thread feeds them to x264 */
+typedef struct
+{
+    uint8_t *data;
+    int i_size;
+    int i_alloc;
+    int b_keyframe;
+} async_frame_t;
+
+struct x264vfw_async_t
+{
+    CODEC *codec;
+    HANDLE thread;
+    HANDLE hFree;           /* semaphore: pictures available for conversion */
+    HANDLE hQueued;         /* semaphore: converted pictures waiting for the encoder */
+    HANDLE hIdle;           /* manual-reset event: no picture is queued or being encoded */
+    CRITICAL_SECTION cs;    /* protects i_pending and the encoded frames queue */
+    int i_pics;
+    x264_picture_t pic[MAX_ASYNC_PICS];
+    int i_write;            /* accessed only by the calling thread */
+    int i_read;             /* accessed only by the encoder thread */
+    int i_pending;
+    /* Encoded frames waiting to be returned through VFW (at most i_pics at any time) */
+    async_frame_t frame[MAX_ASYNC_PICS + 1];
+    int i_frame_first;
+    int i_frame_count;
+    volatile LONG b_exit;
+    volatile LONG b_error;
+};
+
+/* The encoder thread may log into the window owned by the calling thread so process sent messages while waiting */
+static void async_wait(HANDLE handle)
+{
+    MSG msg;
+
+    while (MsgWaitForMultipleObjects(1, &handle, FALSE, INFINITE, QS_SENDMESSAGE) == WAIT_OBJECT_0 + 1)
+        PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE);
+}
+
+static int async_encode(x264vfw_async_t *async, x264_picture_t *pic)
+{
+    CODEC *codec = async->codec;
+    x264_nal_t *nal;
+    int i_nal;
+    x264_picture_t pic_out;
+    async_frame_t *frame;
+    int i_frame_size;
+    int64_t i_start;
+
+    i_start = X264VFW_TRACE_START(codec->trace);
+    i_frame_size = encoder_encode(codec, &nal, &i_nal, pic, &pic_out);
+    X264VFW_TRACE_END(codec->trace, X264VFW_TRACE_ENCODE, (int)pic->i_pts, i_start);
+    if (codec->telemetry)
+        x264vfw_telemetry_encoded(codec->telemetry, i_frame_size, x264_encoder_delayed_frames(codec->h));
+    if (i_frame_size > 0 && codec->sidecar)
+        x264vfw_sidecar_frame(codec->sidecar, &pic_out, i_frame_size);
+    if (i_frame_size <= 0 || codec->b_no_output)
+        return i_frame_size;
+    if (codec->b_cli_output)
+    {
+        i_start = X264VFW_TRACE_START(codec->trace);
+        i_frame_size = codec->cli_output.write_frame(codec->cli_hout, nal[0].p_payload, i_frame_size, &pic_out);
+        X264VFW_TRACE_END(codec->trace, X264VFW_TRACE_MUX, (int)pic_out.i_pts, i_start);
+        return i_frame_size;
+    }
+
+    EnterCriticalSection(&async->cs);
+    frame = async->i_frame_count < ARRAY_ELEMS(async->frame)
+            ? &async->frame[(async->i_frame_first + async->i_frame_count) % ARRAY_ELEMS(async->frame)]
+            : NULL;
+    LeaveCriticalSection(&async->cs);
+    if (!frame)
+        return -1;
+    if (frame->i_alloc < i_frame_size)
+    {
+        uint8_t *data = realloc(frame->data, i_frame_size);
+        if (!data)
+            return -1;
+        frame->data = data;
+        frame->i_alloc = i_frame_size;
+    }
+    memcpy(frame->data, nal[0].p_payload, i_frame_size);
+    frame->i_size = i_frame_size;
+    frame->b_keyframe = pic_out.b_keyframe;
+    EnterCriticalSection(&async->cs);
+    async->i_frame_count++;
+    LeaveCriticalSection(&async->cs);
+    return i_frame_size;
+}
+
+static unsigned __stdcall attribute_align_arg async_encoder_thread(void *arg)
+{
+    x264vfw_async_t *async = arg;
+
+    for (;;)
+    {
+        x264_picture_t *pic;
+
+        WaitForSingleObject(async->hQueued, INFINITE);
+        if (async->b_exit)
+            break;
+        pic = &async->pic[async->i_read];
+        async->i_read = (async->i_read + 1) % async->i_pics;
+        /* x264 copies the picture so it can be reused as soon as the call returns */
+        if (!async->b_error && async_encode(async, pic) < 0)
+            InterlockedExchange(&async->b_error, 1);
+        ReleaseSemaphore(async->hFree, 1, NULL);
+
+        EnterCriticalSection(&async->cs);
+        if (--async->i_pending == 0)
+            SetEvent(async->hIdle);
+        LeaveCriticalSection(&async->cs);
+    }
+    return 0;
+}
+
+/* Pictures submitted but not yet encoded */
+static int async_queued(x264vfw_async_t *async)
+{
+    int i_pending;
+
+    if (!async)
+        return 0;
+    EnterCriticalSection(&async->cs);
+    i_pending = async->i_pending;
+    LeaveCriticalSection(&async->cs);
+    return i_pending;
+}
+
+static void async_delete(x264vfw_async_t *async)
+{
+    int i;
+
+    if (!async)
+        return;
+    if (async->thread)
+    {
+        async_wait(async->hIdle);
+        InterlockedExchange(&async->b_exit, 1);
+        ReleaseSemaphore(async->hQueued, 1, NULL);
+        WaitForSingleObject(async->thread, INFINITE);
+        CloseHandle(async->thread);
+    }
+    if (async->hFree)
+        CloseHandle(async->hFree);
+    if (async->hQueued)
+        CloseHandle(async->hQueued);
+    if (async->hIdle)
+        CloseHandle(async->hIdle);
+    DeleteCriticalSection(&async->cs);
+    for (i = 0; i < async->i_pics; i++)
+        x264_picture_clean(&async->pic[i]);
+    for (i = 0; i < ARRAY_ELEMS(async->frame); i++)
+        free(async->frame[i].data);
+    free(async);
+}
+
+static x264vfw_async_t *async_create(CODEC *codec, x264_param_t *param, int i_pics)
+{
+    x264vfw_async_t *async = calloc(1, sizeof(x264vfw_async_t));
+    if (!async)
+        return NULL;
+
+    async->codec = codec;
+    InitializeCriticalSection(&async->cs);
+    for (async->i_pics = 0; async->i_pics < i_pics; async->i_pics++)
+        if (x264_picture_alloc(&async->pic[async->i_pics], param->i_csp, param->i_width, param->i_height) < 0)
+            goto fail;
+    async->hFree = CreateSemaphore(NULL, i_pics, i_pics, NULL);
+    /* +1 for the exit request */
+    async->hQueued = CreateSemaphore(NULL, 0, i_pics + 1, NULL);
+    async->hIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+    if (!async->hFree || !async->hQueued || !async->hIdle)
+        goto fail;
+    async->thread = (HANDLE)_beginthreadex(NULL, 0, async_encoder_thread, async, 0, NULL);
+    if (!async->thread)
+        goto fail;
+    return async;
+fail:
+    async_delete(async);
+    return NULL;
+}
+
+/* Copy a picture allocated by x264_picture_alloc */
+static void copy_picture(x264_picture_t *dst, x264_picture_t *src, int i_height)
+{
+    int i;
+
+    for (i = 0; i < src->img.i_plane; i++)
+        memcpy(dst->img.plane[i], src->img.plane[i], src->img.i_stride[i] * plane_rows(src->img.i_csp, i, i_height));
+}
+
+/* Convert the input into the next free picture and queue it for the encoder thread */
+static int async_submit(CODEC *codec, int i_csp, x264_image_t *img, int i_width, int i_height)
+{
+    x264vfw_async_t *async = codec->async;
+    x264_picture_t *pic;
+    int i_ret;
+    int64_t i_start;
+
+    async_wait(async->hFree);
+    if (async->b_error)
+    {
+        ReleaseSemaphore(async->hFree, 1, NULL);
+        x264vfw_log(codec, X264_LOG_ERROR, "x264_encoder_encode failed\n");
+        return -1;
+    }
+    pic = &async->pic[async->i_write];
+    i_start = X264VFW_TRACE_START(codec->trace);
+    if (use_changed_tiles(codec))
+    {
+        /* The previous picture is only written by the calling thread so it can be read while being encoded */
+        copy_picture(pic, &async->pic[(async->i_write + async->i_pics - 1) % async->i_pics], i_height);
+        i_ret = convert_changed_tiles(codec, &pic->img, img, i_width, i_height);
+    }
+    else
+        i_ret = convert_picture(codec, i_csp, &pic->img, img, i_width, i_height);
+    X264VFW_TRACE_END(codec->trace, X264VFW_TRACE_CONVERT, (int)codec->conv_pic.i_pts, i_start);
+    if (i_ret < 0)
+    {
+        ReleaseSemaphore(async->hFree, 1, NULL);
+        x264vfw_log(codec, X264_LOG_ERROR, "colorspace conversion failed\n");
+        return -1;
+    }
+    pic->i_pts = codec->conv_pic.i_pts;
+    pic->i_type = codec->b_deadline_idr ? X264_TYPE_IDR : X264_TYPE_AUTO;
+    codec->b_deadline_idr = FALSE;
+    async->i_write = (async->i_write + 1) % async->i_pics;
+
+    EnterCriticalSection(&async->cs);
+    if (async->i_pending++ == 0)
+        ResetEvent(async->hIdle);
+    LeaveCriticalSection(&async->cs);
+    ReleaseSemaphore(async->hQueued, 1, NULL);
     return 0;
-fail:
-    LeaveCriticalSection(&x264vfw_CS);
-    return -1;
+}
+
+/* Return the oldest frame encoded by the encoder thread (if any) */
+static int async_get_frame(CODEC *codec, x264_picture_t *pic_out, uint8_t *buf, DWORD buf_size, int *got_picture)
+{
+    x264vfw_async_t *async = codec->async;
+    async_frame_t *frame;
+    int i_frame_size;
+    int64_t i_start;
+
+    *got_picture = 0;
+    pic_out->b_keyframe = 0;
+    if (async->b_error)
+    {
+        x264vfw_log(codec, X264_LOG_ERROR, "x264_encoder_encode failed\n");
+        return -1;
+    }
+
+    EnterCriticalSection(&async->cs);
+    frame = async->i_frame_count ? &async->frame[async->i_frame_first] : NULL;
+    LeaveCriticalSection(&async->cs);
+    if (!frame)
+        return 0;
+
+    i_frame_size = frame->i_size;
+#if X264VFW_USE_BUGGY_APPS_HACK
+    if (i_frame_size > buf_size && codec->b_check_size)
+#else
+    if (i_frame_size > buf_size)
+#endif
+    {
+        x264vfw_log(codec, X264_LOG_ERROR, "output frame buffer too small (size %d / needed %d)\n", (int)buf_size, i_frame_size);
+        return -1;
+    }
+    i_start = X264VFW_TRACE_START(codec->trace);
+    memcpy(buf, frame->data, i_frame_size);
+    X264VFW_TRACE_END(codec->trace, X264VFW_TRACE_COPY, -1, i_start);
+    pic_out->b_keyframe = frame->b_keyframe;
+    *got_picture = 1;
+
+    EnterCriticalSection(&async->cs);
+    async->i_frame_first = (async->i_frame_first + 1) % ARRAY_ELEMS(async->frame);
+    async->i_frame_count--;
+    LeaveCriticalSection(&async->cs);
+    return i_frame_size;
+}
+
+/* Dropped frames leave gaps in timestamps which only VFR capable containers can keep */
+static int vfr_cli_output(CODEC *codec)
+{
+    return codec->b_cli_output && (codec->cli_output.write_frame == mkv_output.write_frame ||
+                                   codec->cli_output.write_frame == mp4_output.write_frame ||
+                                   codec->cli_output.write_frame == flv_output.write_frame);
+}
+
+/* Whether the encoder holds frames back before it outputs them (B-frames, lookahead or frame threads) */
+static int encoder_has_delay(const x264_param_t *param)
+{
+    return param->i_bframe || param->rc.i_lookahead || param->i_sync_lookahead ||
+           (param->i_threads > 1 && !param->b_sliced_threads);
 }
 
 /* Prepare to compress data */
@@ -1389,6 +2629,7 @@ LRESULT x264vfw_compress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *
     char *argv[MAX_ARG_NUM];
     char arg_mem[MAX_CMDLINE * 2];
     int argc;
+    x264vfw_reuse_key_t reuse_key;
 
     /* Destroy previous handle */
     x264vfw_compress_end(codec);
@@ -1402,6 +2643,18 @@ LRESULT x264vfw_compress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *
         return ICERR_BADFORMAT;
     }
 
+    /* Everything the encoder parameters are derived from (biSizeImage is changed by the compression itself) */
+    memset(&reuse_key, 0, sizeof(x264vfw_reuse_key_t));
+    memcpy(&reuse_key.config, config, sizeof(CONFIG));
+    reuse_key.i_width = lpbiInput->bmiHeader.biWidth;
+    reuse_key.i_height = lpbiInput->bmiHeader.biHeight;
+    reuse_key.i_bit_count = lpbiInput->bmiHeader.biBitCount;
+    reuse_key.input_fourcc = lpbiInput->bmiHeader.biCompression;
+    reuse_key.output_fourcc = lpbiOutput->bmiHeader.biCompression;
+    reuse_key.i_frame_total = codec->i_frame_total;
+    reuse_key.i_fps_num = codec->i_fps_num;
+    reuse_key.i_fps_den = codec->i_fps_den;
+
     /* Default internal codec params */
 #if X264VFW_USE_BUGGY_APPS_HACK
     codec->b_check_size = lpbiOutput->bmiHeader.biSizeImage != 0;
@@ -1413,6 +2666,18 @@ LRESULT x264vfw_compress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *
     codec->b_no_output = FALSE;
     codec->b_fast1pass = FALSE;
     codec->b_user_ref = FALSE;
+    codec->i_csp_threads = 0;
+    codec->i_async_pics = 0;
+    codec->b_convert_nv12 = FALSE;
+    codec->i_static_frames = STATIC_FRAMES_OFF;
+    codec->trace_file = NULL;
+    codec->sidecar_file = NULL;
+    codec->b_telemetry = FALSE;
+    codec->b_encoder_reuse = TRUE;
+    codec->f_speed = 0.0f;
+    codec->i_deadline = 0;
+    codec->spill_file = NULL;
+    codec->i_renditions = 0;
     codec->i_frame_remain = codec->i_frame_total ? codec->i_frame_total : -1;
 
     /* Preset/Tuning/Profile */
@@ -1469,7 +2734,7 @@ LRESULT x264vfw_compress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *
     /* Video Properties */
     param.i_width  = lpbiInput->bmiHeader.biWidth;
     param.i_height = abs(lpbiInput->bmiHeader.biHeight);
-    param.i_csp    = choose_output_csp(get_csp(&lpbiInput->bmiHeader), config->i_colorspace != CSP_CONVERT_TO_I420);
+    param.i_csp    = choose_output_csp(get_csp(&lpbiInput->bmiHeader), config->i_colorspace, codec->b_convert_nv12);
 
     /* ICM_COMPRESS_FRAMES_INFO params */
     param.i_frame_total = codec->i_frame_total;
@@ -1516,7 +2781,8 @@ LRESULT x264vfw_compress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *
         case 4: /* 2 PASS */
             param.rc.i_rc_method = X264_RC_ABR;
             param.rc.i_bitrate = config->i_passbitrate;
-            if (config->i_pass <= 1)
+            /* With --spill-2pass this session is the first pass, x264vfw_compress_end runs the second one */
+            if (config->i_pass <= 1 || codec->spill_file)
             {
                 codec->b_no_output = TRUE;
                 codec->b_fast1pass = config->b_fast1pass;
@@ -1562,6 +2828,16 @@ LRESULT x264vfw_compress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *
     /* Parse extra command line options */
     if (parse_cmdline(argc, argv, &param, codec) < 0)
         goto fail;
+    if (codec->spill_file && config->i_encoding_type != 4)
+    {
+        x264vfw_log(codec, X264_LOG_WARNING, "--spill-2pass requires 2 pass mode, ignored\n");
+        codec->spill_file = NULL;
+    }
+    if (codec->i_renditions && (codec->spill_file || (config->i_encoding_type == 4 && config->i_pass <= 1)))
+    {
+        x264vfw_log(codec, X264_LOG_WARNING, "--rendition is not used in the first pass, ignored\n");
+        codec->i_renditions = 0;
+    }
 
     /* VFW supports only CFR */
     param.b_vfr_input = 0;
@@ -1575,13 +2851,26 @@ LRESULT x264vfw_compress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *
         param.vui.i_colmatrix = 0; /* GBR */
     if (param.vui.i_colmatrix < 0)
         param.vui.i_colmatrix = 2; /* undef */
+#if X264_BIT_DEPTH > 8
+    /* High bit depth x264 only takes 16-bit pictures, the conversion writes them directly */
+    param.i_csp |= X264_CSP_HIGH_DEPTH;
+#endif
+
+    /* The second pass of --spill-2pass gets the settings without the first pass speedups */
+    if (codec->spill_file)
+    {
+        codec->spill_param = param;
+        codec->spill_param.rc.b_stat_write = config->b_updatestats;
+        codec->spill_param.rc.b_stat_read = 1;
+    }
 
     /* If "1st pass (fast)" mode or --fast-firstpass is used, apply faster settings. */
     if (codec->b_fast1pass)
         x264_param_apply_fastfirstpass(&param);
 
     /* Apply profile restrictions. */
-    if (x264_param_apply_profile(&param, codec->profile) < 0)
+    if (x264_param_apply_profile(&param, codec->profile) < 0 ||
+        (codec->spill_file && x264_param_apply_profile(&codec->spill_param, codec->profile) < 0))
     {
         x264vfw_log(codec, X264_LOG_ERROR, "x264_param_apply_profile failed\n");
         goto fail;
@@ -1591,74 +2880,105 @@ LRESULT x264vfw_compress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *
      * if the user didn't explicitly set a reference frame count. */
     if (!codec->b_user_ref)
     {
-        int i;
-        int mbs = (((param.i_width)+15)>>4) * (((param.i_height)+15)>>4);
-        for (i = 0; x264_levels[i].level_idc != 0; i++)
-            if (param.i_level_idc == x264_levels[i].level_idc)
-            {
-                while (mbs * param.i_frame_reference > x264_levels[i].dpb &&
-                       param.i_frame_reference > 1)
-                {
-                    param.i_frame_reference--;
-                }
-                break;
-            }
+        limit_frame_reference(&param);
+        if (codec->spill_file)
+            limit_frame_reference(&codec->spill_param);
     }
 
     /* Configure CLI output */
-    if (select_output(codec->cli_output_muxer, codec->cli_output_file, &param, codec) < 0)
+    codec->b_cli_output = select_output(codec->cli_output_muxer, codec->cli_output_file, &param, codec, &codec->cli_output);
+    if (codec->b_cli_output < 0)
         goto fail;
     if (!codec->b_cli_output)
     {
         param.b_annexb = 1;
         param.b_repeat_headers = 1; /* VFW needs SPS/PPS before each keyframe */
     }
+    if (codec->spill_file)
+    {
+        /* The host gets nothing from either pass */
+        if (!codec->b_cli_output)
+        {
+            x264vfw_log(codec, X264_LOG_ERROR, "--spill-2pass requires 'File' output mode\n");
+            goto fail;
+        }
+        codec->spill_param.b_annexb = param.b_annexb;
+        codec->spill_param.b_repeat_headers = param.b_repeat_headers;
+        codec->spill_param.i_nal_hrd = param.i_nal_hrd;
+        /* Both names point into buffers of this function */
+        codec->spill_stats = strdup(stats);
+        codec->spill_output = strdup(codec->cli_output_file);
+        if (!codec->spill_stats || !codec->spill_output)
+        {
+            x264vfw_log(codec, X264_LOG_ERROR, "malloc failed\n");
+            goto fail;
+        }
+        codec->spill_param.rc.psz_stat_out = codec->spill_stats;
+        codec->spill_param.rc.psz_stat_in = codec->spill_stats;
+    }
     if (!codec->b_no_output && codec->b_cli_output && codec->cli_output.open_file(codec->cli_output_file, &codec->cli_hout, &codec->cli_output_opt) < 0)
     {
         x264vfw_log(codec, X264_LOG_ERROR, "could not open output file: '%s'\n", codec->cli_output_file);
         goto fail;
     }
 
-    /* Open the encoder */
-    codec->h = x264_encoder_open(&param);
-    if (!codec->h)
+    /* Open the encoder (or take the one left by the previous session with the same settings) */
+    if (codec->reuse_h && codec->b_encoder_reuse && !memcmp(&reuse_key, &codec->reuse_key, sizeof(x264vfw_reuse_key_t)) &&
+        x264_encoder_reconfig(codec->reuse_h, &param) >= 0)
     {
-        x264vfw_log(codec, X264_LOG_ERROR, "x264_encoder_open failed\n");
-        goto fail;
+        codec->h = codec->reuse_h;
+        codec->reuse_h = NULL;
+        codec->i_pts_base = codec->reuse_pts;
+        codec->b_force_idr = TRUE;
+        x264vfw_log(codec, X264_LOG_DEBUG, "reusing the encoder of the previous session\n");
+    }
+    else
+    {
+        x264vfw_compress_release(codec);
+        codec->i_pts_base = 0;
+        codec->b_force_idr = FALSE;
+        codec->b_encoder_flushed = FALSE;
+        codec->h = x264_encoder_open(&param);
+        if (!codec->h)
+        {
+            x264vfw_log(codec, X264_LOG_ERROR, "x264_encoder_open failed\n");
+            goto fail;
+        }
+    }
+    codec->reuse_key = reuse_key;
+    if (codec->f_speed > 0.0f)
+    {
+        codec->speed = speed_create(codec);
+        if (!codec->speed)
+        {
+            x264vfw_log(codec, X264_LOG_ERROR, "failed to init speed control\n");
+            goto fail;
+        }
     }
 
     x264_encoder_parameters(codec->h, &param);
 
+    if (codec->i_renditions)
+    {
+        int i;
+
+        for (i = 0; i < codec->i_renditions; i++)
+            if (rendition_open(codec, &codec->rendition[i], &param) < 0)
+                goto fail;
+        if (x264vfw_threadpool_init(&codec->rendition_pool, codec->i_renditions + 1) < 0)
+        {
+            x264vfw_log(codec, X264_LOG_ERROR, "failed to create rendition threads\n");
+            goto fail;
+        }
+    }
+
     if (codec->b_cli_output)
     {
 #if X264VFW_USE_VIRTUALDUB_HACK
         codec->b_use_vd_hack = FALSE;
 #endif
-        if (!codec->b_no_output)
-        {
-            if (codec->cli_output.set_param(codec->cli_hout, &param) < 0)
-            {
-                x264vfw_log(codec, X264_LOG_ERROR, "can't set outfile param\n");
-                goto fail;
-            }
-            if (!param.b_repeat_headers)
-            {
-                /* Write SPS/PPS/SEI */
-                x264_nal_t *headers;
-                int i_nal;
-
-                if (x264_encoder_headers(codec->h, &headers, &i_nal) < 0)
-                {
-                    x264vfw_log(codec, X264_LOG_ERROR, "x264_encoder_headers failed\n");
-                    goto fail;
-                }
-                if (codec->cli_output.write_headers(codec->cli_hout, headers) < 0)
-                {
-                    x264vfw_log(codec, X264_LOG_ERROR, "can't write SPS/PPS/SEI to outfile\n");
-                    goto fail;
-                }
-            }
-        }
+        if (!codec->b_no_output && cli_output_start(codec, codec->h, &codec->cli_output, codec->cli_hout, &param) < 0)
+            goto fail;
     }
 
 #if X264VFW_USE_VIRTUALDUB_HACK
@@ -1669,11 +2989,167 @@ LRESULT x264vfw_compress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *
     codec->b_flush_delayed = codec->b_cli_output || param.rc.b_stat_write;
 
     /* Colorspace conversion */
-    x264vfw_csp_init(&codec->csp, param.i_csp, param.vui.i_colmatrix, param.vui.b_fullrange);
-    if (x264_picture_alloc(&codec->conv_pic, param.i_csp, param.i_width, param.i_height) < 0)
+    x264vfw_csp_init(&codec->csp, param.i_csp, param.vui.i_colmatrix, param.vui.b_fullrange, param.cpu);
+    if (codec->i_async_pics > 0)
     {
-        x264vfw_log(codec, X264_LOG_ERROR, "x264_picture_alloc failed\n");
-        goto fail;
+        /* Frames come out of the encoder later than in the synchronous mode so only
+         * the modes which already handle delayed frames can use it */
+#if X264VFW_USE_VIRTUALDUB_HACK
+        if (codec->b_cli_output || codec->b_use_vd_hack)
+#else
+        if (codec->b_cli_output)
+#endif
+        {
+            codec->async = async_create(codec, &param, codec->i_async_pics);
+            if (!codec->async)
+            {
+                x264vfw_log(codec, X264_LOG_ERROR, "failed to create encoder thread\n");
+                goto fail;
+            }
+            x264vfw_log(codec, X264_LOG_DEBUG, "pipelined compress with %d queued pictures\n", codec->i_async_pics);
+        }
+        else
+#if X264VFW_USE_VIRTUALDUB_HACK
+            x264vfw_log(codec, X264_LOG_WARNING, "--async-pics requires 'File' output mode or 'VirtualDub Hack', ignored\n");
+#else
+            x264vfw_log(codec, X264_LOG_WARNING, "--async-pics requires 'File' output mode, ignored\n");
+#endif
+    }
+    if (codec->i_static_frames != STATIC_FRAMES_OFF)
+    {
+        x264_image_t img;
+
+        /* Only the layout of the input is needed here */
+        memset(&img, 0, sizeof(x264_image_t));
+        img.i_csp = get_csp(&lpbiInput->bmiHeader);
+        if (x264vfw_img_fill(&img, NULL, img.i_csp, param.i_width, param.i_height) < 0 ||
+            x264vfw_framediff_init(&codec->framediff, &img, param.i_width, param.i_height, param.cpu) < 0)
+        {
+            x264vfw_log(codec, X264_LOG_ERROR, "failed to init static frame detection\n");
+            goto fail;
+        }
+        if (codec->i_static_frames == STATIC_FRAMES_DROP && !vfr_cli_output(codec))
+        {
+            x264vfw_log(codec, X264_LOG_WARNING, "--static-frames drop requires 'File' output mode with mkv, mp4 or flv muxer, using reuse\n");
+            codec->i_static_frames = STATIC_FRAMES_REUSE;
+        }
+    }
+    if (codec->i_deadline)
+    {
+        /* In VFW mode a zero-size frame keeps its place in the AVI timeline */
+        if (codec->b_cli_output && !vfr_cli_output(codec))
+        {
+            x264vfw_log(codec, X264_LOG_WARNING, "--deadline requires VFW output or 'File' output mode with mkv, mp4 or flv muxer, ignored\n");
+            codec->i_deadline = 0;
+        }
+        /* The AVI slot of a call holds the frame that comes out of the encoder, so with a delay the
+         * zero-size frame would land that many frames before the dropped input */
+        else if (!codec->b_cli_output && (codec->async || encoder_has_delay(&param)))
+        {
+            x264vfw_log(codec, X264_LOG_WARNING, "--deadline with VFW output requires an encoder without delay (no B-frames, lookahead, "
+                        "sync-lookahead or frame threads, e.g. --tune zerolatency) and no --async-pics, ignored\n");
+            codec->i_deadline = 0;
+        }
+        else
+        {
+            LARGE_INTEGER freq;
+
+            QueryPerformanceFrequency(&freq);
+            codec->f_deadline_frame = (double)freq.QuadPart * param.i_fps_den / param.i_fps_num;
+            codec->f_deadline_limit = (double)freq.QuadPart * codec->i_deadline / 1000.0;
+            codec->i_deadline_origin = 0;
+            codec->i_deadline_run = 0;
+            codec->i_deadline_drops = 0;
+            codec->b_deadline_idr = FALSE;
+        }
+    }
+    /* With pipelined compress conv_pic only counts timestamps */
+    if (!codec->async)
+    {
+        if (codec->reuse_pic.img.plane[0])
+        {
+            /* Same settings so same colorspace and size */
+            codec->conv_pic = codec->reuse_pic;
+            codec->conv_pic.i_pts = 0;
+            memset(&codec->reuse_pic, 0, sizeof(x264_picture_t));
+        }
+        else if (x264_picture_alloc(&codec->conv_pic, param.i_csp, param.i_width, param.i_height) < 0)
+        {
+            x264vfw_log(codec, X264_LOG_ERROR, "x264_picture_alloc failed\n");
+            goto fail;
+        }
+    }
+    x264_picture_clean(&codec->reuse_pic);
+    memset(&codec->reuse_pic, 0, sizeof(x264_picture_t));
+    {
+        int i_csp_threads = codec->i_csp_threads
+                            ? codec->i_csp_threads
+                            : X264_MIN(x264vfw_cpu_num_processors(), MAX_CSP_AUTO_THREADS);
+
+        /* Too thin bands cost more in synchronization than they gain */
+        i_csp_threads = X264_MIN(i_csp_threads, X264_MAX(param.i_height / MIN_CSP_BAND_HEIGHT, 1));
+        if (i_csp_threads > 1)
+        {
+            if (x264vfw_threadpool_init(&codec->csp_pool, i_csp_threads) < 0)
+                x264vfw_log(codec, X264_LOG_WARNING, "failed to create colorspace conversion threads\n");
+            else
+                x264vfw_log(codec, X264_LOG_DEBUG, "colorspace conversion threads: %d\n", i_csp_threads);
+        }
+    }
+    if (codec->spill_file)
+    {
+        char spill_file[MAX_PATH * 4];
+        x264_picture_t pic;
+        int i, i_record_size = SPILL_HEADER_SIZE;
+
+        /* Pictures are spilled in the layout of x264_picture_alloc */
+        if (x264_picture_alloc(&pic, param.i_csp, param.i_width, param.i_height) < 0)
+        {
+            x264vfw_log(codec, X264_LOG_ERROR, "x264_picture_alloc failed\n");
+            goto fail;
+        }
+        codec->spill_planes = pic.img.i_plane;
+        for (i = 0; i < pic.img.i_plane; i++)
+        {
+            codec->spill_stride[i] = pic.img.i_stride[i];
+            codec->spill_rows[i] = plane_rows(param.i_csp, i, param.i_height);
+            i_record_size += codec->spill_stride[i] * codec->spill_rows[i];
+        }
+        x264_picture_clean(&pic);
+        side_filename(spill_file, sizeof(spill_file), codec->spill_file, codec->cli_output_file, NULL);
+        codec->spill_file = NULL;
+        if (x264vfw_spill_open(&codec->spill, spill_file, i_record_size) < 0)
+        {
+            x264vfw_log(codec, X264_LOG_ERROR, "could not create spill file: '%s'\n", spill_file);
+            goto fail;
+        }
+        x264vfw_log(codec, X264_LOG_INFO, "first pass, the pictures are spilled to '%s'\n", spill_file);
+    }
+    if (codec->trace_file)
+    {
+        char trace_file[MAX_PATH * 4];
+
+        side_filename(trace_file, sizeof(trace_file), codec->trace_file, codec->b_cli_output ? codec->cli_output_file : NULL, NULL);
+        if (x264vfw_trace_open(&codec->trace, trace_file) < 0)
+            x264vfw_log(codec, X264_LOG_WARNING, "could not open trace file: '%s'\n", trace_file);
+        codec->trace_file = NULL; /* points into the command line buffer */
+    }
+    if (codec->sidecar_file)
+    {
+        char sidecar_file[MAX_PATH * 4];
+
+        side_filename(sidecar_file, sizeof(sidecar_file), codec->sidecar_file, codec->b_cli_output ? codec->cli_output_file : NULL, NULL);
+        if (x264vfw_sidecar_open(&codec->sidecar, sidecar_file) < 0)
+            x264vfw_log(codec, X264_LOG_WARNING, "could not open stats sidecar file: '%s'\n", sidecar_file);
+        codec->sidecar_file = NULL;
+    }
+    if (codec->b_telemetry)
+    {
+        if (x264vfw_telemetry_open(&codec->telemetry, param.i_fps_num, param.i_fps_den) < 0)
+            x264vfw_log(codec, X264_LOG_WARNING, "could not create telemetry shared memory\n");
+        else
+            x264vfw_log(codec, X264_LOG_INFO, "telemetry: process %lu, instance %d\n",
+                        (unsigned long)GetCurrentProcessId(), x264vfw_telemetry_instance(codec->telemetry));
     }
 
     return ICERR_OK;
@@ -1688,9 +3164,14 @@ static int encode_frame(CODEC *codec, x264_picture_t *pic, x264_picture_t *pic_o
     x264_nal_t *nal;
     int        i_nal;
     int        i_frame_size;
+    int64_t    i_start;
 
     *got_picture = 0;
-    i_frame_size = x264_encoder_encode(codec->h, &nal, &i_nal, pic, pic_out);
+    i_start = X264VFW_TRACE_START(codec->trace);
+    i_frame_size = encoder_encode(codec, &nal, &i_nal, pic, pic_out);
+    X264VFW_TRACE_END(codec->trace, X264VFW_TRACE_ENCODE, pic ? (int)pic->i_pts : -1, i_start);
+    if (codec->telemetry)
+        x264vfw_telemetry_encoded(codec->telemetry, i_frame_size, x264_encoder_delayed_frames(codec->h));
     if (i_frame_size < 0)
     {
         x264vfw_log(codec, X264_LOG_ERROR, "x264_encoder_encode failed\n");
@@ -1699,12 +3180,21 @@ static int encode_frame(CODEC *codec, x264_picture_t *pic, x264_picture_t *pic_o
     if (i_frame_size)
     {
         *got_picture = 1;
+        if (codec->sidecar)
+            x264vfw_sidecar_frame(codec->sidecar, pic_out, i_frame_size);
         if (!codec->b_no_output && codec->b_cli_output)
-            if (codec->cli_output.write_frame(codec->cli_hout, nal[0].p_payload, i_frame_size, pic_out) < 0)
+        {
+            int i_ret;
+
+            i_start = X264VFW_TRACE_START(codec->trace);
+            i_ret = codec->cli_output.write_frame(codec->cli_hout, nal[0].p_payload, i_frame_size, pic_out);
+            X264VFW_TRACE_END(codec->trace, X264VFW_TRACE_MUX, (int)pic_out->i_pts, i_start);
+            if (i_ret < 0)
             {
                 x264vfw_log(codec, X264_LOG_ERROR, "can't write frame to outfile\n");
                 return -1;
             }
+        }
         if (!(codec->b_no_output || codec->b_cli_output) && buf)
         {
 #if X264VFW_USE_BUGGY_APPS_HACK
@@ -1716,7 +3206,9 @@ static int encode_frame(CODEC *codec, x264_picture_t *pic, x264_picture_t *pic_o
                 x264vfw_log(codec, X264_LOG_ERROR, "output frame buffer too small (size %d / needed %d)\n", (int)buf_size, i_frame_size);
                 return -1;
             }
+            i_start = X264VFW_TRACE_START(codec->trace);
             memcpy(buf, nal[0].p_payload, i_frame_size);
+            X264VFW_TRACE_END(codec->trace, X264VFW_TRACE_COPY, (int)pic_out->i_pts, i_start);
         }
         else
             i_frame_size = 0;
@@ -1724,13 +3216,47 @@ static int encode_frame(CODEC *codec, x264_picture_t *pic, x264_picture_t *pic_o
     return i_frame_size;
 }
 
-/* Compress a frame of data */
-LRESULT x264vfw_compress(CODEC *codec, ICCOMPRESS *icc)
+/* Deadline mode: frame n is due n frame durations after the first one, frames later than
+ * --deadline ms are dropped without being converted or encoded */
+static int deadline_late(CODEC *codec)
+{
+    LARGE_INTEGER now;
+    double f_lag;
+
+    QueryPerformanceCounter(&now);
+    if (!codec->i_deadline_origin)
+        codec->i_deadline_origin = now.QuadPart;
+    f_lag = now.QuadPart - codec->i_deadline_origin - codec->conv_pic.i_pts * codec->f_deadline_frame;
+    /* Frames coming early give no credit to the later ones */
+    if (f_lag < 0.0)
+    {
+        codec->i_deadline_origin += (int64_t)f_lag;
+        f_lag = 0.0;
+    }
+    if (f_lag <= codec->f_deadline_limit)
+    {
+        /* Recover from a long run of drops with a clean start for the decoder */
+        if (codec->i_deadline_run >= DEADLINE_IDR_DROPS)
+            codec->b_deadline_idr = TRUE;
+        codec->i_deadline_run = 0;
+        return 0;
+    }
+    if (!codec->i_deadline_run)
+        x264vfw_log(codec, X264_LOG_DEBUG, "frame %d: %.1f ms late, dropping\n",
+                    (int)codec->conv_pic.i_pts, f_lag * codec->i_deadline / codec->f_deadline_limit);
+    codec->i_deadline_run++;
+    codec->i_deadline_drops++;
+    return 1;
+}
+
+/* Encode one input frame (or flush one delayed frame if the input is over) */
+static LRESULT compress_frame(CODEC *codec, ICCOMPRESS *icc)
 {
     BITMAPINFOHEADER *inhdr = icc->lpbiInput;
     BITMAPINFOHEADER *outhdr = icc->lpbiOutput;
 
     x264_picture_t pic;
+    x264_picture_t *pic_in;
     x264_picture_t pic_out;
 
     int        i_out;
@@ -1739,6 +3265,9 @@ LRESULT x264vfw_compress(CODEC *codec, ICCOMPRESS *icc)
     int        i_csp;
     int        iWidth;
     int        iHeight;
+    int        b_static = 0;
+    int        b_late = 0;
+    int64_t    i_start;
 
 #if X264VFW_USE_BUGGY_APPS_HACK
     /* Workaround for the bug in some weird applications
@@ -1756,6 +3285,8 @@ LRESULT x264vfw_compress(CODEC *codec, ICCOMPRESS *icc)
     {
         if (codec->i_frame_remain != -1)
             codec->i_frame_remain--;
+        if (codec->sidecar)
+            x264vfw_sidecar_submit(codec->sidecar, codec->conv_pic.i_pts);
 
         /* Init the picture */
         memset(&pic, 0, sizeof(x264_picture_t));
@@ -1771,20 +3302,106 @@ LRESULT x264vfw_compress(CODEC *codec, ICCOMPRESS *icc)
             return ICERR_BADFORMAT;
         }
 
-        if (codec->csp.convert[i_csp](&codec->conv_pic.img, &pic.img, iWidth, iHeight) < 0)
+        if (codec->i_deadline)
+            b_late = deadline_late(codec);
+
+        /* Dropped frames are not compared so the reference stays the last converted one */
+        if (codec->i_static_frames != STATIC_FRAMES_OFF && !b_late)
         {
-            x264vfw_log(codec, X264_LOG_ERROR, "colorspace conversion failed\n");
-            codec->b_encoder_error = TRUE;
-            return ICERR_ERROR;
+            x264vfw_framediff_t *fd = &codec->framediff;
+            int i_changed;
+
+            i_start = X264VFW_TRACE_START(codec->trace);
+            i_changed = x264vfw_framediff_update(fd, &pic.img);
+            X264VFW_TRACE_END(codec->trace, X264VFW_TRACE_DIFF, (int)codec->conv_pic.i_pts, i_start);
+
+            x264vfw_log(codec, X264_LOG_DEBUG, "frame %d: %.1f%% of tiles changed\n",
+                        (int)codec->conv_pic.i_pts, 100.0 * i_changed / (fd->i_tiles_x * fd->i_tiles_y));
+            b_static = i_changed == 0;
+            codec->i_static_count += b_static;
+        }
+
+        if (b_late)
+        {
+            /* Zero-size frame: VFW keeps it as a dropped frame, containers show the previous frame longer */
+            codec->conv_pic.i_pts++;
+            i_out = 0;
+            got_picture = 0;
+            pic_out.b_keyframe = 0;
+        }
+        else if (b_static && codec->i_static_frames == STATIC_FRAMES_DROP)
+        {
+            /* The container shows the previous frame until the next timestamp */
+            codec->conv_pic.i_pts++;
+            if (codec->async)
+                i_out = async_get_frame(codec, &pic_out, icc->lpOutput, outhdr->biSizeImage, &got_picture);
+            else
+            {
+                i_out = 0;
+                got_picture = 0;
+                pic_out.b_keyframe = 0;
+            }
+        }
+        else if (codec->async)
+        {
+            /* The input can't be referenced after return so it is always converted */
+            if (async_submit(codec, i_csp, &pic.img, iWidth, iHeight) < 0)
+            {
+                codec->b_encoder_error = TRUE;
+                return ICERR_ERROR;
+            }
+            codec->conv_pic.i_pts++;
+            i_out = async_get_frame(codec, &pic_out, icc->lpOutput, outhdr->biSizeImage, &got_picture);
         }
+        else
+        {
+            pic_in = &codec->conv_pic;
+            if (x264vfw_img_direct(&pic.img, codec->conv_pic.img.i_csp, codec->spill || codec->rendition_pool))
+            {
+                /* Zero-copy: encode straight from the input frame */
+                x264_image_t img = pic.img;
+                pic = codec->conv_pic;
+                pic.img = img;
+                pic_in = &pic;
+            }
+            /* conv_pic still holds the previous frame, unchanged input needs no conversion at all */
+            else if (!b_static || !use_changed_tiles(codec))
+            {
+                int i_ret;
+
+                i_start = X264VFW_TRACE_START(codec->trace);
+                if (use_changed_tiles(codec))
+                    i_ret = convert_changed_tiles(codec, &codec->conv_pic.img, &pic.img, iWidth, iHeight);
+                else
+                    i_ret = convert_picture(codec, i_csp, &codec->conv_pic.img, &pic.img, iWidth, iHeight);
+                X264VFW_TRACE_END(codec->trace, X264VFW_TRACE_CONVERT, (int)codec->conv_pic.i_pts, i_start);
+                if (i_ret < 0)
+                {
+                    x264vfw_log(codec, X264_LOG_ERROR, "colorspace conversion failed\n");
+                    codec->b_encoder_error = TRUE;
+                    return ICERR_ERROR;
+                }
+            }
 
-        /* Support keyframe forcing */
-        /* Disabled because VirtualDub incorrectly force them with "VirtualDub Hack" option */
-        //codec->conv_pic.i_type = icc->dwFlags & ICCOMPRESS_KEYFRAME ? X264_TYPE_IDR : X264_TYPE_AUTO;
+            /* Support keyframe forcing */
+            /* Disabled because VirtualDub incorrectly force them with "VirtualDub Hack" option */
+            //codec->conv_pic.i_type = icc->dwFlags & ICCOMPRESS_KEYFRAME ? X264_TYPE_IDR : X264_TYPE_AUTO;
 
-        /* Encode it */
-        i_out = encode_frame(codec, &codec->conv_pic, &pic_out, icc->lpOutput, outhdr->biSizeImage, &got_picture);
-        codec->conv_pic.i_pts++;
+            pic_in->i_type = codec->b_deadline_idr ? X264_TYPE_IDR : X264_TYPE_AUTO;
+            codec->b_deadline_idr = FALSE;
+
+            /* Encode it */
+            i_out = encode_frame(codec, pic_in, &pic_out, icc->lpOutput, outhdr->biSizeImage, &got_picture);
+            codec->conv_pic.i_pts++;
+        }
+    }
+    else if (codec->async)
+    {
+        /* No more input: return the frames still queued and then flush the delayed ones */
+        async_wait(codec->async->hIdle);
+        i_out = async_get_frame(codec, &pic_out, icc->lpOutput, outhdr->biSizeImage, &got_picture);
+        if (i_out == 0 && !got_picture)
+            i_out = encode_frame(codec, NULL, &pic_out, icc->lpOutput, outhdr->biSizeImage, &got_picture);
     }
     else
         i_out = encode_frame(codec, NULL, &pic_out, icc->lpOutput, outhdr->biSizeImage, &got_picture);
@@ -1795,7 +3412,7 @@ LRESULT x264vfw_compress(CODEC *codec, ICCOMPRESS *icc)
         return ICERR_ERROR;
     }
 
-    if (!got_picture && codec->b_warn_frame_loss)
+    if (!got_picture && !b_late && codec->b_warn_frame_loss)
     {
         codec->b_warn_frame_loss = FALSE;
         x264vfw_log(codec, X264_LOG_WARNING, "Few frames probably would be lost. Ways to fix this:\n");
@@ -1808,9 +3425,9 @@ LRESULT x264vfw_compress(CODEC *codec, ICCOMPRESS *icc)
 
 #if X264VFW_USE_VIRTUALDUB_HACK
 #if X264VFW_USE_BUGGY_APPS_HACK
-    if (codec->b_use_vd_hack && !got_picture && (outhdr->biSizeImage > 0 || !codec->b_check_size))
+    if (codec->b_use_vd_hack && !got_picture && !b_late && (outhdr->biSizeImage > 0 || !codec->b_check_size))
 #else
-    if (codec->b_use_vd_hack && !got_picture && outhdr->biSizeImage > 0)
+    if (codec->b_use_vd_hack && !got_picture && !b_late && outhdr->biSizeImage > 0)
 #endif
     {
         *icc->lpdwFlags = 0;
@@ -1834,9 +3451,131 @@ LRESULT x264vfw_compress(CODEC *codec, ICCOMPRESS *icc)
     return ICERR_OK;
 }
 
+/* Compress a frame of data */
+LRESULT x264vfw_compress(CODEC *codec, ICCOMPRESS *icc)
+{
+    int     i_frame = (int)codec->conv_pic.i_pts;
+    int     b_input = codec->i_frame_remain != 0;
+    int64_t i_start = X264VFW_TRACE_START(codec->trace);
+    LRESULT ret = compress_frame(codec, icc);
+
+    X264VFW_TRACE_END(codec->trace, X264VFW_TRACE_COMPRESS, i_frame, i_start);
+    if (codec->telemetry)
+        x264vfw_telemetry_update(codec->telemetry, b_input, async_queued(codec->async),
+                                 (codec->i_static_frames == STATIC_FRAMES_DROP ? codec->i_static_count : 0) + codec->i_deadline_drops);
+    return ret;
+}
+
+/* Log min/avg/p99 duration of every traced stage */
+static void trace_summary(CODEC *codec, x264vfw_trace_t *trace)
+{
+    int i;
+
+    for (i = 0; i < X264VFW_TRACE_STAGES; i++)
+    {
+        double min, avg, p99;
+        int i_spans = x264vfw_trace_stats(trace, i, &min, &avg, &p99);
+
+        if (i_spans > 0)
+            x264vfw_log(codec, X264_LOG_INFO, "trace %-10s: %6d spans, min %8.3f ms, avg %8.3f ms, p99 %8.3f ms\n",
+                        x264vfw_trace_stage_names[i], i_spans, min, avg, p99);
+    }
+}
+
+/* Only stream state is reset between sessions sharing an encoder, so rate control must not depend on the past frames.
+ * A flushed encoder is never kept: only one that had no delayed frames without a flush can take the next session. */
+static int encoder_reusable(CODEC *codec)
+{
+    x264_param_t param;
+
+    if (!codec->b_encoder_reuse || codec->b_encoder_error || codec->b_encoder_flushed || codec->i_renditions ||
+        x264_encoder_delayed_frames(codec->h))
+        return 0;
+    x264_encoder_parameters(codec->h, &param);
+    return param.rc.i_rc_method != X264_RC_ABR && !param.rc.i_vbv_buffer_size &&
+           !param.rc.b_stat_write && !param.rc.b_stat_read;
+}
+
+/* Close the encoder kept open for the next session */
+void x264vfw_compress_release(CODEC *codec)
+{
+    if (codec->reuse_h)
+    {
+        x264_encoder_close(codec->reuse_h);
+        codec->reuse_h = NULL;
+    }
+    x264_picture_clean(&codec->reuse_pic);
+    memset(&codec->reuse_pic, 0, sizeof(x264_picture_t));
+}
+
+/* Second pass of --spill-2pass: encode the spilled pictures again with the statistics of the first pass */
+static int spill_second_pass(CODEC *codec, x264vfw_spill_t *spill)
+{
+    x264_picture_t pic, pic_out;
+    int i, i_count = x264vfw_spill_count(spill);
+    int got_picture;
+
+    x264vfw_log(codec, X264_LOG_INFO, "second pass: %d frames\n", i_count);
+    codec->h = x264_encoder_open(&codec->spill_param);
+    if (!codec->h)
+    {
+        x264vfw_log(codec, X264_LOG_ERROR, "x264_encoder_open failed\n");
+        return -1;
+    }
+    x264_encoder_parameters(codec->h, &codec->spill_param);
+    codec->b_no_output = FALSE;
+    codec->i_pts_base = 0;
+    codec->b_force_idr = FALSE;
+    if (codec->cli_output.open_file(codec->spill_output, &codec->cli_hout, &codec->cli_output_opt) < 0)
+    {
+        x264vfw_log(codec, X264_LOG_ERROR, "could not open output file: '%s'\n", codec->spill_output);
+        return -1;
+    }
+    if (cli_output_start(codec, codec->h, &codec->cli_output, codec->cli_hout, &codec->spill_param) < 0)
+        return -1;
+
+    /* x264 copies the input so the planes can point into the mapped record */
+    x264_picture_init(&pic);
+    pic.img.i_csp = codec->spill_param.i_csp;
+    pic.img.i_plane = codec->spill_planes;
+    for (i = 0; i < i_count; i++)
+    {
+        const uint8_t *src = x264vfw_spill_record(spill, i);
+        int p;
+
+        if (!src)
+        {
+            x264vfw_log(codec, X264_LOG_ERROR, "can't read picture %d from spill file\n", i);
+            return -1;
+        }
+        pic.i_pts = *(const int64_t *)src;
+        pic.i_type = X264_TYPE_AUTO;
+        src += SPILL_HEADER_SIZE;
+        for (p = 0; p < codec->spill_planes; p++)
+        {
+            pic.img.plane[p] = (uint8_t *)src;
+            pic.img.i_stride[p] = codec->spill_stride[p];
+            src += codec->spill_stride[p] * codec->spill_rows[p];
+        }
+        if (codec->sidecar)
+            x264vfw_sidecar_submit(codec->sidecar, pic.i_pts);
+        if (encode_frame(codec, &pic, &pic_out, NULL, 0, &got_picture) < 0)
+            return -1;
+    }
+    while (x264_encoder_delayed_frames(codec->h))
+        if (encode_frame(codec, NULL, &pic_out, NULL, 0, &got_picture) < 0)
+            return -1;
+    return 0;
+}
+
 /* End compression and free resources allocated for compression */
 LRESULT x264vfw_compress_end(CODEC *codec)
 {
+    int64_t i_start = X264VFW_TRACE_START(codec->trace);
+
+    /* Encode the queued pictures and stop the encoder thread */
+    async_delete(codec->async);
+    codec->async = NULL;
     if (codec->h)
     {
         if (!codec->b_encoder_error && codec->b_flush_delayed)
@@ -1854,9 +3593,47 @@ LRESULT x264vfw_compress_end(CODEC *codec)
                 } while (x264_encoder_delayed_frames(codec->h));
             }
         }
-        x264_encoder_close(codec->h);
+        if (codec->speed)
+        {
+            x264vfw_log(codec, X264_LOG_INFO, "speed control: %d steps, final level %d/%d\n",
+                        codec->speed->i_steps, codec->speed->i_level, SPEED_LEVELS);
+            /* A reused encoder starts the next session with the configured settings */
+            if (codec->speed->i_level < SPEED_LEVELS)
+                x264_encoder_reconfig(codec->h, &codec->speed->param);
+            free(codec->speed);
+            codec->speed = NULL;
+        }
+        if (encoder_reusable(codec))
+        {
+            /* Kept open until x264vfw_compress_begin sees whether the next session has the same settings */
+            codec->reuse_h = codec->h;
+            codec->reuse_pts = codec->i_pts_base + codec->conv_pic.i_pts;
+        }
+        else
+            x264_encoder_close(codec->h);
         codec->h = NULL;
     }
+    X264VFW_TRACE_END(codec->trace, X264VFW_TRACE_FLUSH, -1, i_start);
+    if (codec->spill)
+    {
+        x264vfw_spill_t *spill = codec->spill;
+
+        /* The first pass encoder is closed so its stats file is complete */
+        codec->spill = NULL;
+        if (!codec->b_encoder_error && spill_second_pass(codec, spill) < 0)
+            codec->b_encoder_error = TRUE;
+        if (codec->h)
+        {
+            x264_encoder_close(codec->h);
+            codec->h = NULL;
+        }
+        x264vfw_spill_close(spill);
+    }
+    rendition_close_all(codec, !codec->b_encoder_error);
+    free(codec->spill_stats);
+    codec->spill_stats = NULL;
+    free(codec->spill_output);
+    codec->spill_output = NULL;
     if (codec->b_cli_output)
     {
         if (codec->cli_hout)
@@ -1869,8 +3646,33 @@ LRESULT x264vfw_compress_end(CODEC *codec)
         memset(&codec->cli_output, 0, sizeof(cli_output_t));
         codec->b_cli_output = FALSE;
     }
-    x264_picture_clean(&codec->conv_pic);
+    if (codec->i_static_frames != STATIC_FRAMES_OFF && codec->framediff.b_valid)
+        x264vfw_log(codec, X264_LOG_INFO, "static frames: %d %s\n", codec->i_static_count,
+                    codec->i_static_frames == STATIC_FRAMES_DROP ? "dropped" : "not converted");
+    x264vfw_framediff_close(&codec->framediff);
+    codec->i_static_count = 0;
+    if (codec->i_deadline)
+        x264vfw_log(codec, X264_LOG_INFO, "deadline: %d frames dropped\n", codec->i_deadline_drops);
+    codec->i_deadline = 0;
+    codec->i_deadline_drops = 0;
+    if (codec->reuse_h && codec->conv_pic.img.plane[0])
+        codec->reuse_pic = codec->conv_pic;
+    else
+        x264_picture_clean(&codec->conv_pic);
     memset(&codec->conv_pic, 0, sizeof(x264_picture_t));
+    x264vfw_threadpool_delete(codec->csp_pool);
+    codec->csp_pool = NULL;
+    x264vfw_telemetry_close(codec->telemetry);
+    codec->telemetry = NULL;
+    if (x264vfw_sidecar_close(codec->sidecar) < 0)
+        x264vfw_log(codec, X264_LOG_WARNING, "error writing stats sidecar file\n");
+    codec->sidecar = NULL;
+    if (codec->trace)
+    {
+        trace_summary(codec, codec->trace);
+        x264vfw_trace_close(codec->trace);
+        codec->trace = NULL;
+    }
     codec->b_encoder_error = FALSE;
     return ICERR_OK;
 }
@@ -1979,6 +3781,277 @@ LRESULT x264vfw_decompress_query(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO
     return ICERR_OK;
 }
 
+/* Value of option name ("--name value" or "--name=value") at argv[*i] or NULL */
+static const char *decoder_option(int argc, char **argv, int *i, const char *name)
+{
+    size_t len = strlen(name);
+
+    if (!strcmp(argv[*i], name) && *i + 1 < argc)
+        return argv[++*i];
+    if (!strncmp(argv[*i], name, len) && argv[*i][len] == '=')
+        return argv[*i] + len + 1;
+    return NULL;
+}
+
+/* The decoder doesn't parse the extra command line, only its own options and --trace are looked up there */
+static void decoder_parse_cmdline(CODEC *codec)
+{
+    char extra_cmdline[MAX_CMDLINE * 2];
+    char *argv[MAX_ARG_NUM];
+    char arg_mem[MAX_CMDLINE * 2];
+    const char *name = NULL;
+    char trace_file[MAX_PATH * 4];
+    int argc, i;
+
+    codec->decoder_threads = 1;
+    codec->decoder_thread_type = FF_THREAD_SLICE;
+    codec->decoder_fast_convert = 0;
+    codec->decoder_adaptive = 0;
+    if (!WideCharToMultiByte(CP_UTF8, 0, codec->config.extra_cmdline, -1, extra_cmdline, sizeof(extra_cmdline), NULL, NULL))
+        return;
+    argc = split_cmdline(extra_cmdline, argv, arg_mem);
+    for (i = 1; i < argc; i++)
+    {
+        const char *value;
+        int i_type;
+
+        if ((value = decoder_option(argc, argv, &i, "--trace")))
+            name = value;
+        else if ((value = decoder_option(argc, argv, &i, "--decoder-threads")))
+            codec->decoder_threads = X264_MAX(atoi(value), 0);
+        else if ((value = decoder_option(argc, argv, &i, "--decoder-thread-type")))
+        {
+            if (parse_enum_value(value, x264vfw_decoder_thread_type_names, &i_type) < 0)
+                x264vfw_log(codec, X264_LOG_WARNING, "unknown decoder thread type '%s'\n", value);
+            else
+                codec->decoder_thread_type = i_type ? FF_THREAD_FRAME : FF_THREAD_SLICE;
+        }
+        else if (!strcmp(argv[i], "--decoder-adaptive"))
+            codec->decoder_adaptive = 1;
+        else if ((value = decoder_option(argc, argv, &i, "--decoder-convert")))
+        {
+            if (parse_enum_value(value, x264vfw_decoder_convert_names, &i_type) < 0)
+                x264vfw_log(codec, X264_LOG_WARNING, "unknown decoder convert mode '%s'\n", value);
+            else
+                codec->decoder_fast_convert = i_type;
+        }
+    }
+    if (!name)
+        return;
+
+    side_filename(trace_file, sizeof(trace_file), name, NULL, ".decode");
+    if (x264vfw_trace_open(&codec->decoder_trace, trace_file) < 0)
+        x264vfw_log(codec, X264_LOG_WARNING, "could not open trace file: '%s'\n", trace_file);
+}
+
+/* A decoder context for the stream, it gets its own copy of the extradata (avcodec_free_context frees it) */
+static AVCodecContext *decoder_open_context(CODEC *codec, BITMAPINFOHEADER *inhdr, const uint8_t *extradata, int extradata_size)
+{
+    AVCodecContext *ctx = avcodec_alloc_context3(codec->decoder);
+    if (!ctx)
+    {
+        x264vfw_log(codec, X264_LOG_DEBUG, "avcodec_alloc_context failed\n");
+        return NULL;
+    }
+
+    /* Slice threads add no latency, frame threads delay the output by thread_count - 1 frames */
+    ctx->thread_count = codec->decoder_threads;
+    ctx->thread_type = codec->decoder_thread_type;
+    ctx->coded_width  = inhdr->biWidth;
+    ctx->coded_height = inhdr->biHeight;
+    ctx->codec_tag = inhdr->biCompression;
+    if (extradata)
+    {
+        ctx->extradata = av_mallocz(extradata_size + FF_INPUT_BUFFER_PADDING_SIZE);
+        if (!ctx->extradata)
+        {
+            x264vfw_log(codec, X264_LOG_DEBUG, "failed to allocate extradata\n");
+            avcodec_free_context(&ctx);
+            return NULL;
+        }
+        memcpy(ctx->extradata, extradata, extradata_size);
+        ctx->extradata_size = extradata_size;
+    }
+
+    if (avcodec_open2(ctx, codec->decoder, NULL) < 0)
+    {
+        x264vfw_log(codec, X264_LOG_DEBUG, "avcodec_open failed\n");
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/* Check that the frame is in correct size prefixed format */
+static int decoder_length_prefixed(const uint8_t *buf, uint32_t buf_size)
+{
+    uint32_t nal_size;
+
+    if (buf_size < 4)
+        return 0;
+    nal_size = endian_fix32(*(uint32_t *)buf);
+    /* Check startcode */
+    if (nal_size == 0x00000001)
+        return 0;
+    while ((uint64_t)buf_size >= (uint64_t)nal_size + 8)
+    {
+        buf += nal_size + 4;
+        buf_size -= nal_size + 4;
+        nal_size = endian_fix32(*(uint32_t *)buf);
+    }
+    return (uint64_t)buf_size == (uint64_t)nal_size + 4;
+}
+
+/* Convert a size prefixed frame to Annex B in place */
+static void decoder_annexb(uint8_t *buf, uint32_t buf_size)
+{
+    uint32_t nal_size = endian_fix32(*(uint32_t *)buf);
+
+    *(uint32_t *)buf = endian_fix32(0x00000001);
+    while ((uint64_t)buf_size >= (uint64_t)nal_size + 8)
+    {
+        buf += nal_size + 4;
+        buf_size -= nal_size + 4;
+        nal_size = endian_fix32(*(uint32_t *)buf);
+        *(uint32_t *)buf = endian_fix32(0x00000001);
+    }
+}
+
+/* avcC extradata with 4 byte NAL sizes and the SPS/PPS of the Annex B extradata,
+ * without extradata it has none and they come in-band like with Annex B */
+static uint8_t *decoder_make_avcc(const uint8_t *annexb, int annexb_size, int *p_size)
+{
+    const uint8_t *ps[2][32];
+    int ps_size[2][32];
+    int ps_count[2] = { 0, 0 };
+    const uint8_t *p = annexb;
+    const uint8_t *end = annexb + annexb_size;
+    uint8_t *avcc;
+    int size = 7;
+    int i, j, k;
+
+    while (annexb && p + 3 <= end)
+    {
+        const uint8_t *nal, *next;
+        int nal_size, i_type;
+
+        if (p[0] || p[1] || p[2] != 1)
+        {
+            p++;
+            continue;
+        }
+        nal = p + 3;
+        for (next = nal; next + 3 <= end && (next[0] || next[1] || next[2] != 1); next++);
+        if (next + 3 > end)
+            next = end;
+        nal_size = (int)(next - nal);
+        /* The zero byte of the next 4 byte start code */
+        while (nal_size > 0 && !nal[nal_size - 1])
+            nal_size--;
+        i_type = nal_size > 0 ? nal[0] & 0x1f : 0;
+        if (((i_type == 7 && ps_count[0] < 31) || (i_type == 8 && ps_count[1] < 32)) && nal_size <= 0xffff)
+        {
+            i = i_type == 8;
+            ps[i][ps_count[i]] = nal;
+            ps_size[i][ps_count[i]++] = nal_size;
+            size += 2 + nal_size;
+        }
+        p = next;
+    }
+
+    avcc = av_mallocz(size + FF_INPUT_BUFFER_PADDING_SIZE);
+    if (!avcc)
+        return NULL;
+    avcc[0] = 1;
+    /* profile, compatibility and level of the first SPS */
+    if (ps_count[0] && ps_size[0][0] >= 4)
+        memcpy(avcc + 1, ps[0][0] + 1, 3);
+    avcc[4] = 0xfc | 3;
+    k = 5;
+    for (i = 0; i < 2; i++)
+    {
+        avcc[k++] = i ? ps_count[1] : 0xe0 | ps_count[0];
+        for (j = 0; j < ps_count[i]; j++)
+        {
+            avcc[k++] = ps_size[i][j] >> 8;
+            avcc[k++] = ps_size[i][j] & 0xff;
+            memcpy(avcc + k, ps[i][j], ps_size[i][j]);
+            k += ps_size[i][j];
+        }
+    }
+    *p_size = size;
+    return avcc;
+}
+
+/* A size prefixed stream without avcC extradata is decoded in AVCC mode instead of being converted to
+ * Annex B frame by frame, the decoder is reopened with avcC extradata before it gets the first frame */
+static int decoder_switch_avcc(CODEC *codec, BITMAPINFOHEADER *inhdr)
+{
+    AVCodecContext *ctx;
+    uint8_t *avcc;
+    int avcc_size;
+
+    avcc = decoder_make_avcc(codec->decoder_extradata, codec->decoder_extradata_size, &avcc_size);
+    if (!avcc)
+        return -1;
+    ctx = decoder_open_context(codec, inhdr, avcc, avcc_size);
+    if (!ctx)
+    {
+        av_free(avcc);
+        return -1;
+    }
+    avcodec_free_context(&codec->decoder_context);
+    codec->decoder_context = ctx;
+    av_freep(&codec->decoder_extradata);
+    codec->decoder_extradata = avcc;
+    codec->decoder_extradata_size = avcc_size;
+    codec->decoder_is_avc = 1;
+    x264vfw_log(codec, X264_LOG_DEBUG, "size prefixed stream, decoder reopened in AVCC mode\n");
+    return 0;
+}
+
+/* The host owns the input buffer */
+static void decoder_input_free(void *opaque, uint8_t *data)
+{
+}
+
+/* Give the input buffer to the decoder without copying it, possible when it won't keep a reference past
+ * the call (no frame threads) and FF_INPUT_BUFFER_PADDING_SIZE bytes after the frame can be read.
+ * Unlike in our copy those bytes aren't zeroed, that only matters with damaged streams. */
+static int decoder_wrap_input(CODEC *codec, uint8_t *buf, DWORD buf_size)
+{
+    MEMORY_BASIC_INFORMATION mbi;
+
+    if (codec->decoder_context->active_thread_type == FF_THREAD_FRAME ||
+        !VirtualQuery(buf, &mbi, sizeof(mbi)) || mbi.State != MEM_COMMIT ||
+        (mbi.Protect & (PAGE_GUARD | PAGE_NOACCESS)) ||
+        !(mbi.Protect & (PAGE_READONLY | PAGE_READWRITE | PAGE_WRITECOPY |
+                         PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)) ||
+        (uint64_t)(buf - (uint8_t *)mbi.BaseAddress) + buf_size + FF_INPUT_BUFFER_PADDING_SIZE > mbi.RegionSize)
+        return 0;
+
+    codec->decoder_pkt.buf = av_buffer_create(buf, buf_size + FF_INPUT_BUFFER_PADDING_SIZE,
+                                              decoder_input_free, NULL, AV_BUFFER_FLAG_READONLY);
+    if (!codec->decoder_pkt.buf)
+        return 0;
+    codec->decoder_pkt.data = buf;
+    codec->decoder_pkt.size = buf_size;
+    return 1;
+}
+
+/* Drop our reference to a wrapped input buffer, the decoder must not have kept one */
+static void decoder_unwrap_input(CODEC *codec)
+{
+    if (!codec->decoder_pkt.buf)
+        return;
+    if (av_buffer_get_ref_count(codec->decoder_pkt.buf) > 1)
+    {
+        x264vfw_log(codec, X264_LOG_DEBUG, "decoder kept the input buffer, flushing it\n");
+        avcodec_flush_buffers(codec->decoder_context);
+    }
+    av_buffer_unref(&codec->decoder_pkt.buf);
+}
+
 LRESULT x264vfw_decompress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *lpbiOutput)
 {
     int i_csp;
@@ -2004,25 +4077,19 @@ LRESULT x264vfw_decompress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO
         return ICERR_ERROR;
     }
 
-    codec->decoder_context = avcodec_alloc_context3(codec->decoder);
-    if (!codec->decoder_context)
-    {
-        x264vfw_log(codec, X264_LOG_DEBUG, "avcodec_alloc_context failed\n");
-        return ICERR_ERROR;
-    }
-
     codec->decoder_frame = av_frame_alloc();
     if (!codec->decoder_frame)
     {
         x264vfw_log(codec, X264_LOG_DEBUG, "av_frame_alloc failed\n");
-        avcodec_free_context(&codec->decoder_context);
         return ICERR_ERROR;
     }
 
-    codec->decoder_context->thread_count = 1; //minimize latency
-    codec->decoder_context->coded_width  = lpbiInput->bmiHeader.biWidth;
-    codec->decoder_context->coded_height = lpbiInput->bmiHeader.biHeight;
-    codec->decoder_context->codec_tag = lpbiInput->bmiHeader.biCompression;
+    decoder_parse_cmdline(codec);
+    codec->decoder_level = 0;
+    codec->decoder_level_frames = 0;
+    codec->i_decoder_last_call = 0;
+    codec->f_decoder_period = 0.0;
+    codec->f_decoder_busy = 0.0;
 
     if (lpbiInput->bmiHeader.biSize > sizeof(BITMAPINFOHEADER) + 4 && lpbiInput->bmiHeader.biSize < (1 << 30))
     {
@@ -2038,16 +4105,14 @@ LRESULT x264vfw_decompress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO
                 codec->decoder_is_avc = buf[0] == 0x01;
                 memcpy(codec->decoder_extradata, buf, buf_size);
                 memset(codec->decoder_extradata + buf_size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
-                codec->decoder_context->extradata = codec->decoder_extradata;
-                codec->decoder_context->extradata_size = buf_size;
+                codec->decoder_extradata_size = buf_size;
             }
         }
     }
 
-    if (avcodec_open2(codec->decoder_context, codec->decoder, NULL) < 0)
+    codec->decoder_context = decoder_open_context(codec, &lpbiInput->bmiHeader, codec->decoder_extradata, codec->decoder_extradata_size);
+    if (!codec->decoder_context)
     {
-        x264vfw_log(codec, X264_LOG_DEBUG, "avcodec_open failed\n");
-        avcodec_free_context(&codec->decoder_context);
         av_frame_free(&codec->decoder_frame);
         av_freep(&codec->decoder_extradata);
         return ICERR_ERROR;
@@ -2056,6 +4121,10 @@ LRESULT x264vfw_decompress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO
     av_init_packet(&codec->decoder_pkt);
     codec->decoder_pkt.data = NULL;
     codec->decoder_pkt.size = 0;
+    codec->decoder_in = 0;
+    x264vfw_log(codec, X264_LOG_DEBUG, "decoder threads: %d (%s)\n", codec->decoder_context->thread_count,
+                codec->decoder_context->active_thread_type == FF_THREAD_FRAME ? "frame" :
+                codec->decoder_context->active_thread_type == FF_THREAD_SLICE ? "slice" : "none");
 
     return ICERR_OK;
 }
@@ -2072,6 +4141,123 @@ static int handle_jpeg(int pix_fmt, int *fullrange)
     }
 }
 
+/* A decoded frame already in the output format and size only needs its planes copied (swscale would
+ * run its whole graph for the same result), returns 0 if the frame needs swscale */
+static int decoder_copy_frame(CODEC *codec, VFWPicture *picture, const AVFrame *frame, int width, int height)
+{
+    int src_range = 0, dst_range = 0;
+    int chroma_width, chroma_height;
+    int i, y;
+
+    /* The output keeps the source range so the jpeg formats match their mpeg counterparts */
+    if (frame->width != width || frame->height != height ||
+        handle_jpeg(frame->format, &src_range) != handle_jpeg(codec->decoder_pix_fmt, &dst_range))
+        return 0;
+    switch (codec->decoder_pix_fmt)
+    {
+        case AV_PIX_FMT_YUV420P:
+            chroma_width = (width + 1) >> 1;
+            chroma_height = (height + 1) >> 1;
+            break;
+
+        case AV_PIX_FMT_YUV422P:
+            chroma_width = (width + 1) >> 1;
+            chroma_height = height;
+            break;
+
+        case AV_PIX_FMT_YUV444P:
+            chroma_width = width;
+            chroma_height = height;
+            break;
+
+        default:
+            return 0;
+    }
+    for (i = 0; i < 3; i++)
+    {
+        int plane_width = i ? chroma_width : width;
+        int plane_height = i ? chroma_height : height;
+
+        if (frame->linesize[i] == plane_width && picture->linesize[i] == plane_width)
+            memcpy(picture->data[i], frame->data[i], plane_width * plane_height);
+        else
+            for (y = 0; y < plane_height; y++)
+                memcpy(picture->data[i] + y * picture->linesize[i], frame->data[i] + y * frame->linesize[i], plane_width);
+    }
+    return 1;
+}
+
+/* --decoder-convert fast: 8-bit 4:2:0 frames are converted to RGB or packed yuv by x264vfw_dcsp
+ * (vertical flipping included), returns 0 if the frame needs swscale */
+static int decoder_dcsp_frame(CODEC *codec, VFWPicture *picture, const AVFrame *frame, int width, int height)
+{
+    x264_image_t img_src, img_dst;
+    int src_range = codec->decoder_context->color_range == AVCOL_RANGE_JPEG;
+    int i_src_csp, i_dst_csp, i;
+
+    if (!codec->decoder_fast_convert || frame->width != width || frame->height != height)
+        return 0;
+    switch (handle_jpeg(frame->format, &src_range))
+    {
+        case AV_PIX_FMT_YUV420P:
+            i_src_csp = X264VFW_CSP_I420;
+            break;
+
+        case AV_PIX_FMT_NV12:
+            i_src_csp = X264VFW_CSP_NV12;
+            break;
+
+        default:
+            return 0;
+    }
+    switch (codec->decoder_pix_fmt)
+    {
+        case AV_PIX_FMT_BGR24:
+            i_dst_csp = X264VFW_CSP_BGR;
+            break;
+
+        case AV_PIX_FMT_BGRA:
+            i_dst_csp = X264VFW_CSP_BGRA;
+            break;
+
+        case AV_PIX_FMT_YUYV422:
+            i_dst_csp = X264VFW_CSP_YUYV;
+            break;
+
+        case AV_PIX_FMT_UYVY422:
+            i_dst_csp = X264VFW_CSP_UYVY;
+            break;
+
+        default:
+            return 0;
+    }
+
+    /* Like swscale the converters are set up with the colorimetry of the first frame */
+    if (codec->decoder_dcsp_src != i_src_csp)
+    {
+        x264_param_t param;
+
+        x264_param_default(&param);
+        x264vfw_dcsp_init(&codec->decoder_dcsp, i_src_csp, codec->decoder_context->colorspace, src_range, param.cpu);
+        codec->decoder_dcsp_src = i_src_csp;
+    }
+
+    memset(&img_src, 0, sizeof(x264_image_t));
+    img_src.i_csp = i_src_csp;
+    img_src.i_plane = i_src_csp == X264VFW_CSP_NV12 ? 2 : 3;
+    for (i = 0; i < img_src.i_plane; i++)
+    {
+        img_src.plane[i] = frame->data[i];
+        img_src.i_stride[i] = frame->linesize[i];
+    }
+    memset(&img_dst, 0, sizeof(x264_image_t));
+    img_dst.i_csp = i_dst_csp | (codec->decoder_vflip ? X264VFW_CSP_VFLIP : 0);
+    img_dst.i_plane = 1;
+    img_dst.plane[0] = picture->data[0];
+    img_dst.i_stride[0] = picture->linesize[0];
+    return x264vfw_dcsp_convert(&codec->decoder_dcsp, &img_dst, &img_src, width, height) == 0;
+}
+
 static struct SwsContext *x264vfw_init_sws_context(CODEC *codec, int dst_width, int dst_height)
 {
     struct SwsContext *sws = sws_alloc_context();
@@ -2151,95 +4337,147 @@ static struct SwsContext *x264vfw_init_sws_context(CODEC *codec, int dst_width,
     return sws;
 }
 
-LRESULT x264vfw_decompress(CODEC *codec, ICDECOMPRESS *icd)
+/* Move every frame the decoder has finished to the queue (frame threads may finish several at once) */
+static int decoder_receive(CODEC *codec)
+{
+    for (;;)
+    {
+        AVFrame **slot;
+        int ret = avcodec_receive_frame(codec->decoder_context, codec->decoder_frame);
+
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            return 0;
+        if (ret < 0)
+        {
+            x264vfw_log(codec, X264_LOG_DEBUG, "avcodec_receive_frame failed\n");
+            return -1;
+        }
+        if (codec->decoder_queue_count == MAX_DECODER_QUEUE)
+        {
+            /* Only possible with more threads than the queue holds, the oldest frame is lost */
+            av_frame_unref(codec->decoder_queue[codec->decoder_queue_first]);
+            codec->decoder_queue_first = (codec->decoder_queue_first + 1) % MAX_DECODER_QUEUE;
+            codec->decoder_queue_count--;
+        }
+        slot = &codec->decoder_queue[(codec->decoder_queue_first + codec->decoder_queue_count) % MAX_DECODER_QUEUE];
+        if (!*slot)
+            *slot = av_frame_alloc();
+        if (!*slot)
+        {
+            x264vfw_log(codec, X264_LOG_DEBUG, "av_frame_alloc failed\n");
+            av_frame_unref(codec->decoder_frame);
+            return -1;
+        }
+        av_frame_move_ref(*slot, codec->decoder_frame);
+        codec->decoder_queue_count++;
+    }
+}
+
+/* Let the decoder threads finish their frames before the decoder is freed, VFW doesn't ask for them any more */
+static void decoder_drain(CODEC *codec)
+{
+    int i;
+
+    if (codec->decoder_context && avcodec_is_open(codec->decoder_context) &&
+        avcodec_send_packet(codec->decoder_context, NULL) >= 0)
+        decoder_receive(codec);
+    if (codec->decoder_queue_count)
+        x264vfw_log(codec, X264_LOG_DEBUG, "%d decoded frames were not shown\n", codec->decoder_queue_count);
+    for (i = 0; i < MAX_DECODER_QUEUE; i++)
+        av_frame_free(&codec->decoder_queue[i]);
+    codec->decoder_queue_first = 0;
+    codec->decoder_queue_count = 0;
+    av_frame_free(&codec->decoder_shown);
+}
+
+static LRESULT decompress_frame(CODEC *codec, ICDECOMPRESS *icd)
 {
     BITMAPINFOHEADER *inhdr = icd->lpbiInput;
     DWORD neededsize = inhdr->biSizeImage + FF_INPUT_BUFFER_PADDING_SIZE;
     int ret, got_picture;
     VFWPicture picture;
     int picture_size;
+    int64_t i_start;
 
     got_picture = 0;
 #if X264VFW_USE_VIRTUALDUB_HACK
     if (!(inhdr->biSizeImage == 1 && ((uint8_t *)icd->lpInput)[0] == 0x7f))
     {
 #endif
+        int b_prefixed = !codec->decoder_is_avc && decoder_length_prefixed(icd->lpInput, inhdr->biSizeImage);
+
         /* Check overflow */
         if (neededsize < FF_INPUT_BUFFER_PADDING_SIZE)
         {
             x264vfw_log(codec, X264_LOG_DEBUG, "buffer overflow check failed\n");
             return ICERR_ERROR;
         }
-        if (codec->decoder_buf_size < neededsize)
-        {
-            av_free(codec->decoder_buf);
-            codec->decoder_buf_size = 0;
-            codec->decoder_buf = av_malloc(neededsize);
-            if (!codec->decoder_buf)
-            {
-                x264vfw_log(codec, X264_LOG_DEBUG, "failed to realloc decoder buffer\n");
-                return ICERR_ERROR;
-            }
-            codec->decoder_buf_size = neededsize;
-        }
-        memcpy(codec->decoder_buf, icd->lpInput, inhdr->biSizeImage);
-        memset(codec->decoder_buf + inhdr->biSizeImage, 0, FF_INPUT_BUFFER_PADDING_SIZE);
-        codec->decoder_pkt.data = codec->decoder_buf;
-        codec->decoder_pkt.size = inhdr->biSizeImage;
-
-        if (inhdr->biSizeImage >= 4 && !codec->decoder_is_avc)
+        if (b_prefixed && !codec->decoder_in && decoder_switch_avcc(codec, inhdr) == 0)
+            b_prefixed = 0;
+        if (b_prefixed || !decoder_wrap_input(codec, icd->lpInput, inhdr->biSizeImage))
         {
-            uint8_t *buf = codec->decoder_buf;
-            uint32_t buf_size = inhdr->biSizeImage;
-            uint32_t nal_size = endian_fix32(*(uint32_t *)buf);
-            /* Check startcode */
-            if (nal_size != 0x00000001)
+            if (codec->decoder_buf_size < neededsize)
             {
-                /* Check that this is correct size prefixed format */
-                while ((uint64_t)buf_size >= (uint64_t)nal_size + 8)
-                {
-                    buf += nal_size + 4;
-                    buf_size -= nal_size + 4;
-                    nal_size = endian_fix32(*(uint32_t *)buf);
-                }
-                if ((uint64_t)buf_size == (uint64_t)nal_size + 4)
+                av_free(codec->decoder_buf);
+                codec->decoder_buf_size = 0;
+                codec->decoder_buf = av_malloc(neededsize);
+                if (!codec->decoder_buf)
                 {
-                    /* Convert to Annex B */
-                    buf = codec->decoder_buf;
-                    buf_size = inhdr->biSizeImage;
-                    nal_size = endian_fix32(*(uint32_t *)buf);
-                    *(uint32_t *)buf = endian_fix32(0x00000001);
-                    while ((uint64_t)buf_size >= (uint64_t)nal_size + 8)
-                    {
-                        buf += nal_size + 4;
-                        buf_size -= nal_size + 4;
-                        nal_size = endian_fix32(*(uint32_t *)buf);
-                        *(uint32_t *)buf = endian_fix32(0x00000001);
-                    }
+                    x264vfw_log(codec, X264_LOG_DEBUG, "failed to realloc decoder buffer\n");
+                    return ICERR_ERROR;
                 }
+                codec->decoder_buf_size = neededsize;
             }
+            memcpy(codec->decoder_buf, icd->lpInput, inhdr->biSizeImage);
+            memset(codec->decoder_buf + inhdr->biSizeImage, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+            codec->decoder_pkt.data = codec->decoder_buf;
+            codec->decoder_pkt.size = inhdr->biSizeImage;
+
+            /* Convert to Annex B */
+            if (b_prefixed)
+                decoder_annexb(codec->decoder_buf, inhdr->biSizeImage);
         }
 
+        codec->decoder_in++;
+        i_start = X264VFW_TRACE_START(codec->decoder_trace);
         ret = avcodec_send_packet(codec->decoder_context, &codec->decoder_pkt);
         if (ret < 0)
         {
             x264vfw_log(codec, X264_LOG_DEBUG, "avcodec_send_packet failed\n");
+            decoder_unwrap_input(codec);
             return ICERR_ERROR;
         }
-        ret = avcodec_receive_frame(codec->decoder_context, codec->decoder_frame);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-            got_picture = 0;
-        else if (ret < 0)
-        {
-            x264vfw_log(codec, X264_LOG_DEBUG, "avcodec_receive_frame failed\n");
+        ret = decoder_receive(codec);
+        decoder_unwrap_input(codec);
+        X264VFW_TRACE_END(codec->decoder_trace, X264VFW_TRACE_DECODE, codec->decoder_context->frame_number, i_start);
+        if (ret < 0)
             return ICERR_ERROR;
-        }
-        else
-            got_picture = 1;
 #if X264VFW_USE_VIRTUALDUB_HACK
     }
 #endif
 
+    /* One decoded frame per call in decoding order, the previous one is shown again while
+     * the decoder is still busy with the frame (delayed by B-frames or frame threads) */
+    if (codec->decoder_queue_count)
+    {
+        if (!codec->decoder_shown)
+            codec->decoder_shown = av_frame_alloc();
+        if (!codec->decoder_shown)
+        {
+            x264vfw_log(codec, X264_LOG_DEBUG, "av_frame_alloc failed\n");
+            return ICERR_ERROR;
+        }
+        av_frame_unref(codec->decoder_shown);
+        av_frame_move_ref(codec->decoder_shown, codec->decoder_queue[codec->decoder_queue_first]);
+        codec->decoder_queue_first = (codec->decoder_queue_first + 1) % MAX_DECODER_QUEUE;
+        codec->decoder_queue_count--;
+    }
+    got_picture = codec->decoder_shown && codec->decoder_shown->data[0];
+
+    /* The host won't show this frame, only the decoder state had to advance */
+    if (codec->decoder_adaptive && (icd->dwFlags & ICDECOMPRESS_HURRYUP))
+        return ICERR_OK;
+
     picture_size = x264vfw_picture_get_size(codec->decoder_pix_fmt, inhdr->biWidth, inhdr->biHeight);
     if (picture_size < 0)
     {
@@ -2249,7 +4487,7 @@ LRESULT x264vfw_decompress(CODEC *codec, ICDECOMPRESS *icd)
 
     if (!got_picture)
     {
-        /* Frame was decoded but delayed so we would show the BLACK-frame instead */
+        /* Nothing was decoded yet so we would show the BLACK-frame instead */
         x264vfw_fill_black_frame(icd->lpOutput, codec->decoder_pix_fmt, picture_size);
         //icd->lpbiOutput->biSizeImage = picture_size;
         return ICERR_OK;
@@ -2272,6 +4510,15 @@ LRESULT x264vfw_decompress(CODEC *codec, ICDECOMPRESS *icd)
         picture.data[2] = temp_data;
         picture.linesize[2] = temp_linesize;
     }
+
+    i_start = X264VFW_TRACE_START(codec->decoder_trace);
+    if (decoder_copy_frame(codec, &picture, codec->decoder_shown, inhdr->biWidth, inhdr->biHeight) ||
+        decoder_dcsp_frame(codec, &picture, codec->decoder_shown, inhdr->biWidth, inhdr->biHeight))
+    {
+        X264VFW_TRACE_END(codec->decoder_trace, X264VFW_TRACE_SCALE, codec->decoder_context->frame_number, i_start);
+        return ICERR_OK;
+    }
+
     if (codec->decoder_vflip)
         if (x264vfw_picture_vflip(&picture, codec->decoder_pix_fmt, inhdr->biWidth, inhdr->biHeight) < 0)
         {
@@ -2289,15 +4536,94 @@ LRESULT x264vfw_decompress(CODEC *codec, ICDECOMPRESS *icd)
         }
     }
 
-    sws_scale(codec->sws, (const uint8_t * const *)codec->decoder_frame->data, codec->decoder_frame->linesize, 0, inhdr->biHeight, picture.data, picture.linesize);
+    i_start = X264VFW_TRACE_START(codec->decoder_trace);
+    sws_scale(codec->sws, (const uint8_t * const *)codec->decoder_shown->data, codec->decoder_shown->linesize, 0, inhdr->biHeight, picture.data, picture.linesize);
+    X264VFW_TRACE_END(codec->decoder_trace, X264VFW_TRACE_SCALE, codec->decoder_context->frame_number, i_start);
     //icd->lpbiOutput->biSizeImage = picture_size;
 
     return ICERR_OK;
 }
 
+/* --decoder-adaptive levels: 1 - AV_CODEC_FLAG2_FAST, 2 - no deblocking of non-reference frames,
+ * 3 - non-reference frames aren't decoded (the previous frame is shown again) */
+static void decoder_set_level(CODEC *codec, int i_level)
+{
+    AVCodecContext *ctx = codec->decoder_context;
+
+    if (i_level >= 1)
+        ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+    else
+        ctx->flags2 &= ~AV_CODEC_FLAG2_FAST;
+    ctx->skip_loop_filter = i_level >= 2 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    ctx->skip_frame = i_level >= 3 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    x264vfw_log(codec, X264_LOG_DEBUG, "decoder adaptive level %d (busy %.0f%% of the time between frames)\n",
+                i_level, codec->f_decoder_busy * 100.0 / codec->f_decoder_period);
+    codec->decoder_level = i_level;
+    codec->decoder_level_frames = 0;
+}
+
+/* Adaptive mode: a host that calls us back to back (or hurries us) is waiting for the decoder,
+ * so the decode time is compared with the time between the calls. Processing hosts always
+ * look like that, which is why the mode is only meant for playback. */
+static void decoder_adapt(CODEC *codec, int64_t i_call, int64_t i_end, int b_hurry)
+{
+    double f_busy = (double)(i_end - i_call);
+    double f_ratio;
+
+    codec->decoder_level_frames++;
+    if (!codec->i_decoder_last_call)
+    {
+        codec->i_decoder_last_call = i_call;
+        codec->f_decoder_busy = f_busy;
+        return;
+    }
+    if (!codec->f_decoder_period)
+        codec->f_decoder_period = (double)(i_call - codec->i_decoder_last_call);
+    codec->f_decoder_period += ((double)(i_call - codec->i_decoder_last_call) - codec->f_decoder_period) * DECODER_ADAPT_SMOOTH;
+    codec->f_decoder_busy += (f_busy - codec->f_decoder_busy) * DECODER_ADAPT_SMOOTH;
+    codec->i_decoder_last_call = i_call;
+    if (codec->f_decoder_period <= 0.0)
+        return;
+
+    f_ratio = codec->f_decoder_busy / codec->f_decoder_period;
+    if ((b_hurry || f_ratio > DECODER_ADAPT_HIGH) && codec->decoder_level < DECODER_ADAPT_LEVELS &&
+        codec->decoder_level_frames >= (b_hurry ? 1 : DECODER_ADAPT_HOLD))
+        decoder_set_level(codec, codec->decoder_level + 1);
+    else if (!b_hurry && f_ratio < DECODER_ADAPT_LOW && codec->decoder_level > 0 &&
+             codec->decoder_level_frames >= DECODER_ADAPT_HOLD)
+        decoder_set_level(codec, codec->decoder_level - 1);
+}
+
+LRESULT x264vfw_decompress(CODEC *codec, ICDECOMPRESS *icd)
+{
+    int64_t i_start = X264VFW_TRACE_START(codec->decoder_trace);
+    LARGE_INTEGER call, end;
+    LRESULT ret;
+
+    if (codec->decoder_adaptive)
+        QueryPerformanceCounter(&call);
+    ret = decompress_frame(codec, icd);
+    if (codec->decoder_adaptive && ret == ICERR_OK)
+    {
+        QueryPerformanceCounter(&end);
+        decoder_adapt(codec, call.QuadPart, end.QuadPart, (icd->dwFlags & ICDECOMPRESS_HURRYUP) != 0);
+    }
+
+    X264VFW_TRACE_END(codec->decoder_trace, X264VFW_TRACE_DECOMPRESS, codec->decoder_context->frame_number, i_start);
+    return ret;
+}
+
 LRESULT x264vfw_decompress_end(CODEC *codec)
 {
+    if (codec->decoder_trace)
+    {
+        trace_summary(codec, codec->decoder_trace);
+        x264vfw_trace_close(codec->decoder_trace);
+        codec->decoder_trace = NULL;
+    }
+    decoder_drain(codec);
     codec->decoder_is_avc = 0;
+    codec->decoder_extradata_size = 0;
     avcodec_free_context(&codec->decoder_context);
     av_frame_free(&codec->decoder_frame);
     av_freep(&codec->decoder_extradata);
@@ -2305,6 +4631,7 @@ LRESULT x264vfw_decompress_end(CODEC *codec)
     codec->decoder_buf_size = 0;
     sws_freeContext(codec->sws);
     codec->sws = NULL;
+    codec->decoder_dcsp_src = X264VFW_CSP_NONE;
     return ICERR_OK;
 }
 #endif
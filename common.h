@@ -33,12 +33,19 @@
 #include <string.h>
 #include <stdio.h>
 #include <sys/stat.h>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <wchar.h>
 
 #include <x264.h>
 #include "config.h"
 
+/* Older x264 don't export their build bit depth */
+#ifndef X264_BIT_DEPTH
+#define X264_BIT_DEPTH 8
+#endif
+
 #ifdef HAVE_STDINT_H
 #include <stdint.h>
 #else
@@ -81,6 +88,23 @@
 #define attribute_align_arg
 #endif
 
+/* x86 SIMD intrinsics with per-function instruction set selection (runtime dispatch by x264 cpu flags) */
+#if (defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)) && \
+    (!defined(__GNUC__) || defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_X86_SIMD 1
+#if defined(__GNUC__)
+#define TARGET_SSE2  __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
 #define X264_MIN(a, b) (((a)<(b)) ? (a) : (b))
 #define X264_MAX(a, b) (((a)>(b)) ? (a) : (b))
 #define X264_CLIP(v, min, max) (((v)<(min)) ? (min) : ((v)>(max)) ? (max) : (v))
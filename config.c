@@ -90,6 +90,12 @@ extern const char * const x264vfw_log_level_names[];
 
 extern const char * const x264vfw_range_names[];
 
+extern const char * const x264vfw_static_frames_names[];
+
+extern const char * const x264vfw_decoder_thread_type_names[];
+
+extern const char * const x264vfw_decoder_convert_names[];
+
 static const reg_named_str_t reg_named_str_table[] =
 {
     /* Basic */
@@ -1394,10 +1400,6 @@ static char *stringify_names(char *buf, const char * const names[])
 #define X264_CHROMA_FORMAT 0
 #endif
 
-#ifndef X264_BIT_DEPTH
-#define X264_BIT_DEPTH 8
-#endif
-
 static void help(char *buffer, int longhelp)
 {
 #define H0(...) do { sprintf(buffer, __VA_ARGS__); buffer += strlen(buffer); } while (0)
@@ -1765,6 +1767,64 @@ static void help(char *buffer, int longhelp)
     H1( "      --threads <integer>     Force a specific number of threads\r\n" );
     H2( "      --lookahead-threads <integer> Force a specific number of lookahead threads\r\n" );
     H2( "      --sliced-threads        Low-latency but lower-efficiency threading\r\n" );
+    H2( "      --csp-threads <integer> Number of threads for input colorspace conversion\r\n"
+        "                                  - 0: auto, 1: convert in the calling thread [0]\r\n" );
+    H2( "      --convert-nv12          Convert input to NV12 instead of I420 (x264 internal layout)\r\n" );
+    H2( "      --async-pics <integer>  Encode in a separate thread with up to <integer> converted\r\n"
+        "                                  pictures queued ahead of it [0 (disabled)]\r\n"
+        "                              Needs 'File' output mode or 'VirtualDub Hack'\r\n" );
+    H2( "      --static-frames <string> Compare input frames with the previous one [\"%s\"]\r\n"
+        "                                  - %s\r\n"
+        "                              Only changed 16x16 tiles are converted, identical\r\n"
+        "                              frames are encoded again (reuse) or not at all (drop)\r\n"
+        "                              Drop needs 'File' output mode with mkv, mp4 or flv muxer\r\n",
+                                       x264vfw_static_frames_names[0], stringify_names( buf, x264vfw_static_frames_names ) );
+    H2( "      --trace <string>        Write per-stage timings to Chrome trace JSON (CSV if *.csv)\r\n"
+        "                              Relative names are placed next to 'File' output,\r\n"
+        "                              the decoder writes <name>.decode.<ext>\r\n" );
+    H2( "      --stats-sidecar <string> Write one JSON line per encoded frame: type, size,\r\n"
+        "                                  average CRF, pts/dts and submit-to-output latency\r\n" );
+    H2( "      --telemetry             Publish live encoder counters in shared memory\r\n"
+        "                              (read them with x264vfw_telemetry.exe <pid>)\r\n" );
+    H2( "      --no-encoder-reuse      Always open a new encoder in ICM_COMPRESS_BEGIN\r\n"
+        "                              (by default a CQP/CRF encoder without VBV that ended\r\n"
+        "                              with no delayed frames and was never flushed, e.g. with\r\n"
+        "                              --tune zerolatency, is kept for the next session with\r\n"
+        "                              the same settings)\r\n" );
+    H2( "      --speed-control <float> Lower subme/me/ref/trellis while encoding is slower than\r\n"
+        "                                  <float> x the frame rate (1.0 = real time) and raise\r\n"
+        "                                  them back up to the configured ones when it's faster\r\n" );
+    H2( "      --deadline <integer>    Drop frames arriving more than <integer> ms later than\r\n"
+        "                                  the frame rate allows, IDR after a run of drops\r\n"
+        "                              Needs 'File' output mode with mkv, mp4 or flv muxer, or\r\n"
+        "                                  VFW output with an encoder without delay (no B-frames,\r\n"
+        "                                  lookahead or frame threads, e.g. --tune zerolatency)\r\n"
+        "                                  and without --async-pics\r\n" );
+    H2( "      --spill-2pass <string>  2 pass mode in one session: the first pass saves the raw\r\n"
+        "                                  pictures to the temporary file <string> and the\r\n"
+        "                                  second pass encodes them when compression ends\r\n"
+        "                              Needs 'File' output mode and free disk space for them\r\n" );
+    H2( "      --rendition <string>    Encode a downscaled rendition in parallel (up to %d times):\r\n"
+        "                                  <width>x<height>:<bitrate>:<file>\r\n"
+        "                              ABR at <bitrate> kbit/s, muxer chosen by the file extension,\r\n"
+        "                              relative names are placed next to 'File' output\r\n", MAX_RENDITIONS );
+    H2( "      --decoder-threads <integer> Threads of the built-in decoder [1], 0: auto\r\n" );
+    H2( "      --decoder-thread-type <string> Threading of the built-in decoder [\"%s\"]\r\n"
+        "                                  - %s\r\n"
+        "                              Frame threads are faster but show every frame (threads - 1)\r\n"
+        "                              calls late, the last shown frame is repeated meanwhile\r\n",
+                                       x264vfw_decoder_thread_type_names[0], stringify_names( buf, x264vfw_decoder_thread_type_names ) );
+    H2( "      --decoder-convert <string> Output conversion of the built-in decoder [\"%s\"]\r\n"
+        "                                  - %s\r\n"
+        "                              - accurate: swscale with interpolated chroma\r\n"
+        "                              - fast: SIMD converters for 8-bit 4:2:0 streams to RGB,\r\n"
+        "                                  YUY2 and UYVY output, chroma is repeated\r\n",
+                                       x264vfw_decoder_convert_names[0], stringify_names( buf, x264vfw_decoder_convert_names ) );
+    H2( "      --decoder-adaptive      Lower the quality of the built-in decoder while it can't keep\r\n"
+        "                                  up with playback and restore it when it catches up:\r\n"
+        "                                  fast flags, then no deblocking and then no decoding\r\n"
+        "                                  of non-reference frames, hurried frames aren't converted\r\n"
+        "                              Only for playback, processing would always look too slow\r\n" );
     H2( "      --sync-lookahead <integer> Number of buffer frames for threaded lookahead\r\n" );
     H2( "      --non-deterministic     Slightly improve quality of SMP, at the cost of repeatability\r\n" );
     H2( "      --cpu-independent       Ensure exact reproducibility across different cpus,\r\n"
@@ -21,16 +21,57 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
  *****************************************************************************/
 
-#include "x264vfw.h"
+#include "csp.h"
 
 #include <assert.h>
 
+#if HAVE_X86_SIMD
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <immintrin.h>
+#endif
+
+/* Output samples: high bit depth builds of x264 take 16-bit pictures (X264_CSP_HIGH_DEPTH)
+ * with X264_BIT_DEPTH significant bits. Destination pointers and strides stay in bytes. */
+#if X264_BIT_DEPTH > 8
+typedef uint16_t pixel;
+#else
+typedef uint8_t  pixel;
+#endif
+#define PIXEL_SHIFT8  (X264_BIT_DEPTH - 8)  /* 8-bit sample -> output */
+#define PIXEL_SHIFT16 (16 - X264_BIT_DEPTH) /* msb aligned 16-bit sample -> output */
+#define PIXEL_ROUND16 (1 << PIXEL_SHIFT16 >> 1)
+#define PIXEL_MAX     ((1 << X264_BIT_DEPTH) - 1)
+#define PIXEL8( x )   ((x) << PIXEL_SHIFT8)
+#define PIXEL16( x )  pixel16( x )
+/* Averages of 8-bit samples keep the extra output precision */
+#define AVG2( a, b )       (((((a) + (b)) << PIXEL_SHIFT8) + 1) >> 1)
+#define AVG4( a, b, c, d ) (((((a) + (b) + (c) + (d)) << PIXEL_SHIFT8) + 2) >> 2)
+
+/* Rounded, samples that round up past the maximum are saturated */
+static ALWAYS_INLINE int pixel16( int x )
+{
+    x = (x + PIXEL_ROUND16) >> PIXEL_SHIFT16;
+    return x < PIXEL_MAX ? x : PIXEL_MAX;
+}
+
+#define PIXEL_ROW( img, i, i_row ) ((pixel *)((img)->plane[i] + (i_row) * (img)->i_stride[i]))
+#define PIXEL_STRIDE( img, i )     ((img)->i_stride[i] / (int)sizeof(pixel))
+
+/* With high bit depth output the 8-bit -> 16-bit shift is done while copying */
 static inline void plane_copy( uint8_t *dst, int i_dst,
                                uint8_t *src, int i_src, int w, int h )
 {
     for( ; h > 0; h-- )
     {
+#if X264_BIT_DEPTH > 8
+        pixel *d = (pixel *)dst;
+        int   i;
+        for( i = 0; i < w; i++ )
+            d[i] = PIXEL8( src[i] );
+#else
         memcpy( dst, src, w );
+#endif
         dst += i_dst;
         src += i_src;
     }
@@ -41,12 +82,12 @@ static inline void plane_subsamplev2( uint8_t *dst, int i_dst,
 {
     for( ; h > 0; h-- )
     {
-        uint8_t *d = dst;
+        pixel   *d = (pixel *)dst;
         uint8_t *s = src;
         int     i;
         for( i = w; i > 0; i-- )
         {
-            *d++ = ( s[0] + s[i_src] + 1 ) >> 1;
+            *d++ = AVG2( s[0], s[i_src] );
             s++;
         }
         dst += i_dst;
@@ -59,12 +100,12 @@ static inline void plane_subsamplehv2( uint8_t *dst, int i_dst,
 {
     for( ; h > 0; h-- )
     {
-        uint8_t *d = dst;
+        pixel   *d = (pixel *)dst;
         uint8_t *s = src;
         int     i;
         for( i = w; i > 0; i-- )
         {
-            *d++ = ( s[0] + s[1] + s[i_src] + s[i_src+1] + 2 ) >> 2;
+            *d++ = AVG4( s[0], s[1], s[i_src], s[i_src+1] );
             s += 2;
         }
         dst += i_dst;
@@ -72,183 +113,627 @@ static inline void plane_subsamplehv2( uint8_t *dst, int i_dst,
     }
 }
 
-static inline void plane_copy_vflip( uint8_t *dst, int i_dst,
-                                     uint8_t *src, int i_src, int w, int h )
+/* Interleave U and V planes into one UV plane (NV12) */
+static inline void plane_interleave_copy( uint8_t *dst, int i_dst,
+                                          uint8_t *srcu, int i_srcu,
+                                          uint8_t *srcv, int i_srcv, int w, int h )
 {
-    plane_copy( dst, i_dst, src + (h - 1) * i_src, -i_src, w, h );
+    for( ; h > 0; h-- )
+    {
+        pixel *d = (pixel *)dst;
+        int   i;
+        for( i = 0; i < w; i++ )
+        {
+            d[2*i]   = PIXEL8( srcu[i] );
+            d[2*i+1] = PIXEL8( srcv[i] );
+        }
+        dst  += i_dst;
+        srcu += i_srcu;
+        srcv += i_srcv;
+    }
 }
 
-static inline void plane_subsamplev2_vflip( uint8_t *dst, int i_dst,
-                                            uint8_t *src, int i_src, int w, int h )
+static inline void plane_interleave_subsamplev2( uint8_t *dst, int i_dst,
+                                                 uint8_t *srcu, int i_srcu,
+                                                 uint8_t *srcv, int i_srcv, int w, int h )
 {
-    plane_subsamplev2( dst, i_dst, src + (2 * h - 1) * i_src, -i_src, w, h );
+    for( ; h > 0; h-- )
+    {
+        pixel *d = (pixel *)dst;
+        int   i;
+        for( i = 0; i < w; i++ )
+        {
+            d[2*i]   = AVG2( srcu[i], srcu[i+i_srcu] );
+            d[2*i+1] = AVG2( srcv[i], srcv[i+i_srcv] );
+        }
+        dst  += i_dst;
+        srcu += 2 * i_srcu;
+        srcv += 2 * i_srcv;
+    }
+}
+
+static inline void plane_interleave_subsamplehv2( uint8_t *dst, int i_dst,
+                                                  uint8_t *srcu, int i_srcu,
+                                                  uint8_t *srcv, int i_srcv, int w, int h )
+{
+    for( ; h > 0; h-- )
+    {
+        pixel *d = (pixel *)dst;
+        int   i;
+        for( i = 0; i < w; i++ )
+        {
+            d[2*i]   = AVG4( srcu[2*i], srcu[2*i+1], srcu[2*i+i_srcu], srcu[2*i+i_srcu+1] );
+            d[2*i+1] = AVG4( srcv[2*i], srcv[2*i+1], srcv[2*i+i_srcv], srcv[2*i+i_srcv+1] );
+        }
+        dst  += i_dst;
+        srcu += 2 * i_srcu;
+        srcv += 2 * i_srcv;
+    }
 }
 
-static inline void plane_subsamplehv2_vflip( uint8_t *dst, int i_dst,
-                                             uint8_t *src, int i_src, int w, int h )
+/* 16-bit little-endian msb aligned source planes (P010/P210), strides are in bytes */
+static inline void plane_copy16( uint8_t *dst, int i_dst,
+                                 uint8_t *src, int i_src, int w, int h )
+{
+    for( ; h > 0; h-- )
+    {
+        pixel    *d = (pixel *)dst;
+        uint16_t *s = (uint16_t *)src;
+        int      i;
+        for( i = 0; i < w; i++ )
+            d[i] = PIXEL16( s[i] );
+        dst += i_dst;
+        src += i_src;
+    }
+}
+
+static inline void plane_subsamplev2_16( uint8_t *dst, int i_dst,
+                                         uint8_t *src, int i_src, int w, int h )
+{
+    for( ; h > 0; h-- )
+    {
+        pixel    *d  = (pixel *)dst;
+        uint16_t *s0 = (uint16_t *)src;
+        uint16_t *s1 = (uint16_t *)(src + i_src);
+        int      i;
+        for( i = 0; i < w; i++ )
+            d[i] = PIXEL16( ( s0[i] + s1[i] + 1 ) >> 1 );
+        dst += i_dst;
+        src += 2 * i_src;
+    }
+}
+
+/* Split one UV plane into U and V planes */
+static inline void plane_deinterleave16( uint8_t *dstu, int i_dstu,
+                                         uint8_t *dstv, int i_dstv,
+                                         uint8_t *src, int i_src, int w, int h )
+{
+    for( ; h > 0; h-- )
+    {
+        pixel    *du = (pixel *)dstu;
+        pixel    *dv = (pixel *)dstv;
+        uint16_t *s  = (uint16_t *)src;
+        int      i;
+        for( i = 0; i < w; i++ )
+        {
+            du[i] = PIXEL16( s[2*i] );
+            dv[i] = PIXEL16( s[2*i+1] );
+        }
+        dstu += i_dstu;
+        dstv += i_dstv;
+        src  += i_src;
+    }
+}
+
+static inline void plane_deinterleave_subsamplev2_16( uint8_t *dstu, int i_dstu,
+                                                      uint8_t *dstv, int i_dstv,
+                                                      uint8_t *src, int i_src, int w, int h )
+{
+    for( ; h > 0; h-- )
+    {
+        pixel    *du = (pixel *)dstu;
+        pixel    *dv = (pixel *)dstv;
+        uint16_t *s0 = (uint16_t *)src;
+        uint16_t *s1 = (uint16_t *)(src + i_src);
+        int      i;
+        for( i = 0; i < w; i++ )
+        {
+            du[i] = PIXEL16( ( s0[2*i]   + s1[2*i]   + 1 ) >> 1 );
+            dv[i] = PIXEL16( ( s0[2*i+1] + s1[2*i+1] + 1 ) >> 1 );
+        }
+        dstu += i_dstu;
+        dstv += i_dstv;
+        src  += 2 * i_src;
+    }
+}
+
+/* Rows per output row read from the source plane */
+#define SRC_ROWS_copy                             1
+#define SRC_ROWS_subsamplev2                      2
+#define SRC_ROWS_subsamplehv2                     2
+#define SRC_ROWS_copy_sse2                        1
+#define SRC_ROWS_copy_avx2                        1
+#define SRC_ROWS_copy16                           1
+#define SRC_ROWS_subsamplev2_16                   2
+#define SRC_ROWS_deinterleave16                   1
+#define SRC_ROWS_deinterleave_subsamplev2_16      2
+#define SRC_ROWS_copy16_sse2                      1
+#define SRC_ROWS_copy16_avx2                      1
+#define SRC_ROWS_subsamplev2_16_sse2              2
+#define SRC_ROWS_subsamplev2_16_avx2              2
+#define SRC_ROWS_deinterleave16_sse2              1
+#define SRC_ROWS_deinterleave16_avx2              1
+#define SRC_ROWS_deinterleave_subsamplev2_16_sse2 2
+#define SRC_ROWS_deinterleave_subsamplev2_16_avx2 2
+
+/* Point to the last row of the plane and negate stride so rows can be addressed top-down */
+static inline uint8_t *plane_vflip( uint8_t *src, int *i_src, int h )
 {
-    plane_subsamplehv2( dst, i_dst, src + (2 * h - 1) * i_src, -i_src, w, h );
+    src += (h - 1) * *i_src;
+    *i_src = -*i_src;
+    return src;
 }
 
 static int convert_fail( x264_image_t *img_dst, x264_image_t *img_src,
-                         int i_width, int i_height )
+                         int i_width, int i_height, int i_y0, int i_y1 )
 {
     return -1;
 }
 
-#define YUV_TO_YUV( name, func, swap, h_shift, v_shift )                         \
-static int name( x264_image_t *img_dst, x264_image_t *img_src,                   \
-                 int i_width, int i_height )                                     \
-{                                                                                \
-    if( img_src->i_csp & X264VFW_CSP_VFLIP )                                     \
-    {                                                                            \
-        plane_copy_vflip( img_dst->plane[0], img_dst->i_stride[0],               \
-                          img_src->plane[0], img_src->i_stride[0],               \
-                          i_width, i_height );                                   \
-        plane_##func##_vflip( img_dst->plane[1+swap], img_dst->i_stride[1+swap], \
-                              img_src->plane[1], img_src->i_stride[1],           \
-                              i_width >> h_shift, i_height >> v_shift );         \
-        plane_##func##_vflip( img_dst->plane[2-swap], img_dst->i_stride[2-swap], \
-                              img_src->plane[2], img_src->i_stride[2],           \
-                              i_width >> h_shift, i_height >> v_shift );         \
-    }                                                                            \
-    else                                                                         \
-    {                                                                            \
-        plane_copy( img_dst->plane[0], img_dst->i_stride[0],                     \
-                    img_src->plane[0], img_src->i_stride[0],                     \
-                    i_width, i_height );                                         \
-        plane_##func( img_dst->plane[1+swap], img_dst->i_stride[1+swap],         \
-                      img_src->plane[1], img_src->i_stride[1],                   \
-                      i_width >> h_shift, i_height >> v_shift );                 \
-        plane_##func( img_dst->plane[2-swap], img_dst->i_stride[2-swap],         \
-                      img_src->plane[2], img_src->i_stride[2],                   \
-                      i_width >> h_shift, i_height >> v_shift );                 \
-    }                                                                            \
-    return 0;                                                                    \
-}
-
-#define NV_TO_NV( name, func, v_shift )                                \
-static int name( x264_image_t *img_dst, x264_image_t *img_src,         \
-                 int i_width, int i_height )                           \
-{                                                                      \
-    if( img_src->i_csp & X264VFW_CSP_VFLIP )                           \
-    {                                                                  \
-        plane_copy_vflip( img_dst->plane[0], img_dst->i_stride[0],     \
-                          img_src->plane[0], img_src->i_stride[0],     \
-                          i_width, i_height );                         \
-        plane_##func##_vflip( img_dst->plane[1], img_dst->i_stride[1], \
-                              img_src->plane[1], img_src->i_stride[1], \
-                              i_width, i_height >> v_shift );          \
-    }                                                                  \
-    else                                                               \
-    {                                                                  \
-        plane_copy( img_dst->plane[0], img_dst->i_stride[0],           \
-                    img_src->plane[0], img_src->i_stride[0],           \
-                    i_width, i_height );                               \
-        plane_##func( img_dst->plane[1], img_dst->i_stride[1],         \
-                      img_src->plane[1], img_src->i_stride[1],         \
-                      i_width, i_height >> v_shift );                  \
-    }                                                                  \
-    return 0;                                                          \
+#define YUV_TO_YUV( name, luma, func, swap, h_shift, v_shift )                           \
+static int name( x264_image_t *img_dst, x264_image_t *img_src,                           \
+                 int i_width, int i_height, int i_y0, int i_y1 )                         \
+{                                                                                        \
+    int     i_rows = SRC_ROWS_##func;                                                    \
+    int     i_c0   = i_y0 >> v_shift;                                                    \
+    int     i_c1   = i_y1 >> v_shift;                                                    \
+    uint8_t *src[3];                                                                     \
+    int     i_src[3];                                                                    \
+    int     i;                                                                           \
+                                                                                         \
+    for( i = 0; i < 3; i++ )                                                             \
+    {                                                                                    \
+        src[i]   = img_src->plane[i];                                                    \
+        i_src[i] = img_src->i_stride[i];                                                 \
+    }                                                                                    \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                                             \
+    {                                                                                    \
+        src[0] = plane_vflip( src[0], &i_src[0], i_height );                             \
+        src[1] = plane_vflip( src[1], &i_src[1], (i_height >> v_shift) * i_rows );       \
+        src[2] = plane_vflip( src[2], &i_src[2], (i_height >> v_shift) * i_rows );       \
+    }                                                                                    \
+                                                                                         \
+    plane_##luma( img_dst->plane[0] + i_y0 * img_dst->i_stride[0], img_dst->i_stride[0], \
+                  src[0] + i_y0 * i_src[0], i_src[0],                                    \
+                  i_width, i_y1 - i_y0 );                                                \
+    plane_##func( img_dst->plane[1+swap] + i_c0 * img_dst->i_stride[1+swap],             \
+                  img_dst->i_stride[1+swap],                                             \
+                  src[1] + i_c0 * i_rows * i_src[1], i_src[1],                           \
+                  i_width >> h_shift, i_c1 - i_c0 );                                     \
+    plane_##func( img_dst->plane[2-swap] + i_c0 * img_dst->i_stride[2-swap],             \
+                  img_dst->i_stride[2-swap],                                             \
+                  src[2] + i_c0 * i_rows * i_src[2], i_src[2],                           \
+                  i_width >> h_shift, i_c1 - i_c0 );                                     \
+    return 0;                                                                            \
+}
+
+#define NV_TO_NV( name, luma, func, v_shift )                                            \
+static int name( x264_image_t *img_dst, x264_image_t *img_src,                           \
+                 int i_width, int i_height, int i_y0, int i_y1 )                         \
+{                                                                                        \
+    int     i_rows = SRC_ROWS_##func;                                                    \
+    int     i_c0   = i_y0 >> v_shift;                                                    \
+    int     i_c1   = i_y1 >> v_shift;                                                    \
+    uint8_t *src[2];                                                                     \
+    int     i_src[2];                                                                    \
+                                                                                         \
+    src[0] = img_src->plane[0];                                                          \
+    src[1] = img_src->plane[1];                                                          \
+    i_src[0] = img_src->i_stride[0];                                                     \
+    i_src[1] = img_src->i_stride[1];                                                     \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                                             \
+    {                                                                                    \
+        src[0] = plane_vflip( src[0], &i_src[0], i_height );                             \
+        src[1] = plane_vflip( src[1], &i_src[1], (i_height >> v_shift) * i_rows );       \
+    }                                                                                    \
+                                                                                         \
+    plane_##luma( img_dst->plane[0] + i_y0 * img_dst->i_stride[0], img_dst->i_stride[0], \
+                  src[0] + i_y0 * i_src[0], i_src[0],                                    \
+                  i_width, i_y1 - i_y0 );                                                \
+    plane_##func( img_dst->plane[1] + i_c0 * img_dst->i_stride[1], img_dst->i_stride[1], \
+                  src[1] + i_c0 * i_rows * i_src[1], i_src[1],                           \
+                  i_width, i_c1 - i_c0 );                                                \
+    return 0;                                                                            \
+}
+
+/* Planar yuv/yvu to 4:2:0 with interleaved chroma */
+#define YUV_TO_NV12( name, func, swap )                                                  \
+static int name( x264_image_t *img_dst, x264_image_t *img_src,                           \
+                 int i_width, int i_height, int i_y0, int i_y1 )                         \
+{                                                                                        \
+    int     i_rows = SRC_ROWS_##func;                                                    \
+    int     i_c0   = i_y0 >> 1;                                                          \
+    int     i_c1   = i_y1 >> 1;                                                          \
+    uint8_t *src[3];                                                                     \
+    int     i_src[3];                                                                    \
+    int     i;                                                                           \
+                                                                                         \
+    for( i = 0; i < 3; i++ )                                                             \
+    {                                                                                    \
+        src[i]   = img_src->plane[i];                                                    \
+        i_src[i] = img_src->i_stride[i];                                                 \
+    }                                                                                    \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                                             \
+    {                                                                                    \
+        src[0] = plane_vflip( src[0], &i_src[0], i_height );                             \
+        src[1] = plane_vflip( src[1], &i_src[1], (i_height >> 1) * i_rows );             \
+        src[2] = plane_vflip( src[2], &i_src[2], (i_height >> 1) * i_rows );             \
+    }                                                                                    \
+                                                                                         \
+    plane_copy( img_dst->plane[0] + i_y0 * img_dst->i_stride[0], img_dst->i_stride[0],   \
+                src[0] + i_y0 * i_src[0], i_src[0],                                      \
+                i_width, i_y1 - i_y0 );                                                  \
+    plane_interleave_##func( img_dst->plane[1] + i_c0 * img_dst->i_stride[1],            \
+                             img_dst->i_stride[1],                                       \
+                             src[1+swap] + i_c0 * i_rows * i_src[1+swap], i_src[1+swap], \
+                             src[2-swap] + i_c0 * i_rows * i_src[2-swap], i_src[2-swap], \
+                             i_width >> 1, i_c1 - i_c0 );                                \
+    return 0;                                                                            \
 }
 
 #define YYUV_TO_I420( name, y_pos1, y_pos2, u_pos, v_pos )     \
 static int name( x264_image_t *img_dst, x264_image_t *img_src, \
-                 int i_width, int i_height )                   \
+                 int i_width, int i_height, int i_y0, int i_y1 ) \
 {                                                              \
     uint8_t *src = img_src->plane[0];                          \
     int     i_src= img_src->i_stride[0];                       \
                                                                \
-    uint8_t *y   = img_dst->plane[0];                          \
-    uint8_t *u   = img_dst->plane[1];                          \
-    uint8_t *v   = img_dst->plane[2];                          \
+    pixel   *y   = PIXEL_ROW( img_dst, 0, i_y0 );              \
+    pixel   *u   = PIXEL_ROW( img_dst, 1, i_y0 / 2 );          \
+    pixel   *v   = PIXEL_ROW( img_dst, 2, i_y0 / 2 );          \
                                                                \
     if( img_src->i_csp & X264VFW_CSP_VFLIP )                   \
-    {                                                          \
-        src += ( i_height - 1 ) * i_src;                       \
-        i_src = -i_src;                                        \
-    }                                                          \
+        src = plane_vflip( src, &i_src, i_height );            \
+    src += i_y0 * i_src;                                       \
                                                                \
-    for( ; i_height > 0; i_height -= 2 )                       \
+    for( i_height = i_y1 - i_y0; i_height > 0; i_height -= 2 ) \
     {                                                          \
         uint8_t *ss = src;                                     \
-        uint8_t *yy = y;                                       \
-        uint8_t *uu = u;                                       \
-        uint8_t *vv = v;                                       \
+        pixel   *yy = y;                                       \
+        pixel   *uu = u;                                       \
+        pixel   *vv = v;                                       \
         int w;                                                 \
                                                                \
         for( w = i_width; w > 0; w -= 2 )                      \
         {                                                      \
-            *yy++ = ss[y_pos1];                                \
-            *yy++ = ss[y_pos2];                                \
+            *yy++ = PIXEL8( ss[y_pos1] );                      \
+            *yy++ = PIXEL8( ss[y_pos2] );                      \
                                                                \
-            *uu++ = ( ss[u_pos] + ss[u_pos+i_src] + 1 ) >> 1;  \
-            *vv++ = ( ss[v_pos] + ss[v_pos+i_src] + 1 ) >> 1;  \
+            *uu++ = AVG2( ss[u_pos], ss[u_pos+i_src] );        \
+            *vv++ = AVG2( ss[v_pos], ss[v_pos+i_src] );        \
                                                                \
             ss += 4;                                           \
         }                                                      \
         src += i_src;                                          \
-        y += img_dst->i_stride[0];                             \
-        u += img_dst->i_stride[1];                             \
-        v += img_dst->i_stride[2];                             \
+        y += PIXEL_STRIDE( img_dst, 0 );                       \
+        u += PIXEL_STRIDE( img_dst, 1 );                       \
+        v += PIXEL_STRIDE( img_dst, 2 );                       \
                                                                \
         ss = src;                                              \
         yy = y;                                                \
         for( w = i_width; w > 0; w -= 2 )                      \
         {                                                      \
-            *yy++ = ss[y_pos1];                                \
-            *yy++ = ss[y_pos2];                                \
+            *yy++ = PIXEL8( ss[y_pos1] );                      \
+            *yy++ = PIXEL8( ss[y_pos2] );                      \
             ss += 4;                                           \
         }                                                      \
         src += i_src;                                          \
-        y += img_dst->i_stride[0];                             \
+        y += PIXEL_STRIDE( img_dst, 0 );                       \
     }                                                          \
     return 0;                                                  \
 }
 
-#define YYUV_TO_I422( name, y_pos1, y_pos2, u_pos, v_pos )     \
+/* Convert two rows of packed yuv 4:2:2 into two rows of luma and one row of interleaved chroma */
+static ALWAYS_INLINE void yyuv_to_nv12_row( int y_pos1, int y_pos2, int u_pos, int v_pos,
+                                            pixel *yy, int i_y, pixel *uv,
+                                            uint8_t *ss, int i_src, int w )
+{
+    for( ; w > 0; w -= 2 )
+    {
+        yy[0]     = PIXEL8( ss[y_pos1] );
+        yy[1]     = PIXEL8( ss[y_pos2] );
+        yy[i_y]   = PIXEL8( ss[y_pos1+i_src] );
+        yy[i_y+1] = PIXEL8( ss[y_pos2+i_src] );
+        uv[0]     = AVG2( ss[u_pos], ss[u_pos+i_src] );
+        uv[1]     = AVG2( ss[v_pos], ss[v_pos+i_src] );
+        yy += 2;
+        uv += 2;
+        ss += 4;
+    }
+}
+
+#define YYUV_TO_NV12( name, y_pos1, y_pos2, u_pos, v_pos )     \
 static int name( x264_image_t *img_dst, x264_image_t *img_src, \
-                 int i_width, int i_height )                   \
+                 int i_width, int i_height, int i_y0, int i_y1 ) \
 {                                                              \
     uint8_t *src = img_src->plane[0];                          \
     int     i_src= img_src->i_stride[0];                       \
                                                                \
-    uint8_t *y   = img_dst->plane[0];                          \
-    uint8_t *u   = img_dst->plane[1];                          \
-    uint8_t *v   = img_dst->plane[2];                          \
+    pixel   *y   = PIXEL_ROW( img_dst, 0, i_y0 );              \
+    pixel   *uv  = PIXEL_ROW( img_dst, 1, i_y0 / 2 );          \
+    int     i_y  = PIXEL_STRIDE( img_dst, 0 );                 \
                                                                \
     if( img_src->i_csp & X264VFW_CSP_VFLIP )                   \
+        src = plane_vflip( src, &i_src, i_height );            \
+    src += i_y0 * i_src;                                       \
+                                                               \
+    for( i_height = i_y1 - i_y0; i_height > 0; i_height -= 2 ) \
     {                                                          \
-        src += ( i_height - 1 ) * i_src;                       \
-        i_src = -i_src;                                        \
+        yyuv_to_nv12_row( y_pos1, y_pos2, u_pos, v_pos,        \
+                          y, i_y, uv, src, i_src, i_width );   \
+        src += 2*i_src;                                        \
+        y += 2*i_y;                                            \
+        uv += PIXEL_STRIDE( img_dst, 1 );                      \
     }                                                          \
+    return 0;                                                  \
+}
+
+#define YYUV_TO_I422( name, y_pos1, y_pos2, u_pos, v_pos )     \
+static int name( x264_image_t *img_dst, x264_image_t *img_src, \
+                 int i_width, int i_height, int i_y0, int i_y1 ) \
+{                                                              \
+    uint8_t *src = img_src->plane[0];                          \
+    int     i_src= img_src->i_stride[0];                       \
+                                                               \
+    pixel   *y   = PIXEL_ROW( img_dst, 0, i_y0 );              \
+    pixel   *u   = PIXEL_ROW( img_dst, 1, i_y0 );              \
+    pixel   *v   = PIXEL_ROW( img_dst, 2, i_y0 );              \
                                                                \
-    for( ; i_height > 0; i_height-- )                          \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                   \
+        src = plane_vflip( src, &i_src, i_height );            \
+    src += i_y0 * i_src;                                       \
+                                                               \
+    for( i_height = i_y1 - i_y0; i_height > 0; i_height-- )    \
     {                                                          \
         uint8_t *ss = src;                                     \
-        uint8_t *yy = y;                                       \
-        uint8_t *uu = u;                                       \
-        uint8_t *vv = v;                                       \
+        pixel   *yy = y;                                       \
+        pixel   *uu = u;                                       \
+        pixel   *vv = v;                                       \
         int w;                                                 \
                                                                \
         for( w = i_width; w > 0; w -= 2 )                      \
         {                                                      \
-            *yy++ = ss[y_pos1];                                \
-            *yy++ = ss[y_pos2];                                \
+            *yy++ = PIXEL8( ss[y_pos1] );                      \
+            *yy++ = PIXEL8( ss[y_pos2] );                      \
                                                                \
-            *uu++ = ss[u_pos];                                 \
-            *vv++ = ss[v_pos];                                 \
+            *uu++ = PIXEL8( ss[u_pos] );                       \
+            *vv++ = PIXEL8( ss[v_pos] );                       \
                                                                \
             ss += 4;                                           \
         }                                                      \
         src += i_src;                                          \
-        y += img_dst->i_stride[0];                             \
-        u += img_dst->i_stride[1];                             \
-        v += img_dst->i_stride[2];                             \
+        y += PIXEL_STRIDE( img_dst, 0 );                       \
+        u += PIXEL_STRIDE( img_dst, 1 );                       \
+        v += PIXEL_STRIDE( img_dst, 2 );                       \
     }                                                          \
     return 0;                                                  \
 }
 
+/* 16-bit yuv with one y plane and one packed u+v plane (P010/P210), v_shift - output chroma subsampling */
+#define PX10_TO_NV12( name, luma, func, v_shift )                                        \
+static int name( x264_image_t *img_dst, x264_image_t *img_src,                           \
+                 int i_width, int i_height, int i_y0, int i_y1 )                         \
+{                                                                                        \
+    int     i_rows = SRC_ROWS_##func;                                                    \
+    int     i_c0   = i_y0 >> v_shift;                                                    \
+    int     i_c1   = i_y1 >> v_shift;                                                    \
+    uint8_t *src[2];                                                                     \
+    int     i_src[2];                                                                    \
+                                                                                         \
+    src[0] = img_src->plane[0];                                                          \
+    src[1] = img_src->plane[1];                                                          \
+    i_src[0] = img_src->i_stride[0];                                                     \
+    i_src[1] = img_src->i_stride[1];                                                     \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                                             \
+    {                                                                                    \
+        src[0] = plane_vflip( src[0], &i_src[0], i_height );                             \
+        src[1] = plane_vflip( src[1], &i_src[1], (i_height >> v_shift) * i_rows );       \
+    }                                                                                    \
+                                                                                         \
+    plane_##luma( img_dst->plane[0] + i_y0 * img_dst->i_stride[0], img_dst->i_stride[0], \
+                  src[0] + i_y0 * i_src[0], i_src[0],                                    \
+                  i_width, i_y1 - i_y0 );                                                \
+    plane_##func( img_dst->plane[1] + i_c0 * img_dst->i_stride[1], img_dst->i_stride[1], \
+                  src[1] + i_c0 * i_rows * i_src[1], i_src[1],                           \
+                  i_width, i_c1 - i_c0 );                                                \
+    return 0;                                                                            \
+}
+
+#define PX10_TO_YUV( name, luma, func, v_shift )                                         \
+static int name( x264_image_t *img_dst, x264_image_t *img_src,                           \
+                 int i_width, int i_height, int i_y0, int i_y1 )                         \
+{                                                                                        \
+    int     i_rows = SRC_ROWS_##func;                                                    \
+    int     i_c0   = i_y0 >> v_shift;                                                    \
+    int     i_c1   = i_y1 >> v_shift;                                                    \
+    uint8_t *src[2];                                                                     \
+    int     i_src[2];                                                                    \
+                                                                                         \
+    src[0] = img_src->plane[0];                                                          \
+    src[1] = img_src->plane[1];                                                          \
+    i_src[0] = img_src->i_stride[0];                                                     \
+    i_src[1] = img_src->i_stride[1];                                                     \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                                             \
+    {                                                                                    \
+        src[0] = plane_vflip( src[0], &i_src[0], i_height );                             \
+        src[1] = plane_vflip( src[1], &i_src[1], (i_height >> v_shift) * i_rows );       \
+    }                                                                                    \
+                                                                                         \
+    plane_##luma( img_dst->plane[0] + i_y0 * img_dst->i_stride[0], img_dst->i_stride[0], \
+                  src[0] + i_y0 * i_src[0], i_src[0],                                    \
+                  i_width, i_y1 - i_y0 );                                                \
+    plane_##func( img_dst->plane[1] + i_c0 * img_dst->i_stride[1], img_dst->i_stride[1], \
+                  img_dst->plane[2] + i_c0 * img_dst->i_stride[2], img_dst->i_stride[2], \
+                  src[1] + i_c0 * i_rows * i_src[1], i_src[1],                           \
+                  i_width >> 1, i_c1 - i_c0 );                                           \
+    return 0;                                                                            \
+}
+
+/* v210: 6 pixels of 10-bit yuv 4:2:2 in 4 little-endian dwords (U Y V, Y U Y, V Y U, Y V Y),
+ * unpacked to msb aligned 16-bit samples, chroma as U0 V0 U1 V1 U2 V2 */
+static ALWAYS_INLINE void v210_unpack6( uint8_t *s, uint16_t *y, uint16_t *c )
+{
+    uint32_t *d = (uint32_t *)s;
+
+    c[0] = (d[0]       & 0x3ff) << 6;
+    y[0] = (d[0] >> 10 & 0x3ff) << 6;
+    c[1] = (d[0] >> 20 & 0x3ff) << 6;
+    y[1] = (d[1]       & 0x3ff) << 6;
+    c[2] = (d[1] >> 10 & 0x3ff) << 6;
+    y[2] = (d[1] >> 20 & 0x3ff) << 6;
+    c[3] = (d[2]       & 0x3ff) << 6;
+    y[3] = (d[2] >> 10 & 0x3ff) << 6;
+    c[4] = (d[2] >> 20 & 0x3ff) << 6;
+    y[4] = (d[3]       & 0x3ff) << 6;
+    c[5] = (d[3] >> 10 & 0x3ff) << 6;
+    y[5] = (d[3] >> 20 & 0x3ff) << 6;
+}
+
+/* Convert a row of v210, chroma is skipped if u is NULL and averaged with the next row if i_src2 != 0.
+ * Rows are padded to 48 pixels so the last block can be read whole. */
+static ALWAYS_INLINE void v210_row( pixel *y, pixel *u, pixel *v, int c_step,
+                                    uint8_t *s, int i_src2, int w )
+{
+    int x, i;
+
+    for( x = 0; x < w; x += 6, s += 16 )
+    {
+        uint16_t yy[6], cc[6];
+        int      n = X264_MIN( w - x, 6 );
+
+        v210_unpack6( s, yy, cc );
+        for( i = 0; i < n; i++ )
+            y[x+i] = PIXEL16( yy[i] );
+        if( !u )
+            continue;
+        if( i_src2 )
+        {
+            uint16_t yy2[6], cc2[6];
+            v210_unpack6( s + i_src2, yy2, cc2 );
+            for( i = 0; i < n; i++ )
+                cc[i] = ( cc[i] + cc2[i] + 1 ) >> 1;
+        }
+        for( i = 0; i < n / 2; i++ )
+        {
+            u[(x/2+i)*c_step] = PIXEL16( cc[2*i] );
+            v[(x/2+i)*c_step] = PIXEL16( cc[2*i+1] );
+        }
+    }
+}
+
+/* C_STEP - 1 for planar output, 2 for NV12, v_shift - output chroma subsampling */
+#define V210_TO_YUV( name, C_STEP, v_shift )                                      \
+static int name( x264_image_t *img_dst, x264_image_t *img_src,                    \
+                 int i_width, int i_height, int i_y0, int i_y1 )                  \
+{                                                                                 \
+    uint8_t *src = img_src->plane[0];                                             \
+    int     i_src= img_src->i_stride[0];                                          \
+    int     i_y  = PIXEL_STRIDE( img_dst, 0 );                                    \
+    pixel   *y   = PIXEL_ROW( img_dst, 0, i_y0 );                                 \
+    pixel   *u   = PIXEL_ROW( img_dst, 1, i_y0 >> v_shift );                      \
+    pixel   *v   = C_STEP == 2 ? u + 1 : PIXEL_ROW( img_dst, 2, i_y0 >> v_shift ); \
+    int     i_v  = PIXEL_STRIDE( img_dst, C_STEP == 2 ? 1 : 2 );                  \
+                                                                                  \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                                      \
+        src = plane_vflip( src, &i_src, i_height );                               \
+    src += i_y0 * i_src;                                                          \
+                                                                                  \
+    for( i_height = i_y1 - i_y0; i_height > 0; i_height -= 1 << v_shift )         \
+    {                                                                             \
+        v210_row( y, u, v, C_STEP, src, v_shift ? i_src : 0, i_width );           \
+        if( v_shift )                                                             \
+            v210_row( y + i_y, NULL, NULL, C_STEP, src + i_src, 0, i_width );     \
+        src += i_src << v_shift;                                                  \
+        y += i_y << v_shift;                                                      \
+        u += PIXEL_STRIDE( img_dst, 1 );                                          \
+        v += i_v;                                                                 \
+    }                                                                             \
+    return 0;                                                                     \
+}
+
+/* Y416: packed 16-bit yuv 4:4:4 with alpha, little-endian U Y V A */
+static int y416_to_i444( x264_image_t *img_dst, x264_image_t *img_src,
+                         int i_width, int i_height, int i_y0, int i_y1 )
+{
+    uint8_t *src = img_src->plane[0];
+    int     i_src= img_src->i_stride[0];
+    pixel   *y   = PIXEL_ROW( img_dst, 0, i_y0 );
+    pixel   *u   = PIXEL_ROW( img_dst, 1, i_y0 );
+    pixel   *v   = PIXEL_ROW( img_dst, 2, i_y0 );
+
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )
+        src = plane_vflip( src, &i_src, i_height );
+    src += i_y0 * i_src;
+
+    for( i_height = i_y1 - i_y0; i_height > 0; i_height-- )
+    {
+        uint16_t *ss = (uint16_t *)src;
+        int      x;
+
+        for( x = 0; x < i_width; x++ )
+        {
+            u[x] = PIXEL16( ss[4*x] );
+            y[x] = PIXEL16( ss[4*x+1] );
+            v[x] = PIXEL16( ss[4*x+2] );
+        }
+        src += i_src;
+        y += PIXEL_STRIDE( img_dst, 0 );
+        u += PIXEL_STRIDE( img_dst, 1 );
+        v += PIXEL_STRIDE( img_dst, 2 );
+    }
+    return 0;
+}
+
+/* C_STEP - 1 for I420 output, 2 for NV12 output */
+#define Y416_TO_420( name, C_STEP )                                               \
+static int name( x264_image_t *img_dst, x264_image_t *img_src,                    \
+                 int i_width, int i_height, int i_y0, int i_y1 )                  \
+{                                                                                 \
+    uint8_t *src = img_src->plane[0];                                             \
+    int     i_src= img_src->i_stride[0];                                          \
+    int     i_y  = PIXEL_STRIDE( img_dst, 0 );                                    \
+    pixel   *y   = PIXEL_ROW( img_dst, 0, i_y0 );                                 \
+    pixel   *u   = PIXEL_ROW( img_dst, 1, i_y0 / 2 );                             \
+    pixel   *v   = C_STEP == 2 ? u + 1 : PIXEL_ROW( img_dst, 2, i_y0 / 2 );       \
+    int     i_v  = PIXEL_STRIDE( img_dst, C_STEP == 2 ? 1 : 2 );                  \
+                                                                                  \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                                      \
+        src = plane_vflip( src, &i_src, i_height );                               \
+    src += i_y0 * i_src;                                                          \
+                                                                                  \
+    for( i_height = i_y1 - i_y0; i_height > 0; i_height -= 2 )                    \
+    {                                                                             \
+        uint16_t *s0 = (uint16_t *)src;                                           \
+        uint16_t *s1 = (uint16_t *)(src + i_src);                                 \
+        int      x;                                                               \
+                                                                                  \
+        for( x = 0; x < i_width; x += 2 )                                         \
+        {                                                                         \
+            y[x]       = PIXEL16( s0[4*x+1] );                                    \
+            y[x+1]     = PIXEL16( s0[4*x+5] );                                    \
+            y[x+i_y]   = PIXEL16( s1[4*x+1] );                                    \
+            y[x+i_y+1] = PIXEL16( s1[4*x+5] );                                    \
+            u[x/2*C_STEP] = PIXEL16( ( s0[4*x]   + s0[4*x+4] + s1[4*x]   + s1[4*x+4] + 2 ) >> 2 ); \
+            v[x/2*C_STEP] = PIXEL16( ( s0[4*x+2] + s0[4*x+6] + s1[4*x+2] + s1[4*x+6] + 2 ) >> 2 ); \
+        }                                                                         \
+        src += 2*i_src;                                                           \
+        y += 2*i_y;                                                               \
+        u += PIXEL_STRIDE( img_dst, 1 );                                          \
+        v += i_v;                                                                 \
+    }                                                                             \
+    return 0;                                                                     \
+}
+
 #define BITS         20
 #define INT_FIX      (1 << BITS)
 #define INT_ROUND    (INT_FIX >> 1)
@@ -284,231 +769,1432 @@ static int name( x264_image_t *img_dst, x264_image_t *img_src, \
 #define Y_R( rec, scale )   FIX(Kr_##rec * Ky_##scale)
 #define Y_G( rec, scale )   FIX(Kg(rec)  * Ky_##scale)
 #define Y_B( rec, scale )   FIX(Kb_##rec * Ky_##scale)
-#define Y_ADD( scale )      ((uint32_t)(Ay_##scale * INT_FIX + INT_ROUND + 0.5))
+/* Offsets are scaled to the output bit depth, RGB samples are loaded with the same depth */
+#define Y_ADD( scale )      ((uint32_t)(Ay_##scale * (1 << PIXEL_SHIFT8) * INT_FIX + INT_ROUND + 0.5))
 
 #define U_R( rec, scale )   FIX(Kr_##rec * Ku_##scale(rec))
 #define U_G( rec, scale )   FIX(Kg(rec)  * Ku_##scale(rec))
 #define U_B( rec, scale )   FIX(Sb(rec)  * Ku_##scale(rec))
-#define U_ADD( scale )      ((uint32_t)((Au_##scale * INT_FIX + INT_ROUND) * 4 + (Bu_##scale) + 0.5))
+#define U_ADD( scale )      ((uint32_t)((Au_##scale * (1 << PIXEL_SHIFT8) * INT_FIX + INT_ROUND) * 4 + (Bu_##scale) + 0.5))
 
 #define V_R( rec, scale )   FIX(Sr(rec)  * Kv_##scale(rec))
 #define V_G( rec, scale )   FIX(Kg(rec)  * Kv_##scale(rec))
 #define V_B( rec, scale )   FIX(Kb_##rec * Kv_##scale(rec))
-#define V_ADD( scale )      ((uint32_t)((Av_##scale * INT_FIX + INT_ROUND) * 4 + (Bv_##scale) + 0.5))
+#define V_ADD( scale )      ((uint32_t)((Av_##scale * (1 << PIXEL_SHIFT8) * INT_FIX + INT_ROUND) * 4 + (Bv_##scale) + 0.5))
+
+typedef struct
+{
+    uint32_t y_r, y_g, y_b, y_add;
+    uint32_t u_r, u_g, u_b, u_add;
+    uint32_t v_r, v_g, v_b, v_add;
+} rgb_coefs_t;
+
+#define RGB_COEFS( rec, scale )                                      \
+static const rgb_coefs_t rgb_coefs_##rec##_##scale =                 \
+{                                                                    \
+    Y_R(rec, scale), Y_G(rec, scale), Y_B(rec, scale), Y_ADD(scale), \
+    U_R(rec, scale), U_G(rec, scale), U_B(rec, scale), U_ADD(scale), \
+    V_R(rec, scale), V_G(rec, scale), V_B(rec, scale), V_ADD(scale)  \
+};
 
-#define RGB_TO_I420( name, POS_R, POS_G, POS_B, S_RGB, rec, scale )               \
+RGB_COEFS( 601, tv )
+RGB_COEFS( 601, pc )
+RGB_COEFS( 709, tv )
+RGB_COEFS( 709, pc )
+
+/* RGB sample with the output bit depth, b_be16 - 16-bit big-endian (b48r/b64a) instead of 8-bit */
+static ALWAYS_INLINE uint32_t rgb_load( uint8_t *p, int b_be16 )
+{
+    return b_be16 ? PIXEL16( (p[0] << 8) | p[1] ) : PIXEL8( p[0] );
+}
+
+/* Convert two rows of packed RGB into two rows of luma and one row of 2x2 subsampled chroma,
+ * c_step is 1 for planar chroma and 2 for interleaved (NV12) */
+static ALWAYS_INLINE void rgb_to_420_row( const rgb_coefs_t *k, int pos_r, int pos_g, int pos_b, int s_rgb, int b_be16,
+                                          pixel *yy, int i_y, pixel *uu, pixel *vv, int c_step,
+                                          uint8_t *ss, int i_src, int w )
+{
+    for( ; w > 0; w -= 2 )
+    {
+        uint32_t cr = 0,cg = 0,cb = 0;
+        uint32_t r, g, b;
+
+        /* Luma */
+        cr = r = rgb_load( ss + pos_r, b_be16 );
+        cg = g = rgb_load( ss + pos_g, b_be16 );
+        cb = b = rgb_load( ss + pos_b, b_be16 );
+
+        yy[0] = (k->y_add + k->y_r * r + k->y_g * g + k->y_b * b) >> BITS;
+
+        cr+= r = rgb_load( ss + pos_r + i_src, b_be16 );
+        cg+= g = rgb_load( ss + pos_g + i_src, b_be16 );
+        cb+= b = rgb_load( ss + pos_b + i_src, b_be16 );
+
+        yy[i_y] = (k->y_add + k->y_r * r + k->y_g * g + k->y_b * b) >> BITS;
+        yy++;
+        ss += s_rgb;
+
+        cr+= r = rgb_load( ss + pos_r, b_be16 );
+        cg+= g = rgb_load( ss + pos_g, b_be16 );
+        cb+= b = rgb_load( ss + pos_b, b_be16 );
+
+        yy[0] = (k->y_add + k->y_r * r + k->y_g * g + k->y_b * b) >> BITS;
+
+        cr+= r = rgb_load( ss + pos_r + i_src, b_be16 );
+        cg+= g = rgb_load( ss + pos_g + i_src, b_be16 );
+        cb+= b = rgb_load( ss + pos_b + i_src, b_be16 );
+
+        yy[i_y] = (k->y_add + k->y_r * r + k->y_g * g + k->y_b * b) >> BITS;
+        yy++;
+        ss += s_rgb;
+
+        /* Chroma */
+        *uu = (pixel)((k->u_add + k->u_b * cb - k->u_r * cr - k->u_g * cg) >> (BITS+2));
+        *vv = (pixel)((k->v_add + k->v_r * cr - k->v_g * cg - k->v_b * cb) >> (BITS+2));
+        uu += c_step;
+        vv += c_step;
+    }
+}
+
+/* C_STEP - 1 for I420 output, 2 for NV12 output */
+#define RGB_TO_420( name, POS_R, POS_G, POS_B, S_RGB, BE16, rec, scale, C_STEP )  \
 static int name##_##rec##_##scale( x264_image_t *img_dst, x264_image_t *img_src,  \
-                                   int i_width, int i_height )                    \
+                                   int i_width, int i_height, int i_y0, int i_y1 ) \
 {                                                                                 \
     uint8_t *src = img_src->plane[0];                                             \
     int     i_src= img_src->i_stride[0];                                          \
-    int     i_y  = img_dst->i_stride[0];                                          \
-    uint8_t *y   = img_dst->plane[0];                                             \
-    uint8_t *u   = img_dst->plane[1];                                             \
-    uint8_t *v   = img_dst->plane[2];                                             \
+    int     i_y  = PIXEL_STRIDE( img_dst, 0 );                                    \
+    pixel   *y   = PIXEL_ROW( img_dst, 0, i_y0 );                                 \
+    pixel   *u   = PIXEL_ROW( img_dst, 1, i_y0 / 2 );                             \
+    pixel   *v   = C_STEP == 2 ? u + 1 : PIXEL_ROW( img_dst, 2, i_y0 / 2 );       \
+    int     i_v  = PIXEL_STRIDE( img_dst, C_STEP == 2 ? 1 : 2 );                  \
                                                                                   \
     if( img_src->i_csp & X264VFW_CSP_VFLIP )                                      \
-    {                                                                             \
-        src += ( i_height - 1 ) * i_src;                                          \
-        i_src = -i_src;                                                           \
-    }                                                                             \
+        src = plane_vflip( src, &i_src, i_height );                               \
+    src += i_y0 * i_src;                                                          \
                                                                                   \
-    for(  ; i_height > 0; i_height -= 2 )                                         \
+    for( i_height = i_y1 - i_y0; i_height > 0; i_height -= 2 )                    \
     {                                                                             \
-        uint8_t *ss = src;                                                        \
-        uint8_t *yy = y;                                                          \
-        uint8_t *uu = u;                                                          \
-        uint8_t *vv = v;                                                          \
-        int w;                                                                    \
-                                                                                  \
-        for( w = i_width; w > 0; w -= 2 )                                         \
-        {                                                                         \
-            uint32_t cr = 0,cg = 0,cb = 0;                                        \
-            uint32_t r, g, b;                                                     \
-                                                                                  \
-            /* Luma */                                                            \
-            cr = r = ss[POS_R];                                                   \
-            cg = g = ss[POS_G];                                                   \
-            cb = b = ss[POS_B];                                                   \
-                                                                                  \
-            yy[0] = (Y_ADD(scale) +                                               \
-                     Y_R(rec, scale) * r +                                        \
-                     Y_G(rec, scale) * g +                                        \
-                     Y_B(rec, scale) * b) >> BITS;                                \
-                                                                                  \
-            cr+= r = ss[POS_R+i_src];                                             \
-            cg+= g = ss[POS_G+i_src];                                             \
-            cb+= b = ss[POS_B+i_src];                                             \
-                                                                                  \
-            yy[i_y] = (Y_ADD(scale) +                                             \
-                       Y_R(rec, scale) * r +                                      \
-                       Y_G(rec, scale) * g +                                      \
-                       Y_B(rec, scale) * b) >> BITS;                              \
-            yy++;                                                                 \
-            ss += S_RGB;                                                          \
-                                                                                  \
-            cr+= r = ss[POS_R];                                                   \
-            cg+= g = ss[POS_G];                                                   \
-            cb+= b = ss[POS_B];                                                   \
-                                                                                  \
-            yy[0] = (Y_ADD(scale) +                                               \
-                     Y_R(rec, scale) * r +                                        \
-                     Y_G(rec, scale) * g +                                        \
-                     Y_B(rec, scale) * b) >> BITS;                                \
-                                                                                  \
-            cr+= r = ss[POS_R+i_src];                                             \
-            cg+= g = ss[POS_G+i_src];                                             \
-            cb+= b = ss[POS_B+i_src];                                             \
-                                                                                  \
-            yy[i_y] = (Y_ADD(scale) +                                             \
-                       Y_R(rec, scale) * r +                                      \
-                       Y_G(rec, scale) * g +                                      \
-                       Y_B(rec, scale) * b) >> BITS;                              \
-            yy++;                                                                 \
-            ss += S_RGB;                                                          \
-                                                                                  \
-            /* Chroma */                                                          \
-            *uu++ = (uint8_t)((U_ADD(scale) +                                     \
-                               U_B(rec, scale) * cb -                             \
-                               U_R(rec, scale) * cr -                             \
-                               U_G(rec, scale) * cg) >> (BITS+2));                \
+        rgb_to_420_row( &rgb_coefs_##rec##_##scale, POS_R, POS_G, POS_B, S_RGB,   \
+                        BE16, y, i_y, u, v, C_STEP, src, i_src, i_width );        \
+        src += 2*i_src;                                                           \
+        y += 2*i_y;                                                               \
+        u += PIXEL_STRIDE( img_dst, 1 );                                          \
+        v += i_v;                                                                 \
+    }                                                                             \
+    return 0;                                                                     \
+}
+
+/* Convert a row of packed RGB into a row of luma and a row of 4:4:4 or 4:2:2 (b_422) chroma.
+ * Chroma is scaled to the 2x2 sums of the 4:2:0 version so the same coefficients are used. */
+static ALWAYS_INLINE void rgb_to_4xx_row( const rgb_coefs_t *k, int pos_r, int pos_g, int pos_b, int s_rgb, int b_be16,
+                                          pixel *yy, pixel *uu, pixel *vv, uint8_t *ss, int w, int b_422 )
+{
+    for( ; w > 0; w -= b_422 ? 2 : 1 )
+    {
+        uint32_t cr, cg, cb;
+        uint32_t r, g, b;
+
+        /* Luma */
+        cr = r = rgb_load( ss + pos_r, b_be16 );
+        cg = g = rgb_load( ss + pos_g, b_be16 );
+        cb = b = rgb_load( ss + pos_b, b_be16 );
+
+        *yy++ = (k->y_add + k->y_r * r + k->y_g * g + k->y_b * b) >> BITS;
+        ss += s_rgb;
+
+        if( b_422 )
+        {
+            cr+= r = rgb_load( ss + pos_r, b_be16 );
+            cg+= g = rgb_load( ss + pos_g, b_be16 );
+            cb+= b = rgb_load( ss + pos_b, b_be16 );
+
+            *yy++ = (k->y_add + k->y_r * r + k->y_g * g + k->y_b * b) >> BITS;
+            ss += s_rgb;
+
+            cr *= 2;
+            cg *= 2;
+            cb *= 2;
+        }
+        else
+        {
+            cr *= 4;
+            cg *= 4;
+            cb *= 4;
+        }
+
+        /* Chroma */
+        *uu++ = (pixel)((k->u_add + k->u_b * cb - k->u_r * cr - k->u_g * cg) >> (BITS+2));
+        *vv++ = (pixel)((k->v_add + k->v_r * cr - k->v_g * cg - k->v_b * cb) >> (BITS+2));
+    }
+}
+
+/* B_422 - 0 for I444 output, 1 for I422 output */
+#define RGB_TO_4XX( name, POS_R, POS_G, POS_B, S_RGB, BE16, rec, scale, B_422 )   \
+static int name##_##rec##_##scale( x264_image_t *img_dst, x264_image_t *img_src,  \
+                                   int i_width, int i_height, int i_y0, int i_y1 ) \
+{                                                                                 \
+    uint8_t *src = img_src->plane[0];                                             \
+    int     i_src= img_src->i_stride[0];                                          \
+    pixel   *y   = PIXEL_ROW( img_dst, 0, i_y0 );                                 \
+    pixel   *u   = PIXEL_ROW( img_dst, 1, i_y0 );                                 \
+    pixel   *v   = PIXEL_ROW( img_dst, 2, i_y0 );                                 \
                                                                                   \
-            *vv++ = (uint8_t)((V_ADD(scale) +                                     \
-                               V_R(rec, scale) * cr -                             \
-                               V_G(rec, scale) * cg -                             \
-                               V_B(rec, scale) * cb) >> (BITS+2));                \
-        }                                                                         \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                                      \
+        src = plane_vflip( src, &i_src, i_height );                               \
+    src += i_y0 * i_src;                                                          \
                                                                                   \
-        src += 2*i_src;                                                           \
-        y += 2*img_dst->i_stride[0];                                              \
-        u += img_dst->i_stride[1];                                                \
-        v += img_dst->i_stride[2];                                                \
+    for( i_height = i_y1 - i_y0; i_height > 0; i_height-- )                       \
+    {                                                                             \
+        rgb_to_4xx_row( &rgb_coefs_##rec##_##scale, POS_R, POS_G, POS_B, S_RGB,   \
+                        BE16, y, u, v, src, i_width, B_422 );                     \
+        src += i_src;                                                             \
+        y += PIXEL_STRIDE( img_dst, 0 );                                          \
+        u += PIXEL_STRIDE( img_dst, 1 );                                          \
+        v += PIXEL_STRIDE( img_dst, 2 );                                          \
     }                                                                             \
     return 0;                                                                     \
 }
 
 #define RGB_TO_RGB( name, S_RGB )                                  \
 static int name( x264_image_t *img_dst, x264_image_t *img_src,     \
-                 int i_width, int i_height )                       \
+                 int i_width, int i_height, int i_y0, int i_y1 )   \
 {                                                                  \
+    uint8_t *src = img_src->plane[0];                              \
+    int     i_src= img_src->i_stride[0];                           \
+                                                                   \
     if( img_src->i_csp & X264VFW_CSP_VFLIP )                       \
-    {                                                              \
-        plane_copy_vflip( img_dst->plane[0], img_dst->i_stride[0], \
-                          img_src->plane[0], img_src->i_stride[0], \
-                          i_width * S_RGB, i_height );             \
-    }                                                              \
-    else                                                           \
-    {                                                              \
-        plane_copy( img_dst->plane[0], img_dst->i_stride[0],       \
-                    img_src->plane[0], img_src->i_stride[0],       \
-                    i_width * S_RGB, i_height );                   \
-    }                                                              \
+        src = plane_vflip( src, &i_src, i_height );                \
+    plane_copy( img_dst->plane[0] + i_y0 * img_dst->i_stride[0],   \
+                img_dst->i_stride[0],                              \
+                src + i_y0 * i_src, i_src,                         \
+                i_width * S_RGB, i_y1 - i_y0 );                    \
     return 0;                                                      \
 }
 
-YUV_TO_YUV( i420_to_i420, copy,         0, 1, 1 )
-//YUV_TO_YUV( i422_to_i420, subsamplev2,  0, 1, 1 )
-//YUV_TO_YUV( i444_to_i420, subsamplehv2, 0, 1, 1 )
-YUV_TO_YUV( yv12_to_i420, copy,         1, 1, 1 )
-YUV_TO_YUV( yv16_to_i420, subsamplev2,  1, 1, 1 )
-YUV_TO_YUV( yv24_to_i420, subsamplehv2, 1, 1, 1 )
-//YUV_TO_YUV( i422_to_i422, copy,         0, 1, 0 )
-YUV_TO_YUV( yv16_to_i422, copy,         1, 1, 0 )
-//YUV_TO_YUV( i444_to_i444, copy,         0, 0, 0 )
-YUV_TO_YUV( yv24_to_i444, copy,         1, 0, 0 )
+/* 16-bit big-endian RGB (b48r, b64a) -> BGR/BGRA, POS_A is only used for BGRA output */
+#define RGB16BE_TO_RGB( name, POS_A, POS_R, POS_G, POS_B, S_SRC, S_DST )   \
+static int name( x264_image_t *img_dst, x264_image_t *img_src,             \
+                 int i_width, int i_height, int i_y0, int i_y1 )           \
+{                                                                          \
+    uint8_t *src = img_src->plane[0];                                      \
+    int     i_src= img_src->i_stride[0];                                   \
+    pixel   *dst = PIXEL_ROW( img_dst, 0, i_y0 );                          \
+                                                                           \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                               \
+        src = plane_vflip( src, &i_src, i_height );                        \
+    src += i_y0 * i_src;                                                   \
+                                                                           \
+    for( i_height = i_y1 - i_y0; i_height > 0; i_height-- )                \
+    {                                                                      \
+        uint8_t *ss = src;                                                 \
+        pixel   *dd = dst;                                                 \
+        int w;                                                             \
+                                                                           \
+        for( w = i_width; w > 0; w-- )                                     \
+        {                                                                  \
+            dd[0] = rgb_load( ss + POS_B, 1 );                             \
+            dd[1] = rgb_load( ss + POS_G, 1 );                             \
+            dd[2] = rgb_load( ss + POS_R, 1 );                             \
+            if( S_DST == 4 )                                               \
+                dd[3] = rgb_load( ss + POS_A, 1 );                         \
+            dd += S_DST;                                                   \
+            ss += S_SRC;                                                   \
+        }                                                                  \
+        src += i_src;                                                      \
+        dst += PIXEL_STRIDE( img_dst, 0 );                                 \
+    }                                                                      \
+    return 0;                                                              \
+}
 
-NV_TO_NV( nv12_to_nv12, copy,        1 )
+YUV_TO_YUV( i420_to_i420, copy, copy,         0, 1, 1 )
+YUV_TO_YUV( i422_to_i420, copy, subsamplev2,  0, 1, 1 )
+YUV_TO_YUV( i444_to_i420, copy, subsamplehv2, 0, 1, 1 )
+YUV_TO_YUV( yv12_to_i420, copy, copy,         1, 1, 1 )
+YUV_TO_YUV( yv16_to_i420, copy, subsamplev2,  1, 1, 1 )
+YUV_TO_YUV( yv24_to_i420, copy, subsamplehv2, 1, 1, 1 )
+YUV_TO_YUV( i422_to_i422, copy, copy,         0, 1, 0 )
+YUV_TO_YUV( yv16_to_i422, copy, copy,         1, 1, 0 )
+YUV_TO_YUV( i444_to_i444, copy, copy,         0, 0, 0 )
+YUV_TO_YUV( yv24_to_i444, copy, copy,         1, 0, 0 )
+
+YUV_TO_NV12( i420_to_nv12, copy,         0 )
+YUV_TO_NV12( i422_to_nv12, subsamplev2,  0 )
+YUV_TO_NV12( i444_to_nv12, subsamplehv2, 0 )
+YUV_TO_NV12( yv12_to_nv12, copy,         1 )
+YUV_TO_NV12( yv16_to_nv12, subsamplev2,  1 )
+YUV_TO_NV12( yv24_to_nv12, subsamplehv2, 1 )
+
+NV_TO_NV( nv12_to_nv12, copy, copy,        1 )
 
 YYUV_TO_I420( yuyv_to_i420, 0, 2, 1, 3 )
 YYUV_TO_I420( uyvy_to_i420, 1, 3, 0, 2 )
 
+YYUV_TO_NV12( yuyv_to_nv12, 0, 2, 1, 3 )
+YYUV_TO_NV12( uyvy_to_nv12, 1, 3, 0, 2 )
+
 YYUV_TO_I422( yuyv_to_i422, 0, 2, 1, 3 )
 YYUV_TO_I422( uyvy_to_i422, 1, 3, 0, 2 )
 
-RGB_TO_I420(  bgr_to_i420, 2, 1, 0, 3, 601, tv )
-RGB_TO_I420( bgra_to_i420, 2, 1, 0, 4, 601, tv )
-RGB_TO_I420(  bgr_to_i420, 2, 1, 0, 3, 601, pc )
-RGB_TO_I420( bgra_to_i420, 2, 1, 0, 4, 601, pc )
-RGB_TO_I420(  bgr_to_i420, 2, 1, 0, 3, 709, tv )
-RGB_TO_I420( bgra_to_i420, 2, 1, 0, 4, 709, tv )
-RGB_TO_I420(  bgr_to_i420, 2, 1, 0, 3, 709, pc )
-RGB_TO_I420( bgra_to_i420, 2, 1, 0, 4, 709, pc )
+PX10_TO_NV12( p010_to_nv12, copy16, copy16,                      1 )
+PX10_TO_NV12( p210_to_nv12, copy16, subsamplev2_16,              1 )
+PX10_TO_YUV(  p010_to_i420, copy16, deinterleave16,              1 )
+PX10_TO_YUV(  p210_to_i420, copy16, deinterleave_subsamplev2_16, 1 )
+PX10_TO_YUV(  p210_to_i422, copy16, deinterleave16,              0 )
+
+V210_TO_YUV( v210_to_i420, 1, 1 )
+V210_TO_YUV( v210_to_nv12, 2, 1 )
+V210_TO_YUV( v210_to_i422, 1, 0 )
+
+Y416_TO_420( y416_to_i420, 1 )
+Y416_TO_420( y416_to_nv12, 2 )
+
+RGB_TO_420(  bgr_to_i420, 2, 1, 0, 3, 0, 601, tv, 1 )
+RGB_TO_420( bgra_to_i420, 2, 1, 0, 4, 0, 601, tv, 1 )
+RGB_TO_420(  bgr_to_i420, 2, 1, 0, 3, 0, 601, pc, 1 )
+RGB_TO_420( bgra_to_i420, 2, 1, 0, 4, 0, 601, pc, 1 )
+RGB_TO_420(  bgr_to_i420, 2, 1, 0, 3, 0, 709, tv, 1 )
+RGB_TO_420( bgra_to_i420, 2, 1, 0, 4, 0, 709, tv, 1 )
+RGB_TO_420(  bgr_to_i420, 2, 1, 0, 3, 0, 709, pc, 1 )
+RGB_TO_420( bgra_to_i420, 2, 1, 0, 4, 0, 709, pc, 1 )
+RGB_TO_420( b48r_to_i420, 0, 2, 4, 6, 1, 601, tv, 1 )
+RGB_TO_420( b64a_to_i420, 2, 4, 6, 8, 1, 601, tv, 1 )
+RGB_TO_420( b48r_to_i420, 0, 2, 4, 6, 1, 601, pc, 1 )
+RGB_TO_420( b64a_to_i420, 2, 4, 6, 8, 1, 601, pc, 1 )
+RGB_TO_420( b48r_to_i420, 0, 2, 4, 6, 1, 709, tv, 1 )
+RGB_TO_420( b64a_to_i420, 2, 4, 6, 8, 1, 709, tv, 1 )
+RGB_TO_420( b48r_to_i420, 0, 2, 4, 6, 1, 709, pc, 1 )
+RGB_TO_420( b64a_to_i420, 2, 4, 6, 8, 1, 709, pc, 1 )
+
+RGB_TO_420(  bgr_to_nv12, 2, 1, 0, 3, 0, 601, tv, 2 )
+RGB_TO_420( bgra_to_nv12, 2, 1, 0, 4, 0, 601, tv, 2 )
+RGB_TO_420(  bgr_to_nv12, 2, 1, 0, 3, 0, 601, pc, 2 )
+RGB_TO_420( bgra_to_nv12, 2, 1, 0, 4, 0, 601, pc, 2 )
+RGB_TO_420(  bgr_to_nv12, 2, 1, 0, 3, 0, 709, tv, 2 )
+RGB_TO_420( bgra_to_nv12, 2, 1, 0, 4, 0, 709, tv, 2 )
+RGB_TO_420(  bgr_to_nv12, 2, 1, 0, 3, 0, 709, pc, 2 )
+RGB_TO_420( bgra_to_nv12, 2, 1, 0, 4, 0, 709, pc, 2 )
+RGB_TO_420( b48r_to_nv12, 0, 2, 4, 6, 1, 601, tv, 2 )
+RGB_TO_420( b64a_to_nv12, 2, 4, 6, 8, 1, 601, tv, 2 )
+RGB_TO_420( b48r_to_nv12, 0, 2, 4, 6, 1, 601, pc, 2 )
+RGB_TO_420( b64a_to_nv12, 2, 4, 6, 8, 1, 601, pc, 2 )
+RGB_TO_420( b48r_to_nv12, 0, 2, 4, 6, 1, 709, tv, 2 )
+RGB_TO_420( b64a_to_nv12, 2, 4, 6, 8, 1, 709, tv, 2 )
+RGB_TO_420( b48r_to_nv12, 0, 2, 4, 6, 1, 709, pc, 2 )
+RGB_TO_420( b64a_to_nv12, 2, 4, 6, 8, 1, 709, pc, 2 )
+
+RGB_TO_4XX(  bgr_to_i444, 2, 1, 0, 3, 0, 601, tv, 0 )
+RGB_TO_4XX( bgra_to_i444, 2, 1, 0, 4, 0, 601, tv, 0 )
+RGB_TO_4XX(  bgr_to_i444, 2, 1, 0, 3, 0, 601, pc, 0 )
+RGB_TO_4XX( bgra_to_i444, 2, 1, 0, 4, 0, 601, pc, 0 )
+RGB_TO_4XX(  bgr_to_i444, 2, 1, 0, 3, 0, 709, tv, 0 )
+RGB_TO_4XX( bgra_to_i444, 2, 1, 0, 4, 0, 709, tv, 0 )
+RGB_TO_4XX(  bgr_to_i444, 2, 1, 0, 3, 0, 709, pc, 0 )
+RGB_TO_4XX( bgra_to_i444, 2, 1, 0, 4, 0, 709, pc, 0 )
+RGB_TO_4XX( b48r_to_i444, 0, 2, 4, 6, 1, 601, tv, 0 )
+RGB_TO_4XX( b64a_to_i444, 2, 4, 6, 8, 1, 601, tv, 0 )
+RGB_TO_4XX( b48r_to_i444, 0, 2, 4, 6, 1, 601, pc, 0 )
+RGB_TO_4XX( b64a_to_i444, 2, 4, 6, 8, 1, 601, pc, 0 )
+RGB_TO_4XX( b48r_to_i444, 0, 2, 4, 6, 1, 709, tv, 0 )
+RGB_TO_4XX( b64a_to_i444, 2, 4, 6, 8, 1, 709, tv, 0 )
+RGB_TO_4XX( b48r_to_i444, 0, 2, 4, 6, 1, 709, pc, 0 )
+RGB_TO_4XX( b64a_to_i444, 2, 4, 6, 8, 1, 709, pc, 0 )
+
+RGB_TO_4XX(  bgr_to_i422, 2, 1, 0, 3, 0, 601, tv, 1 )
+RGB_TO_4XX( bgra_to_i422, 2, 1, 0, 4, 0, 601, tv, 1 )
+RGB_TO_4XX(  bgr_to_i422, 2, 1, 0, 3, 0, 601, pc, 1 )
+RGB_TO_4XX( bgra_to_i422, 2, 1, 0, 4, 0, 601, pc, 1 )
+RGB_TO_4XX(  bgr_to_i422, 2, 1, 0, 3, 0, 709, tv, 1 )
+RGB_TO_4XX( bgra_to_i422, 2, 1, 0, 4, 0, 709, tv, 1 )
+RGB_TO_4XX(  bgr_to_i422, 2, 1, 0, 3, 0, 709, pc, 1 )
+RGB_TO_4XX( bgra_to_i422, 2, 1, 0, 4, 0, 709, pc, 1 )
+RGB_TO_4XX( b48r_to_i422, 0, 2, 4, 6, 1, 601, tv, 1 )
+RGB_TO_4XX( b64a_to_i422, 2, 4, 6, 8, 1, 601, tv, 1 )
+RGB_TO_4XX( b48r_to_i422, 0, 2, 4, 6, 1, 601, pc, 1 )
+RGB_TO_4XX( b64a_to_i422, 2, 4, 6, 8, 1, 601, pc, 1 )
+RGB_TO_4XX( b48r_to_i422, 0, 2, 4, 6, 1, 709, tv, 1 )
+RGB_TO_4XX( b64a_to_i422, 2, 4, 6, 8, 1, 709, tv, 1 )
+RGB_TO_4XX( b48r_to_i422, 0, 2, 4, 6, 1, 709, pc, 1 )
+RGB_TO_4XX( b64a_to_i422, 2, 4, 6, 8, 1, 709, pc, 1 )
 
 RGB_TO_RGB(   bgr_to_bgr, 3 )
 RGB_TO_RGB( bgra_to_bgra, 4 )
 
-void x264vfw_csp_init( x264vfw_csp_function_t *pf, int i_x264_csp, int i_colmatrix, int b_fullrange )
+RGB16BE_TO_RGB( b48r_to_bgr,  -1, 0, 2, 4, 6, 3 )
+RGB16BE_TO_RGB( b64a_to_bgra,  0, 2, 4, 6, 8, 4 )
+
+#if HAVE_X86_SIMD && X264_BIT_DEPTH == 8
+/* SIMD versions of the RGB -> YUV converters.
+ * The 20-bit fixed point coefficients are split as C = Ch * 256 + Cl so pmaddwd can be used
+ * while the results stay bit-exact with the C versions.
+ * Pixels are expanded to B,G,R,X dwords, X has zero weight. */
+
+#define COEF_H( c ) ((int16_t)((c) >> 8))
+#define COEF_L( c ) ((int16_t)((c) & 255))
+#define NEG_H( c )  ((int16_t)-COEF_H( c ))
+#define NEG_L( c )  ((int16_t)-COEF_L( c ))
+
+#define COEFS_X4( part1, c1, part2, c2, part3, c3 )\
+    part1( c1 ), part2( c2 ), part3( c3 ), 0, part1( c1 ), part2( c2 ), part3( c3 ), 0
+#define Y_COEFS( part, k ) COEFS_X4( part, (k)->y_b, part, (k)->y_g, part, (k)->y_r )
+#define U_COEFS( part, neg, k ) COEFS_X4( part, (k)->u_b, neg, (k)->u_g, neg, (k)->u_r )
+#define V_COEFS( part, neg, k ) COEFS_X4( neg, (k)->v_b, neg, (k)->v_g, part, (k)->v_r )
+
+static ALWAYS_INLINE TARGET_SSE2 __m128i hadd_epi32_sse2( __m128i a, __m128i b )
+{
+    __m128 fa = _mm_castsi128_ps( a );
+    __m128 fb = _mm_castsi128_ps( b );
+    return _mm_add_epi32( _mm_castps_si128( _mm_shuffle_ps( fa, fb, _MM_SHUFFLE( 2, 0, 2, 0 ) ) ),
+                          _mm_castps_si128( _mm_shuffle_ps( fa, fb, _MM_SHUFFLE( 3, 1, 3, 1 ) ) ) );
+}
+
+/* Dot product of B,G,R,X words with 20-bit coefficients (two dwords per pixel) */
+static ALWAYS_INLINE TARGET_SSE2 __m128i madd20_sse2( __m128i x, __m128i h, __m128i l )
+{
+    return _mm_add_epi32( _mm_slli_epi32( _mm_madd_epi16( x, h ), 8 ), _mm_madd_epi16( x, l ) );
+}
+
+/* Weighted sum of 4 pixels (2 unpacked registers) plus rounding, descaled by i_shift */
+static ALWAYS_INLINE TARGET_SSE2 __m128i rgb_dot4_sse2( __m128i lo, __m128i hi, __m128i h, __m128i l, __m128i add, int i_shift )
+{
+    return _mm_srai_epi32( _mm_add_epi32( hadd_epi32_sse2( madd20_sse2( lo, h, l ), madd20_sse2( hi, h, l ) ), add ), i_shift );
+}
+
+/* Sums of two 2x2 blocks of 4x2 unpacked pixels */
+static ALWAYS_INLINE TARGET_SSE2 __m128i rgb_sum2x2_sse2( __m128i al, __m128i ah, __m128i bl, __m128i bh )
+{
+    __m128i s = _mm_add_epi16( al, bl );
+    __m128i t = _mm_add_epi16( ah, bh );
+    return _mm_add_epi16( _mm_unpacklo_epi64( s, t ), _mm_unpackhi_epi64( s, t ) );
+}
+
+/* Convert 8x2 pixels: a0/a1 - top row pixels 0-3/4-7, b0/b1 - bottom row.
+ * With b_nv12 the chroma is stored interleaved to uu and vv is unused. */
+static ALWAYS_INLINE TARGET_SSE2 void rgb_to_420_core_sse2( const rgb_coefs_t *k, __m128i a0, __m128i a1, __m128i b0, __m128i b1,
+                                                            uint8_t *yy, int i_y, uint8_t *uu, uint8_t *vv, int b_nv12 )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i yh   = _mm_setr_epi16( Y_COEFS( COEF_H, k ) );
+    const __m128i yl   = _mm_setr_epi16( Y_COEFS( COEF_L, k ) );
+    const __m128i uh   = _mm_setr_epi16( U_COEFS( COEF_H, NEG_H, k ) );
+    const __m128i ul   = _mm_setr_epi16( U_COEFS( COEF_L, NEG_L, k ) );
+    const __m128i vh   = _mm_setr_epi16( V_COEFS( COEF_H, NEG_H, k ) );
+    const __m128i vl   = _mm_setr_epi16( V_COEFS( COEF_L, NEG_L, k ) );
+    const __m128i yadd = _mm_set1_epi32( k->y_add );
+    const __m128i uadd = _mm_set1_epi32( k->u_add );
+    const __m128i vadd = _mm_set1_epi32( k->v_add );
+    __m128i a0l = _mm_unpacklo_epi8( a0, zero ), a0h = _mm_unpackhi_epi8( a0, zero );
+    __m128i a1l = _mm_unpacklo_epi8( a1, zero ), a1h = _mm_unpackhi_epi8( a1, zero );
+    __m128i b0l = _mm_unpacklo_epi8( b0, zero ), b0h = _mm_unpackhi_epi8( b0, zero );
+    __m128i b1l = _mm_unpacklo_epi8( b1, zero ), b1h = _mm_unpackhi_epi8( b1, zero );
+    __m128i y, c0, c1, u, v;
+
+    /* Luma */
+    y = _mm_packus_epi16( _mm_packs_epi32( rgb_dot4_sse2( a0l, a0h, yh, yl, yadd, BITS ),
+                                           rgb_dot4_sse2( a1l, a1h, yh, yl, yadd, BITS ) ),
+                          _mm_packs_epi32( rgb_dot4_sse2( b0l, b0h, yh, yl, yadd, BITS ),
+                                           rgb_dot4_sse2( b1l, b1h, yh, yl, yadd, BITS ) ) );
+    _mm_storel_epi64( (__m128i *)yy, y );
+    _mm_storel_epi64( (__m128i *)(yy + i_y), _mm_srli_si128( y, 8 ) );
+
+    /* Chroma */
+    c0 = rgb_sum2x2_sse2( a0l, a0h, b0l, b0h );
+    c1 = rgb_sum2x2_sse2( a1l, a1h, b1l, b1h );
+    u = rgb_dot4_sse2( c0, c1, uh, ul, uadd, BITS+2 );
+    v = rgb_dot4_sse2( c0, c1, vh, vl, vadd, BITS+2 );
+    u = _mm_packus_epi16( _mm_packs_epi32( u, v ), zero );
+    if( b_nv12 )
+        _mm_storel_epi64( (__m128i *)uu, _mm_unpacklo_epi8( u, _mm_srli_si128( u, 4 ) ) );
+    else
+    {
+        *(uint32_t *)uu = _mm_cvtsi128_si32( u );
+        *(uint32_t *)vv = _mm_cvtsi128_si32( _mm_srli_si128( u, 4 ) );
+    }
+}
+
+static ALWAYS_INLINE TARGET_AVX2 __m256i madd20_avx2( __m256i x, __m256i h, __m256i l )
+{
+    return _mm256_add_epi32( _mm256_slli_epi32( _mm256_madd_epi16( x, h ), 8 ), _mm256_madd_epi16( x, l ) );
+}
+
+static ALWAYS_INLINE TARGET_AVX2 __m256i rgb_dot4_avx2( __m256i lo, __m256i hi, __m256i h, __m256i l, __m256i add, int i_shift )
+{
+    return _mm256_srai_epi32( _mm256_add_epi32( _mm256_hadd_epi32( madd20_avx2( lo, h, l ), madd20_avx2( hi, h, l ) ), add ), i_shift );
+}
+
+static ALWAYS_INLINE TARGET_AVX2 __m256i rgb_sum2x2_avx2( __m256i al, __m256i ah, __m256i bl, __m256i bh )
+{
+    __m256i s = _mm256_add_epi16( al, bl );
+    __m256i t = _mm256_add_epi16( ah, bh );
+    return _mm256_add_epi16( _mm256_unpacklo_epi64( s, t ), _mm256_unpackhi_epi64( s, t ) );
+}
+
+/* Convert 16x2 pixels: a0/a1 - top row pixels 0-7/8-15, b0/b1 - bottom row.
+ * All arithmetic is done within 128-bit lanes, the results are reordered before storing. */
+static ALWAYS_INLINE TARGET_AVX2 void rgb_to_420_core_avx2( const rgb_coefs_t *k, __m256i a0, __m256i a1, __m256i b0, __m256i b1,
+                                                            uint8_t *yy, int i_y, uint8_t *uu, uint8_t *vv, int b_nv12 )
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i yh   = _mm256_setr_epi16( Y_COEFS( COEF_H, k ), Y_COEFS( COEF_H, k ) );
+    const __m256i yl   = _mm256_setr_epi16( Y_COEFS( COEF_L, k ), Y_COEFS( COEF_L, k ) );
+    const __m256i uh   = _mm256_setr_epi16( U_COEFS( COEF_H, NEG_H, k ), U_COEFS( COEF_H, NEG_H, k ) );
+    const __m256i ul   = _mm256_setr_epi16( U_COEFS( COEF_L, NEG_L, k ), U_COEFS( COEF_L, NEG_L, k ) );
+    const __m256i vh   = _mm256_setr_epi16( V_COEFS( COEF_H, NEG_H, k ), V_COEFS( COEF_H, NEG_H, k ) );
+    const __m256i vl   = _mm256_setr_epi16( V_COEFS( COEF_L, NEG_L, k ), V_COEFS( COEF_L, NEG_L, k ) );
+    const __m256i yadd = _mm256_set1_epi32( k->y_add );
+    const __m256i uadd = _mm256_set1_epi32( k->u_add );
+    const __m256i vadd = _mm256_set1_epi32( k->v_add );
+    const __m256i perm_y  = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+    const __m256i perm_uv = _mm256_setr_epi32( 0, 1, 4, 5, 2, 3, 6, 7 );
+    __m256i a0l = _mm256_unpacklo_epi8( a0, zero ), a0h = _mm256_unpackhi_epi8( a0, zero );
+    __m256i a1l = _mm256_unpacklo_epi8( a1, zero ), a1h = _mm256_unpackhi_epi8( a1, zero );
+    __m256i b0l = _mm256_unpacklo_epi8( b0, zero ), b0h = _mm256_unpackhi_epi8( b0, zero );
+    __m256i b1l = _mm256_unpacklo_epi8( b1, zero ), b1h = _mm256_unpackhi_epi8( b1, zero );
+    __m256i y, c0, c1, u, v;
+    __m128i uv;
+
+    /* Luma: lanes hold top/bottom dwords of pixels [0-3,8-11 | 4-7,12-15] after packing */
+    y = _mm256_packus_epi16( _mm256_packs_epi32( rgb_dot4_avx2( a0l, a0h, yh, yl, yadd, BITS ),
+                                                 rgb_dot4_avx2( a1l, a1h, yh, yl, yadd, BITS ) ),
+                             _mm256_packs_epi32( rgb_dot4_avx2( b0l, b0h, yh, yl, yadd, BITS ),
+                                                 rgb_dot4_avx2( b1l, b1h, yh, yl, yadd, BITS ) ) );
+    y = _mm256_permutevar8x32_epi32( y, perm_y );
+    _mm_storeu_si128( (__m128i *)yy, _mm256_castsi256_si128( y ) );
+    _mm_storeu_si128( (__m128i *)(yy + i_y), _mm256_extracti128_si256( y, 1 ) );
+
+    /* Chroma: samples come out as [0,1,4,5 | 2,3,6,7] */
+    c0 = rgb_sum2x2_avx2( a0l, a0h, b0l, b0h );
+    c1 = rgb_sum2x2_avx2( a1l, a1h, b1l, b1h );
+    u = _mm256_permutevar8x32_epi32( rgb_dot4_avx2( c0, c1, uh, ul, uadd, BITS+2 ), perm_uv );
+    v = _mm256_permutevar8x32_epi32( rgb_dot4_avx2( c0, c1, vh, vl, vadd, BITS+2 ), perm_uv );
+    uv = _mm_packus_epi16( _mm_packs_epi32( _mm256_castsi256_si128( u ), _mm256_extracti128_si256( u, 1 ) ),
+                           _mm_packs_epi32( _mm256_castsi256_si128( v ), _mm256_extracti128_si256( v, 1 ) ) );
+    if( b_nv12 )
+        _mm_storeu_si128( (__m128i *)uu, _mm_unpacklo_epi8( uv, _mm_srli_si128( uv, 8 ) ) );
+    else
+    {
+        _mm_storel_epi64( (__m128i *)uu, uv );
+        _mm_storel_epi64( (__m128i *)vv, _mm_srli_si128( uv, 8 ) );
+    }
+}
+
+/* 24-bit loaders read a few bytes past the last pixel */
+static ALWAYS_INLINE TARGET_SSE2 __m128i load_bgr4_sse2( uint8_t *p )
+{
+    return _mm_setr_epi32( *(int32_t *)p, *(int32_t *)(p + 3), *(int32_t *)(p + 6), *(int32_t *)(p + 9) );
+}
+
+static ALWAYS_INLINE TARGET_SSE2 __m128i load_bgra4_sse2( uint8_t *p )
+{
+    return _mm_loadu_si128( (__m128i *)p );
+}
+
+static ALWAYS_INLINE TARGET_SSSE3 __m128i load_bgr4_ssse3( uint8_t *p )
+{
+    return _mm_shuffle_epi8( _mm_loadu_si128( (__m128i *)p ),
+                             _mm_setr_epi8( 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 ) );
+}
+
+static ALWAYS_INLINE TARGET_AVX2 __m256i load_bgr8_avx2( uint8_t *p )
+{
+    __m256i x = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (__m128i *)p ) ),
+                                         _mm_loadu_si128( (__m128i *)(p + 12) ), 1 );
+    return _mm256_shuffle_epi8( x, _mm256_setr_epi8( 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                                     0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 ) );
+}
+
+static ALWAYS_INLINE TARGET_AVX2 __m256i load_bgra8_avx2( uint8_t *p )
+{
+    return _mm256_loadu_si256( (__m256i *)p );
+}
+
+#define RGB_BLOCK( name, cpu, target, core, load, i_half, b_nv12 )                         \
+static ALWAYS_INLINE target void name##_block_##cpu( const rgb_coefs_t *k,                 \
+                                                     uint8_t *ss, int i_src,               \
+                                                     uint8_t *yy, int i_y,                 \
+                                                     uint8_t *uu, uint8_t *vv )            \
+{                                                                                          \
+    core( k, load( ss ), load( ss + i_half ), load( ss + i_src ), load( ss + i_src + i_half ), \
+          yy, i_y, uu, vv, b_nv12 );                                                       \
+}
+
+#define RGB_BLOCK_ALL( dst, b_nv12 )                                                                   \
+RGB_BLOCK(  bgr_to_##dst, sse2,  TARGET_SSE2,  rgb_to_420_core_sse2, load_bgr4_sse2,  12, b_nv12 )    \
+RGB_BLOCK( bgra_to_##dst, sse2,  TARGET_SSE2,  rgb_to_420_core_sse2, load_bgra4_sse2, 16, b_nv12 )    \
+RGB_BLOCK(  bgr_to_##dst, ssse3, TARGET_SSSE3, rgb_to_420_core_sse2, load_bgr4_ssse3, 12, b_nv12 )    \
+RGB_BLOCK(  bgr_to_##dst, avx2,  TARGET_AVX2,  rgb_to_420_core_avx2, load_bgr8_avx2,  24, b_nv12 )    \
+RGB_BLOCK( bgra_to_##dst, avx2,  TARGET_AVX2,  rgb_to_420_core_avx2, load_bgra8_avx2, 32, b_nv12 )
+
+RGB_BLOCK_ALL( i420, 0 )
+RGB_BLOCK_ALL( nv12, 1 )
+
+/* SIMD blocks of i_step pixels followed by the C code for the rest of the row.
+ * 24-bit input keeps 2 pixels of margin at the end of the row for the overreading loads. */
+#define RGB_TO_420_SIMD( name, S_RGB, rec, scale, cpu, target, i_step, C_STEP )                   \
+static target int name##_##rec##_##scale##_##cpu( x264_image_t *img_dst, x264_image_t *img_src,   \
+                                                  int i_width, int i_height, int i_y0, int i_y1 ) \
+{                                                                                                 \
+    uint8_t *src = img_src->plane[0];                                                             \
+    int     i_src= img_src->i_stride[0];                                                          \
+    int     i_y  = img_dst->i_stride[0];                                                          \
+    uint8_t *y   = img_dst->plane[0] + i_y0 * img_dst->i_stride[0];                               \
+    uint8_t *u   = img_dst->plane[1] + i_y0 / 2 * img_dst->i_stride[1];                           \
+    uint8_t *v   = C_STEP == 2 ? u + 1                                                            \
+                                : img_dst->plane[2] + i_y0 / 2 * img_dst->i_stride[2];            \
+    int     i_v  = img_dst->i_stride[C_STEP == 2 ? 1 : 2];                                        \
+    int     i_simd = X264_MAX( i_width - (S_RGB == 3 ? 2 : 0), 0 ) / i_step * i_step;            \
+                                                                                                  \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                                                      \
+        src = plane_vflip( src, &i_src, i_height );                                               \
+    src += i_y0 * i_src;                                                                          \
+                                                                                                  \
+    for( i_height = i_y1 - i_y0; i_height > 0; i_height -= 2 )                                    \
+    {                                                                                             \
+        int x;                                                                                    \
+        for( x = 0; x < i_simd; x += i_step )                                                     \
+            name##_block_##cpu( &rgb_coefs_##rec##_##scale, src + x * S_RGB, i_src,               \
+                                y + x, i_y, u + x / 2 * C_STEP, v + x / 2 * C_STEP );             \
+        rgb_to_420_row( &rgb_coefs_##rec##_##scale, 2, 1, 0, S_RGB, 0,                            \
+                        y + i_simd, i_y, u + i_simd / 2 * C_STEP, v + i_simd / 2 * C_STEP, C_STEP, \
+                        src + i_simd * S_RGB, i_src, i_width - i_simd );                          \
+        src += 2*i_src;                                                                           \
+        y += 2*img_dst->i_stride[0];                                                              \
+        u += img_dst->i_stride[1];                                                                \
+        v += i_v;                                                                                 \
+    }                                                                                             \
+    return 0;                                                                                     \
+}
+
+#define RGB_TO_420_SIMD_ALL( dst, rec, scale, C_STEP )                                  \
+RGB_TO_420_SIMD(  bgr_to_##dst, 3, rec, scale, sse2,  TARGET_SSE2,   8, C_STEP )        \
+RGB_TO_420_SIMD( bgra_to_##dst, 4, rec, scale, sse2,  TARGET_SSE2,   8, C_STEP )        \
+RGB_TO_420_SIMD(  bgr_to_##dst, 3, rec, scale, ssse3, TARGET_SSSE3,  8, C_STEP )        \
+RGB_TO_420_SIMD(  bgr_to_##dst, 3, rec, scale, avx2,  TARGET_AVX2,  16, C_STEP )        \
+RGB_TO_420_SIMD( bgra_to_##dst, 4, rec, scale, avx2,  TARGET_AVX2,  16, C_STEP )
+
+RGB_TO_420_SIMD_ALL( i420, 601, tv, 1 )
+RGB_TO_420_SIMD_ALL( i420, 601, pc, 1 )
+RGB_TO_420_SIMD_ALL( i420, 709, tv, 1 )
+RGB_TO_420_SIMD_ALL( i420, 709, pc, 1 )
+RGB_TO_420_SIMD_ALL( nv12, 601, tv, 2 )
+RGB_TO_420_SIMD_ALL( nv12, 601, pc, 2 )
+RGB_TO_420_SIMD_ALL( nv12, 709, tv, 2 )
+RGB_TO_420_SIMD_ALL( nv12, 709, pc, 2 )
+
+/* Convert a row of 8 pixels: a0/a1 - pixels 0-3/4-7.
+ * 4:2:2 chroma sums every horizontal pair with itself and 4:4:4 chroma scales single pixels by 4
+ * so both match the 2x2 sums the coefficients are made for. */
+static ALWAYS_INLINE TARGET_SSE2 void rgb_to_4xx_core_sse2( const rgb_coefs_t *k, __m128i a0, __m128i a1,
+                                                            uint8_t *yy, uint8_t *uu, uint8_t *vv, int b_422 )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i yh   = _mm_setr_epi16( Y_COEFS( COEF_H, k ) );
+    const __m128i yl   = _mm_setr_epi16( Y_COEFS( COEF_L, k ) );
+    const __m128i uh   = _mm_setr_epi16( U_COEFS( COEF_H, NEG_H, k ) );
+    const __m128i ul   = _mm_setr_epi16( U_COEFS( COEF_L, NEG_L, k ) );
+    const __m128i vh   = _mm_setr_epi16( V_COEFS( COEF_H, NEG_H, k ) );
+    const __m128i vl   = _mm_setr_epi16( V_COEFS( COEF_L, NEG_L, k ) );
+    const __m128i yadd = _mm_set1_epi32( k->y_add );
+    const __m128i uadd = _mm_set1_epi32( k->u_add );
+    const __m128i vadd = _mm_set1_epi32( k->v_add );
+    __m128i a0l = _mm_unpacklo_epi8( a0, zero ), a0h = _mm_unpackhi_epi8( a0, zero );
+    __m128i a1l = _mm_unpacklo_epi8( a1, zero ), a1h = _mm_unpackhi_epi8( a1, zero );
+    __m128i y, c0, c1, u, v;
+
+    /* Luma */
+    y = _mm_packus_epi16( _mm_packs_epi32( rgb_dot4_sse2( a0l, a0h, yh, yl, yadd, BITS ),
+                                           rgb_dot4_sse2( a1l, a1h, yh, yl, yadd, BITS ) ), zero );
+    _mm_storel_epi64( (__m128i *)yy, y );
+
+    /* Chroma */
+    if( b_422 )
+    {
+        c0 = rgb_sum2x2_sse2( a0l, a0h, a0l, a0h );
+        c1 = rgb_sum2x2_sse2( a1l, a1h, a1l, a1h );
+        u = rgb_dot4_sse2( c0, c1, uh, ul, uadd, BITS+2 );
+        v = rgb_dot4_sse2( c0, c1, vh, vl, vadd, BITS+2 );
+        u = _mm_packus_epi16( _mm_packs_epi32( u, v ), zero );
+        *(uint32_t *)uu = _mm_cvtsi128_si32( u );
+        *(uint32_t *)vv = _mm_cvtsi128_si32( _mm_srli_si128( u, 4 ) );
+    }
+    else
+    {
+        a0l = _mm_slli_epi16( a0l, 2 );
+        a0h = _mm_slli_epi16( a0h, 2 );
+        a1l = _mm_slli_epi16( a1l, 2 );
+        a1h = _mm_slli_epi16( a1h, 2 );
+        u = _mm_packs_epi32( rgb_dot4_sse2( a0l, a0h, uh, ul, uadd, BITS+2 ),
+                             rgb_dot4_sse2( a1l, a1h, uh, ul, uadd, BITS+2 ) );
+        v = _mm_packs_epi32( rgb_dot4_sse2( a0l, a0h, vh, vl, vadd, BITS+2 ),
+                             rgb_dot4_sse2( a1l, a1h, vh, vl, vadd, BITS+2 ) );
+        u = _mm_packus_epi16( u, v );
+        _mm_storel_epi64( (__m128i *)uu, u );
+        _mm_storel_epi64( (__m128i *)vv, _mm_srli_si128( u, 8 ) );
+    }
+}
+
+/* Convert a row of 16 pixels: a0/a1 - pixels 0-7/8-15 */
+static ALWAYS_INLINE TARGET_AVX2 void rgb_to_4xx_core_avx2( const rgb_coefs_t *k, __m256i a0, __m256i a1,
+                                                            uint8_t *yy, uint8_t *uu, uint8_t *vv, int b_422 )
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i yh   = _mm256_setr_epi16( Y_COEFS( COEF_H, k ), Y_COEFS( COEF_H, k ) );
+    const __m256i yl   = _mm256_setr_epi16( Y_COEFS( COEF_L, k ), Y_COEFS( COEF_L, k ) );
+    const __m256i uh   = _mm256_setr_epi16( U_COEFS( COEF_H, NEG_H, k ), U_COEFS( COEF_H, NEG_H, k ) );
+    const __m256i ul   = _mm256_setr_epi16( U_COEFS( COEF_L, NEG_L, k ), U_COEFS( COEF_L, NEG_L, k ) );
+    const __m256i vh   = _mm256_setr_epi16( V_COEFS( COEF_H, NEG_H, k ), V_COEFS( COEF_H, NEG_H, k ) );
+    const __m256i vl   = _mm256_setr_epi16( V_COEFS( COEF_L, NEG_L, k ), V_COEFS( COEF_L, NEG_L, k ) );
+    const __m256i yadd = _mm256_set1_epi32( k->y_add );
+    const __m256i uadd = _mm256_set1_epi32( k->u_add );
+    const __m256i vadd = _mm256_set1_epi32( k->v_add );
+    const __m256i perm_y  = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+    const __m256i perm_uv = _mm256_setr_epi32( 0, 1, 4, 5, 2, 3, 6, 7 );
+    __m256i a0l = _mm256_unpacklo_epi8( a0, zero ), a0h = _mm256_unpackhi_epi8( a0, zero );
+    __m256i a1l = _mm256_unpacklo_epi8( a1, zero ), a1h = _mm256_unpackhi_epi8( a1, zero );
+    __m256i y, c0, c1, u, v;
+    __m128i uv;
+
+    /* Luma: lanes hold dwords of pixels [0-3,8-11 | 4-7,12-15] after packing */
+    y = _mm256_packus_epi16( _mm256_packs_epi32( rgb_dot4_avx2( a0l, a0h, yh, yl, yadd, BITS ),
+                                                 rgb_dot4_avx2( a1l, a1h, yh, yl, yadd, BITS ) ), zero );
+    y = _mm256_permutevar8x32_epi32( y, perm_y );
+    _mm_storeu_si128( (__m128i *)yy, _mm256_castsi256_si128( y ) );
+
+    /* Chroma: 4:2:2 samples come out as [0,1,4,5 | 2,3,6,7], 4:4:4 ones are ordered as luma */
+    if( b_422 )
+    {
+        c0 = rgb_sum2x2_avx2( a0l, a0h, a0l, a0h );
+        c1 = rgb_sum2x2_avx2( a1l, a1h, a1l, a1h );
+        u = _mm256_permutevar8x32_epi32( rgb_dot4_avx2( c0, c1, uh, ul, uadd, BITS+2 ), perm_uv );
+        v = _mm256_permutevar8x32_epi32( rgb_dot4_avx2( c0, c1, vh, vl, vadd, BITS+2 ), perm_uv );
+        uv = _mm_packus_epi16( _mm_packs_epi32( _mm256_castsi256_si128( u ), _mm256_extracti128_si256( u, 1 ) ),
+                               _mm_packs_epi32( _mm256_castsi256_si128( v ), _mm256_extracti128_si256( v, 1 ) ) );
+        _mm_storel_epi64( (__m128i *)uu, uv );
+        _mm_storel_epi64( (__m128i *)vv, _mm_srli_si128( uv, 8 ) );
+    }
+    else
+    {
+        a0l = _mm256_slli_epi16( a0l, 2 );
+        a0h = _mm256_slli_epi16( a0h, 2 );
+        a1l = _mm256_slli_epi16( a1l, 2 );
+        a1h = _mm256_slli_epi16( a1h, 2 );
+        u = _mm256_packs_epi32( rgb_dot4_avx2( a0l, a0h, uh, ul, uadd, BITS+2 ),
+                                rgb_dot4_avx2( a1l, a1h, uh, ul, uadd, BITS+2 ) );
+        v = _mm256_packs_epi32( rgb_dot4_avx2( a0l, a0h, vh, vl, vadd, BITS+2 ),
+                                rgb_dot4_avx2( a1l, a1h, vh, vl, vadd, BITS+2 ) );
+        u = _mm256_permutevar8x32_epi32( _mm256_packus_epi16( u, v ), perm_y );
+        _mm_storeu_si128( (__m128i *)uu, _mm256_castsi256_si128( u ) );
+        _mm_storeu_si128( (__m128i *)vv, _mm256_extracti128_si256( u, 1 ) );
+    }
+}
+
+/* B_422 - 0 for I444 output, 1 for I422 output */
+#define RGB_TO_4XX_SIMD( name, S_RGB, rec, scale, cpu, target, core, load, i_step, B_422 )        \
+static target int name##_##rec##_##scale##_##cpu( x264_image_t *img_dst, x264_image_t *img_src,   \
+                                                  int i_width, int i_height, int i_y0, int i_y1 ) \
+{                                                                                                 \
+    uint8_t *src = img_src->plane[0];                                                             \
+    int     i_src= img_src->i_stride[0];                                                          \
+    uint8_t *y   = img_dst->plane[0] + i_y0 * img_dst->i_stride[0];                               \
+    uint8_t *u   = img_dst->plane[1] + i_y0 * img_dst->i_stride[1];                               \
+    uint8_t *v   = img_dst->plane[2] + i_y0 * img_dst->i_stride[2];                               \
+    int     i_simd = X264_MAX( i_width - (S_RGB == 3 ? 2 : 0), 0 ) / i_step * i_step;            \
+                                                                                                  \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                                                      \
+        src = plane_vflip( src, &i_src, i_height );                                               \
+    src += i_y0 * i_src;                                                                          \
+                                                                                                  \
+    for( i_height = i_y1 - i_y0; i_height > 0; i_height-- )                                       \
+    {                                                                                             \
+        int x;                                                                                    \
+        for( x = 0; x < i_simd; x += i_step )                                                     \
+            core( &rgb_coefs_##rec##_##scale, load( src + x * S_RGB ),                            \
+                  load( src + (x + i_step / 2) * S_RGB ),                                         \
+                  y + x, u + (x >> B_422), v + (x >> B_422), B_422 );                             \
+        rgb_to_4xx_row( &rgb_coefs_##rec##_##scale, 2, 1, 0, S_RGB, 0,                            \
+                        y + i_simd, u + (i_simd >> B_422), v + (i_simd >> B_422),                 \
+                        src + i_simd * S_RGB, i_width - i_simd, B_422 );                          \
+        src += i_src;                                                                             \
+        y += img_dst->i_stride[0];                                                                \
+        u += img_dst->i_stride[1];                                                                \
+        v += img_dst->i_stride[2];                                                                \
+    }                                                                                             \
+    return 0;                                                                                     \
+}
+
+#define RGB_TO_4XX_SIMD_ALL( dst, rec, scale, B_422 )                                                                       \
+RGB_TO_4XX_SIMD(  bgr_to_##dst, 3, rec, scale, sse2,  TARGET_SSE2,  rgb_to_4xx_core_sse2, load_bgr4_sse2,   8, B_422 )  \
+RGB_TO_4XX_SIMD( bgra_to_##dst, 4, rec, scale, sse2,  TARGET_SSE2,  rgb_to_4xx_core_sse2, load_bgra4_sse2,  8, B_422 )  \
+RGB_TO_4XX_SIMD(  bgr_to_##dst, 3, rec, scale, ssse3, TARGET_SSSE3, rgb_to_4xx_core_sse2, load_bgr4_ssse3,  8, B_422 )  \
+RGB_TO_4XX_SIMD(  bgr_to_##dst, 3, rec, scale, avx2,  TARGET_AVX2,  rgb_to_4xx_core_avx2, load_bgr8_avx2,  16, B_422 )  \
+RGB_TO_4XX_SIMD( bgra_to_##dst, 4, rec, scale, avx2,  TARGET_AVX2,  rgb_to_4xx_core_avx2, load_bgra8_avx2, 16, B_422 )
+
+RGB_TO_4XX_SIMD_ALL( i444, 601, tv, 0 )
+RGB_TO_4XX_SIMD_ALL( i444, 601, pc, 0 )
+RGB_TO_4XX_SIMD_ALL( i444, 709, tv, 0 )
+RGB_TO_4XX_SIMD_ALL( i444, 709, pc, 0 )
+RGB_TO_4XX_SIMD_ALL( i422, 601, tv, 1 )
+RGB_TO_4XX_SIMD_ALL( i422, 601, pc, 1 )
+RGB_TO_4XX_SIMD_ALL( i422, 709, tv, 1 )
+RGB_TO_4XX_SIMD_ALL( i422, 709, pc, 1 )
+
+/* U/V -> NV12 chroma interleaving */
+static TARGET_SSE2 void plane_interleave_copy_sse2( uint8_t *dst, int i_dst,
+                                                    uint8_t *srcu, int i_srcu,
+                                                    uint8_t *srcv, int i_srcv, int w, int h )
+{
+    int i_simd = w & ~15;
+    for( ; h > 0; h-- )
+    {
+        int i;
+        for( i = 0; i < i_simd; i += 16 )
+        {
+            __m128i u = _mm_loadu_si128( (__m128i *)(srcu + i) );
+            __m128i v = _mm_loadu_si128( (__m128i *)(srcv + i) );
+            _mm_storeu_si128( (__m128i *)(dst + 2*i),      _mm_unpacklo_epi8( u, v ) );
+            _mm_storeu_si128( (__m128i *)(dst + 2*i + 16), _mm_unpackhi_epi8( u, v ) );
+        }
+        plane_interleave_copy( dst + 2*i_simd, i_dst, srcu + i_simd, i_srcu, srcv + i_simd, i_srcv, w - i_simd, 1 );
+        dst  += i_dst;
+        srcu += i_srcu;
+        srcv += i_srcv;
+    }
+}
+
+static TARGET_AVX2 void plane_interleave_copy_avx2( uint8_t *dst, int i_dst,
+                                                    uint8_t *srcu, int i_srcu,
+                                                    uint8_t *srcv, int i_srcv, int w, int h )
+{
+    int i_simd = w & ~31;
+    for( ; h > 0; h-- )
+    {
+        int i;
+        for( i = 0; i < i_simd; i += 32 )
+        {
+            __m256i u  = _mm256_loadu_si256( (__m256i *)(srcu + i) );
+            __m256i v  = _mm256_loadu_si256( (__m256i *)(srcv + i) );
+            __m256i lo = _mm256_unpacklo_epi8( u, v );
+            __m256i hi = _mm256_unpackhi_epi8( u, v );
+            _mm256_storeu_si256( (__m256i *)(dst + 2*i),      _mm256_permute2x128_si256( lo, hi, 0x20 ) );
+            _mm256_storeu_si256( (__m256i *)(dst + 2*i + 32), _mm256_permute2x128_si256( lo, hi, 0x31 ) );
+        }
+        plane_interleave_copy( dst + 2*i_simd, i_dst, srcu + i_simd, i_srcu, srcv + i_simd, i_srcv, w - i_simd, 1 );
+        dst  += i_dst;
+        srcu += i_srcu;
+        srcv += i_srcv;
+    }
+}
+
+YUV_TO_NV12( i420_to_nv12_sse2, copy_sse2, 0 )
+YUV_TO_NV12( yv12_to_nv12_sse2, copy_sse2, 1 )
+YUV_TO_NV12( i420_to_nv12_avx2, copy_avx2, 0 )
+YUV_TO_NV12( yv12_to_nv12_avx2, copy_avx2, 1 )
+
+/* Packed yuv 4:2:2 -> NV12: luma and chroma are the even/odd bytes (YUYV) or the other way around (UYVY),
+ * vertical chroma averaging with rounding is exactly pavgb */
+static ALWAYS_INLINE TARGET_SSE2 void yyuv_to_nv12_block_sse2( uint8_t *ss, int i_src, uint8_t *yy, int i_y, uint8_t *uv, int b_uyvy )
+{
+    const __m128i mask = _mm_set1_epi16( 0x00ff );
+    __m128i a0 = _mm_loadu_si128( (__m128i *)ss );
+    __m128i a1 = _mm_loadu_si128( (__m128i *)(ss + 16) );
+    __m128i b0 = _mm_loadu_si128( (__m128i *)(ss + i_src) );
+    __m128i b1 = _mm_loadu_si128( (__m128i *)(ss + i_src + 16) );
+    __m128i ae = _mm_packus_epi16( _mm_and_si128( a0, mask ), _mm_and_si128( a1, mask ) );
+    __m128i ao = _mm_packus_epi16( _mm_srli_epi16( a0, 8 ), _mm_srli_epi16( a1, 8 ) );
+    __m128i be = _mm_packus_epi16( _mm_and_si128( b0, mask ), _mm_and_si128( b1, mask ) );
+    __m128i bo = _mm_packus_epi16( _mm_srli_epi16( b0, 8 ), _mm_srli_epi16( b1, 8 ) );
+
+    _mm_storeu_si128( (__m128i *)yy,         b_uyvy ? ao : ae );
+    _mm_storeu_si128( (__m128i *)(yy + i_y), b_uyvy ? bo : be );
+    _mm_storeu_si128( (__m128i *)uv,         b_uyvy ? _mm_avg_epu8( ae, be ) : _mm_avg_epu8( ao, bo ) );
+}
+
+/* packus works within 128-bit lanes so the qwords are reordered after it */
+static ALWAYS_INLINE TARGET_AVX2 void yyuv_to_nv12_block_avx2( uint8_t *ss, int i_src, uint8_t *yy, int i_y, uint8_t *uv, int b_uyvy )
+{
+    const __m256i mask = _mm256_set1_epi16( 0x00ff );
+    __m256i a0 = _mm256_loadu_si256( (__m256i *)ss );
+    __m256i a1 = _mm256_loadu_si256( (__m256i *)(ss + 32) );
+    __m256i b0 = _mm256_loadu_si256( (__m256i *)(ss + i_src) );
+    __m256i b1 = _mm256_loadu_si256( (__m256i *)(ss + i_src + 32) );
+    __m256i ae = _mm256_packus_epi16( _mm256_and_si256( a0, mask ), _mm256_and_si256( a1, mask ) );
+    __m256i ao = _mm256_packus_epi16( _mm256_srli_epi16( a0, 8 ), _mm256_srli_epi16( a1, 8 ) );
+    __m256i be = _mm256_packus_epi16( _mm256_and_si256( b0, mask ), _mm256_and_si256( b1, mask ) );
+    __m256i bo = _mm256_packus_epi16( _mm256_srli_epi16( b0, 8 ), _mm256_srli_epi16( b1, 8 ) );
+
+    _mm256_storeu_si256( (__m256i *)yy,         _mm256_permute4x64_epi64( b_uyvy ? ao : ae, 0xd8 ) );
+    _mm256_storeu_si256( (__m256i *)(yy + i_y), _mm256_permute4x64_epi64( b_uyvy ? bo : be, 0xd8 ) );
+    _mm256_storeu_si256( (__m256i *)uv,         _mm256_permute4x64_epi64( b_uyvy ? _mm256_avg_epu8( ae, be )
+                                                                                 : _mm256_avg_epu8( ao, bo ), 0xd8 ) );
+}
+
+#define YYUV_TO_NV12_SIMD( name, y_pos1, y_pos2, u_pos, v_pos, cpu, target, i_step )               \
+static target int name##_##cpu( x264_image_t *img_dst, x264_image_t *img_src,                     \
+                                int i_width, int i_height, int i_y0, int i_y1 )                   \
+{                                                                                                 \
+    uint8_t *src = img_src->plane[0];                                                             \
+    int     i_src= img_src->i_stride[0];                                                          \
+    int     i_y  = img_dst->i_stride[0];                                                          \
+    uint8_t *y   = img_dst->plane[0] + i_y0 * img_dst->i_stride[0];                               \
+    uint8_t *uv  = img_dst->plane[1] + i_y0 / 2 * img_dst->i_stride[1];                           \
+    int     i_simd = i_width / i_step * i_step;                                                   \
+                                                                                                  \
+    if( img_src->i_csp & X264VFW_CSP_VFLIP )                                                      \
+        src = plane_vflip( src, &i_src, i_height );                                               \
+    src += i_y0 * i_src;                                                                          \
+                                                                                                  \
+    for( i_height = i_y1 - i_y0; i_height > 0; i_height -= 2 )                                    \
+    {                                                                                             \
+        int x;                                                                                    \
+        for( x = 0; x < i_simd; x += i_step )                                                     \
+            yyuv_to_nv12_block_##cpu( src + 2*x, i_src, y + x, i_y, uv + x, u_pos == 0 );         \
+        yyuv_to_nv12_row( y_pos1, y_pos2, u_pos, v_pos, y + i_simd, i_y, uv + i_simd,             \
+                          src + 2*i_simd, i_src, i_width - i_simd );                              \
+        src += 2*i_src;                                                                           \
+        y += 2*img_dst->i_stride[0];                                                              \
+        uv += img_dst->i_stride[1];                                                               \
+    }                                                                                             \
+    return 0;                                                                                     \
+}
+
+YYUV_TO_NV12_SIMD( yuyv_to_nv12, 0, 2, 1, 3, sse2, TARGET_SSE2, 16 )
+YYUV_TO_NV12_SIMD( uyvy_to_nv12, 1, 3, 0, 2, sse2, TARGET_SSE2, 16 )
+YYUV_TO_NV12_SIMD( yuyv_to_nv12, 0, 2, 1, 3, avx2, TARGET_AVX2, 32 )
+YYUV_TO_NV12_SIMD( uyvy_to_nv12, 1, 3, 0, 2, avx2, TARGET_AVX2, 32 )
+
+#define INIT_RGB_SIMD( dst, rec, scale )                                          \
+    if( cpu & X264_CPU_SSE2 )                                                     \
+    {                                                                             \
+        pf->convert[X264VFW_CSP_BGR ] =  bgr_to_##dst##_##rec##_##scale##_sse2;   \
+        pf->convert[X264VFW_CSP_BGRA] = bgra_to_##dst##_##rec##_##scale##_sse2;   \
+    }                                                                             \
+    if( cpu & X264_CPU_SSSE3 )                                                    \
+        pf->convert[X264VFW_CSP_BGR ] =  bgr_to_##dst##_##rec##_##scale##_ssse3;  \
+    if( cpu & X264_CPU_AVX2 )                                                     \
+    {                                                                             \
+        pf->convert[X264VFW_CSP_BGR ] =  bgr_to_##dst##_##rec##_##scale##_avx2;   \
+        pf->convert[X264VFW_CSP_BGRA] = bgra_to_##dst##_##rec##_##scale##_avx2;   \
+    }
+
+#define INIT_NV12_SIMD                                                            \
+    if( cpu & X264_CPU_SSE2 )                                                     \
+    {                                                                             \
+        pf->convert[X264VFW_CSP_I420] = i420_to_nv12_sse2;                        \
+        pf->convert[X264VFW_CSP_YV12] = yv12_to_nv12_sse2;                        \
+        pf->convert[X264VFW_CSP_YUYV] = yuyv_to_nv12_sse2;                        \
+        pf->convert[X264VFW_CSP_UYVY] = uyvy_to_nv12_sse2;                        \
+    }                                                                             \
+    if( cpu & X264_CPU_AVX2 )                                                     \
+    {                                                                             \
+        pf->convert[X264VFW_CSP_I420] = i420_to_nv12_avx2;                        \
+        pf->convert[X264VFW_CSP_YV12] = yv12_to_nv12_avx2;                        \
+        pf->convert[X264VFW_CSP_YUYV] = yuyv_to_nv12_avx2;                        \
+        pf->convert[X264VFW_CSP_UYVY] = uyvy_to_nv12_avx2;                        \
+    }
+#else
+#define INIT_RGB_SIMD( dst, rec, scale )
+#define INIT_NV12_SIMD
+#endif
+
+#if HAVE_X86_SIMD
+/* SIMD versions of the 16-bit source (P010/P210) plane functions, msb aligned samples
+ * are rounded to the output bit depth like PIXEL16 (the saturating add clamps the maximum) */
+static ALWAYS_INLINE TARGET_SSE2 void store_pixel8_sse2( pixel *dst, __m128i a )
+{
+    a = _mm_srli_epi16( _mm_adds_epu16( a, _mm_set1_epi16( PIXEL_ROUND16 ) ), PIXEL_SHIFT16 );
+#if X264_BIT_DEPTH > 8
+    _mm_storeu_si128( (__m128i *)dst, a );
+#else
+    _mm_storel_epi64( (__m128i *)dst, _mm_packus_epi16( a, _mm_setzero_si128() ) );
+#endif
+}
+
+static ALWAYS_INLINE TARGET_AVX2 void store_pixel16_avx2( pixel *dst, __m256i a )
+{
+    a = _mm256_srli_epi16( _mm256_adds_epu16( a, _mm256_set1_epi16( PIXEL_ROUND16 ) ), PIXEL_SHIFT16 );
+#if X264_BIT_DEPTH > 8
+    _mm256_storeu_si256( (__m256i *)dst, a );
+#else
+    a = _mm256_packus_epi16( a, _mm256_setzero_si256() );
+    _mm_storeu_si128( (__m128i *)dst, _mm256_castsi256_si128( _mm256_permute4x64_epi64( a, 0xd8 ) ) );
+#endif
+}
+
+/* Even and odd 16-bit words of a and b, packs is exact for the sign extended words */
+static ALWAYS_INLINE TARGET_SSE2 void deinterleave16_sse2( __m128i a, __m128i b, __m128i *even, __m128i *odd )
+{
+    *even = _mm_packs_epi32( _mm_srai_epi32( _mm_slli_epi32( a, 16 ), 16 ), _mm_srai_epi32( _mm_slli_epi32( b, 16 ), 16 ) );
+    *odd  = _mm_packs_epi32( _mm_srai_epi32( a, 16 ), _mm_srai_epi32( b, 16 ) );
+}
+
+static ALWAYS_INLINE TARGET_AVX2 void deinterleave16_avx2( __m256i a, __m256i b, __m256i *even, __m256i *odd )
+{
+    *even = _mm256_packs_epi32( _mm256_srai_epi32( _mm256_slli_epi32( a, 16 ), 16 ), _mm256_srai_epi32( _mm256_slli_epi32( b, 16 ), 16 ) );
+    *odd  = _mm256_packs_epi32( _mm256_srai_epi32( a, 16 ), _mm256_srai_epi32( b, 16 ) );
+    *even = _mm256_permute4x64_epi64( *even, 0xd8 );
+    *odd  = _mm256_permute4x64_epi64( *odd,  0xd8 );
+}
+
+#define LOAD16_SSE2( p ) _mm_loadu_si128( (__m128i *)(p) )
+#define LOAD16_AVX2( p ) _mm256_loadu_si256( (__m256i *)(p) )
+
+static TARGET_SSE2 void plane_copy16_sse2( uint8_t *dst, int i_dst,
+                                           uint8_t *src, int i_src, int w, int h )
+{
+    int i_simd = w & ~7;
+    for( ; h > 0; h-- )
+    {
+        pixel    *d = (pixel *)dst;
+        uint16_t *s = (uint16_t *)src;
+        int      i;
+        for( i = 0; i < i_simd; i += 8 )
+            store_pixel8_sse2( d + i, LOAD16_SSE2( s + i ) );
+        plane_copy16( (uint8_t *)(d + i_simd), i_dst, (uint8_t *)(s + i_simd), i_src, w - i_simd, 1 );
+        dst += i_dst;
+        src += i_src;
+    }
+}
+
+static TARGET_AVX2 void plane_copy16_avx2( uint8_t *dst, int i_dst,
+                                           uint8_t *src, int i_src, int w, int h )
+{
+    int i_simd = w & ~15;
+    for( ; h > 0; h-- )
+    {
+        pixel    *d = (pixel *)dst;
+        uint16_t *s = (uint16_t *)src;
+        int      i;
+        for( i = 0; i < i_simd; i += 16 )
+            store_pixel16_avx2( d + i, LOAD16_AVX2( s + i ) );
+        plane_copy16( (uint8_t *)(d + i_simd), i_dst, (uint8_t *)(s + i_simd), i_src, w - i_simd, 1 );
+        dst += i_dst;
+        src += i_src;
+    }
+}
+
+/* pavgw rounds exactly like the C version */
+static TARGET_SSE2 void plane_subsamplev2_16_sse2( uint8_t *dst, int i_dst,
+                                                   uint8_t *src, int i_src, int w, int h )
+{
+    int i_simd = w & ~7;
+    for( ; h > 0; h-- )
+    {
+        pixel    *d  = (pixel *)dst;
+        uint16_t *s0 = (uint16_t *)src;
+        uint16_t *s1 = (uint16_t *)(src + i_src);
+        int      i;
+        for( i = 0; i < i_simd; i += 8 )
+            store_pixel8_sse2( d + i, _mm_avg_epu16( LOAD16_SSE2( s0 + i ), LOAD16_SSE2( s1 + i ) ) );
+        plane_subsamplev2_16( (uint8_t *)(d + i_simd), i_dst, (uint8_t *)(s0 + i_simd), i_src, w - i_simd, 1 );
+        dst += i_dst;
+        src += 2 * i_src;
+    }
+}
+
+static TARGET_AVX2 void plane_subsamplev2_16_avx2( uint8_t *dst, int i_dst,
+                                                   uint8_t *src, int i_src, int w, int h )
+{
+    int i_simd = w & ~15;
+    for( ; h > 0; h-- )
+    {
+        pixel    *d  = (pixel *)dst;
+        uint16_t *s0 = (uint16_t *)src;
+        uint16_t *s1 = (uint16_t *)(src + i_src);
+        int      i;
+        for( i = 0; i < i_simd; i += 16 )
+            store_pixel16_avx2( d + i, _mm256_avg_epu16( LOAD16_AVX2( s0 + i ), LOAD16_AVX2( s1 + i ) ) );
+        plane_subsamplev2_16( (uint8_t *)(d + i_simd), i_dst, (uint8_t *)(s0 + i_simd), i_src, w - i_simd, 1 );
+        dst += i_dst;
+        src += 2 * i_src;
+    }
+}
+
+static TARGET_SSE2 void plane_deinterleave16_sse2( uint8_t *dstu, int i_dstu,
+                                                   uint8_t *dstv, int i_dstv,
+                                                   uint8_t *src, int i_src, int w, int h )
+{
+    int i_simd = w & ~7;
+    for( ; h > 0; h-- )
+    {
+        pixel    *du = (pixel *)dstu;
+        pixel    *dv = (pixel *)dstv;
+        uint16_t *s  = (uint16_t *)src;
+        int      i;
+        for( i = 0; i < i_simd; i += 8 )
+        {
+            __m128i u, v;
+            deinterleave16_sse2( LOAD16_SSE2( s + 2*i ), LOAD16_SSE2( s + 2*i + 8 ), &u, &v );
+            store_pixel8_sse2( du + i, u );
+            store_pixel8_sse2( dv + i, v );
+        }
+        plane_deinterleave16( (uint8_t *)(du + i_simd), i_dstu, (uint8_t *)(dv + i_simd), i_dstv,
+                              (uint8_t *)(s + 2*i_simd), i_src, w - i_simd, 1 );
+        dstu += i_dstu;
+        dstv += i_dstv;
+        src  += i_src;
+    }
+}
+
+static TARGET_AVX2 void plane_deinterleave16_avx2( uint8_t *dstu, int i_dstu,
+                                                   uint8_t *dstv, int i_dstv,
+                                                   uint8_t *src, int i_src, int w, int h )
+{
+    int i_simd = w & ~15;
+    for( ; h > 0; h-- )
+    {
+        pixel    *du = (pixel *)dstu;
+        pixel    *dv = (pixel *)dstv;
+        uint16_t *s  = (uint16_t *)src;
+        int      i;
+        for( i = 0; i < i_simd; i += 16 )
+        {
+            __m256i u, v;
+            deinterleave16_avx2( LOAD16_AVX2( s + 2*i ), LOAD16_AVX2( s + 2*i + 16 ), &u, &v );
+            store_pixel16_avx2( du + i, u );
+            store_pixel16_avx2( dv + i, v );
+        }
+        plane_deinterleave16( (uint8_t *)(du + i_simd), i_dstu, (uint8_t *)(dv + i_simd), i_dstv,
+                              (uint8_t *)(s + 2*i_simd), i_src, w - i_simd, 1 );
+        dstu += i_dstu;
+        dstv += i_dstv;
+        src  += i_src;
+    }
+}
+
+static TARGET_SSE2 void plane_deinterleave_subsamplev2_16_sse2( uint8_t *dstu, int i_dstu,
+                                                                uint8_t *dstv, int i_dstv,
+                                                                uint8_t *src, int i_src, int w, int h )
+{
+    int i_simd = w & ~7;
+    for( ; h > 0; h-- )
+    {
+        pixel    *du = (pixel *)dstu;
+        pixel    *dv = (pixel *)dstv;
+        uint16_t *s0 = (uint16_t *)src;
+        uint16_t *s1 = (uint16_t *)(src + i_src);
+        int      i;
+        for( i = 0; i < i_simd; i += 8 )
+        {
+            __m128i u, v;
+            deinterleave16_sse2( _mm_avg_epu16( LOAD16_SSE2( s0 + 2*i ),     LOAD16_SSE2( s1 + 2*i ) ),
+                                 _mm_avg_epu16( LOAD16_SSE2( s0 + 2*i + 8 ), LOAD16_SSE2( s1 + 2*i + 8 ) ), &u, &v );
+            store_pixel8_sse2( du + i, u );
+            store_pixel8_sse2( dv + i, v );
+        }
+        plane_deinterleave_subsamplev2_16( (uint8_t *)(du + i_simd), i_dstu, (uint8_t *)(dv + i_simd), i_dstv,
+                                           (uint8_t *)(s0 + 2*i_simd), i_src, w - i_simd, 1 );
+        dstu += i_dstu;
+        dstv += i_dstv;
+        src  += 2 * i_src;
+    }
+}
+
+static TARGET_AVX2 void plane_deinterleave_subsamplev2_16_avx2( uint8_t *dstu, int i_dstu,
+                                                                uint8_t *dstv, int i_dstv,
+                                                                uint8_t *src, int i_src, int w, int h )
+{
+    int i_simd = w & ~15;
+    for( ; h > 0; h-- )
+    {
+        pixel    *du = (pixel *)dstu;
+        pixel    *dv = (pixel *)dstv;
+        uint16_t *s0 = (uint16_t *)src;
+        uint16_t *s1 = (uint16_t *)(src + i_src);
+        int      i;
+        for( i = 0; i < i_simd; i += 16 )
+        {
+            __m256i u, v;
+            deinterleave16_avx2( _mm256_avg_epu16( LOAD16_AVX2( s0 + 2*i ),      LOAD16_AVX2( s1 + 2*i ) ),
+                                 _mm256_avg_epu16( LOAD16_AVX2( s0 + 2*i + 16 ), LOAD16_AVX2( s1 + 2*i + 16 ) ), &u, &v );
+            store_pixel16_avx2( du + i, u );
+            store_pixel16_avx2( dv + i, v );
+        }
+        plane_deinterleave_subsamplev2_16( (uint8_t *)(du + i_simd), i_dstu, (uint8_t *)(dv + i_simd), i_dstv,
+                                           (uint8_t *)(s0 + 2*i_simd), i_src, w - i_simd, 1 );
+        dstu += i_dstu;
+        dstv += i_dstv;
+        src  += 2 * i_src;
+    }
+}
+
+PX10_TO_NV12( p010_to_nv12_sse2, copy16_sse2, copy16_sse2,                      1 )
+PX10_TO_NV12( p210_to_nv12_sse2, copy16_sse2, subsamplev2_16_sse2,              1 )
+PX10_TO_YUV(  p010_to_i420_sse2, copy16_sse2, deinterleave16_sse2,              1 )
+PX10_TO_YUV(  p210_to_i420_sse2, copy16_sse2, deinterleave_subsamplev2_16_sse2, 1 )
+PX10_TO_YUV(  p210_to_i422_sse2, copy16_sse2, deinterleave16_sse2,              0 )
+PX10_TO_NV12( p010_to_nv12_avx2, copy16_avx2, copy16_avx2,                      1 )
+PX10_TO_NV12( p210_to_nv12_avx2, copy16_avx2, subsamplev2_16_avx2,              1 )
+PX10_TO_YUV(  p010_to_i420_avx2, copy16_avx2, deinterleave16_avx2,              1 )
+PX10_TO_YUV(  p210_to_i420_avx2, copy16_avx2, deinterleave_subsamplev2_16_avx2, 1 )
+PX10_TO_YUV(  p210_to_i422_avx2, copy16_avx2, deinterleave16_avx2,              0 )
+
+#if X264_BIT_DEPTH > 8
+/* 8-bit -> 16-bit widening copies for the planar and NV12 inputs */
+static TARGET_SSE2 void plane_copy_sse2( uint8_t *dst, int i_dst,
+                                         uint8_t *src, int i_src, int w, int h )
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i_simd = w & ~15;
+    for( ; h > 0; h-- )
+    {
+        pixel *d = (pixel *)dst;
+        int   i;
+        for( i = 0; i < i_simd; i += 16 )
+        {
+            __m128i s = _mm_loadu_si128( (__m128i *)(src + i) );
+            _mm_storeu_si128( (__m128i *)(d + i),     _mm_slli_epi16( _mm_unpacklo_epi8( s, zero ), PIXEL_SHIFT8 ) );
+            _mm_storeu_si128( (__m128i *)(d + i + 8), _mm_slli_epi16( _mm_unpackhi_epi8( s, zero ), PIXEL_SHIFT8 ) );
+        }
+        plane_copy( (uint8_t *)(d + i_simd), i_dst, src + i_simd, i_src, w - i_simd, 1 );
+        dst += i_dst;
+        src += i_src;
+    }
+}
+
+static TARGET_AVX2 void plane_copy_avx2( uint8_t *dst, int i_dst,
+                                         uint8_t *src, int i_src, int w, int h )
+{
+    int i_simd = w & ~31;
+    for( ; h > 0; h-- )
+    {
+        pixel *d = (pixel *)dst;
+        int   i;
+        for( i = 0; i < i_simd; i += 32 )
+        {
+            __m256i lo = _mm256_cvtepu8_epi16( _mm_loadu_si128( (__m128i *)(src + i) ) );
+            __m256i hi = _mm256_cvtepu8_epi16( _mm_loadu_si128( (__m128i *)(src + i + 16) ) );
+            _mm256_storeu_si256( (__m256i *)(d + i),      _mm256_slli_epi16( lo, PIXEL_SHIFT8 ) );
+            _mm256_storeu_si256( (__m256i *)(d + i + 16), _mm256_slli_epi16( hi, PIXEL_SHIFT8 ) );
+        }
+        plane_copy( (uint8_t *)(d + i_simd), i_dst, src + i_simd, i_src, w - i_simd, 1 );
+        dst += i_dst;
+        src += i_src;
+    }
+}
+
+YUV_TO_YUV( i420_to_i420_sse2, copy_sse2, copy_sse2, 0, 1, 1 )
+YUV_TO_YUV( i422_to_i422_sse2, copy_sse2, copy_sse2, 0, 1, 0 )
+YUV_TO_YUV( i444_to_i444_sse2, copy_sse2, copy_sse2, 0, 0, 0 )
+YUV_TO_YUV( yv12_to_i420_sse2, copy_sse2, copy_sse2, 1, 1, 1 )
+YUV_TO_YUV( yv16_to_i422_sse2, copy_sse2, copy_sse2, 1, 1, 0 )
+YUV_TO_YUV( yv24_to_i444_sse2, copy_sse2, copy_sse2, 1, 0, 0 )
+NV_TO_NV(   nv12_to_nv12_sse2, copy_sse2, copy_sse2,    1 )
+YUV_TO_YUV( i420_to_i420_avx2, copy_avx2, copy_avx2, 0, 1, 1 )
+YUV_TO_YUV( i422_to_i422_avx2, copy_avx2, copy_avx2, 0, 1, 0 )
+YUV_TO_YUV( i444_to_i444_avx2, copy_avx2, copy_avx2, 0, 0, 0 )
+YUV_TO_YUV( yv12_to_i420_avx2, copy_avx2, copy_avx2, 1, 1, 1 )
+YUV_TO_YUV( yv16_to_i422_avx2, copy_avx2, copy_avx2, 1, 1, 0 )
+YUV_TO_YUV( yv24_to_i444_avx2, copy_avx2, copy_avx2, 1, 0, 0 )
+NV_TO_NV(   nv12_to_nv12_avx2, copy_avx2, copy_avx2,    1 )
+
+#define INIT_SIMD_HIGH_DEPTH( csp, name ) INIT_SIMD( csp, name )
+#else
+#define INIT_SIMD_HIGH_DEPTH( csp, name )
+#endif
+
+#define INIT_SIMD( csp, name )                  \
+    if( cpu & X264_CPU_SSE2 )                   \
+        pf->convert[csp] = name##_sse2;         \
+    if( cpu & X264_CPU_AVX2 )                   \
+        pf->convert[csp] = name##_avx2;
+#else
+#define INIT_SIMD( csp, name )
+#define INIT_SIMD_HIGH_DEPTH( csp, name )
+#endif
+
+#define INIT_RGB( dst, rec, scale )                                       \
+    pf->convert[X264VFW_CSP_BGR ] =  bgr_to_##dst##_##rec##_##scale;      \
+    pf->convert[X264VFW_CSP_BGRA] = bgra_to_##dst##_##rec##_##scale;      \
+    pf->convert[X264VFW_CSP_B48R] = b48r_to_##dst##_##rec##_##scale;      \
+    pf->convert[X264VFW_CSP_B64A] = b64a_to_##dst##_##rec##_##scale;      \
+    INIT_RGB_SIMD( dst, rec, scale )
+
+#define INIT_RGB_MATRIX( dst )                  \
+    if( i_colmatrix == 1 )                      \
+    {                                           \
+        /* BT.709 */                            \
+        if( b_fullrange )                       \
+        {                                       \
+            /* PC Scale */                      \
+            INIT_RGB( dst, 709, pc );           \
+        }                                       \
+        else                                    \
+        {                                       \
+            /* TV Scale */                      \
+            INIT_RGB( dst, 709, tv );           \
+        }                                       \
+    }                                           \
+    else                                        \
+    {                                           \
+        /* BT.601 */                            \
+        if( b_fullrange )                       \
+        {                                       \
+            /* PC Scale */                      \
+            INIT_RGB( dst, 601, pc );           \
+        }                                       \
+        else                                    \
+        {                                       \
+            /* TV Scale */                      \
+            INIT_RGB( dst, 601, tv );           \
+        }                                       \
+    }
+
+void x264vfw_csp_init( x264vfw_csp_function_t *pf, int i_x264_csp, int i_colmatrix, int b_fullrange, int cpu )
 {
     int i;
     for( i = 0; i < X264VFW_CSP_MAX; i++ )
         pf->convert[i] = convert_fail;
-    switch( i_x264_csp )
+    pf->i_x264_csp = i_x264_csp;
+    switch( i_x264_csp & X264_CSP_MASK )
     {
         case X264_CSP_I420:
             pf->convert[X264VFW_CSP_I420] = i420_to_i420;
-            //pf->convert[X264VFW_CSP_I422] = i422_to_i420;
-            //pf->convert[X264VFW_CSP_I444] = i444_to_i420;
+            pf->convert[X264VFW_CSP_I422] = i422_to_i420;
+            pf->convert[X264VFW_CSP_I444] = i444_to_i420;
             pf->convert[X264VFW_CSP_YV12] = yv12_to_i420;
             pf->convert[X264VFW_CSP_YV16] = yv16_to_i420;
             pf->convert[X264VFW_CSP_YV24] = yv24_to_i420;
             pf->convert[X264VFW_CSP_YUYV] = yuyv_to_i420;
             pf->convert[X264VFW_CSP_UYVY] = uyvy_to_i420;
-            if( i_colmatrix == 1 )
-            {
-                // BT.709
-                if( b_fullrange )
-                {
-                    // PC Scale
-                    pf->convert[X264VFW_CSP_BGR ] =  bgr_to_i420_709_pc;
-                    pf->convert[X264VFW_CSP_BGRA] = bgra_to_i420_709_pc;
-                }
-                else
-                {
-                    // TV Scale
-                    pf->convert[X264VFW_CSP_BGR ] =  bgr_to_i420_709_tv;
-                    pf->convert[X264VFW_CSP_BGRA] = bgra_to_i420_709_tv;
-                }
-            }
-            else
-            {
-                // BT.601
-                if( b_fullrange )
-                {
-                    // PC Scale
-                    pf->convert[X264VFW_CSP_BGR ] =  bgr_to_i420_601_pc;
-                    pf->convert[X264VFW_CSP_BGRA] = bgra_to_i420_601_pc;
-                }
-                else
-                {
-                    // TV Scale
-                    pf->convert[X264VFW_CSP_BGR ] =  bgr_to_i420_601_tv;
-                    pf->convert[X264VFW_CSP_BGRA] = bgra_to_i420_601_tv;
-                }
-            }
+            pf->convert[X264VFW_CSP_P010] = p010_to_i420;
+            pf->convert[X264VFW_CSP_P210] = p210_to_i420;
+            pf->convert[X264VFW_CSP_V210] = v210_to_i420;
+            pf->convert[X264VFW_CSP_Y416] = y416_to_i420;
+            INIT_SIMD_HIGH_DEPTH( X264VFW_CSP_I420, i420_to_i420 )
+            INIT_SIMD_HIGH_DEPTH( X264VFW_CSP_YV12, yv12_to_i420 )
+            INIT_SIMD( X264VFW_CSP_P010, p010_to_i420 )
+            INIT_SIMD( X264VFW_CSP_P210, p210_to_i420 )
+            INIT_RGB_MATRIX( i420 )
             break;
 
         case X264_CSP_NV12:
+            pf->convert[X264VFW_CSP_I420] = i420_to_nv12;
+            pf->convert[X264VFW_CSP_I422] = i422_to_nv12;
+            pf->convert[X264VFW_CSP_I444] = i444_to_nv12;
+            pf->convert[X264VFW_CSP_YV12] = yv12_to_nv12;
+            pf->convert[X264VFW_CSP_YV16] = yv16_to_nv12;
+            pf->convert[X264VFW_CSP_YV24] = yv24_to_nv12;
             pf->convert[X264VFW_CSP_NV12] = nv12_to_nv12;
+            pf->convert[X264VFW_CSP_YUYV] = yuyv_to_nv12;
+            pf->convert[X264VFW_CSP_UYVY] = uyvy_to_nv12;
+            pf->convert[X264VFW_CSP_P010] = p010_to_nv12;
+            pf->convert[X264VFW_CSP_P210] = p210_to_nv12;
+            pf->convert[X264VFW_CSP_V210] = v210_to_nv12;
+            pf->convert[X264VFW_CSP_Y416] = y416_to_nv12;
+            INIT_NV12_SIMD
+            INIT_SIMD_HIGH_DEPTH( X264VFW_CSP_NV12, nv12_to_nv12 )
+            INIT_SIMD( X264VFW_CSP_P010, p010_to_nv12 )
+            INIT_SIMD( X264VFW_CSP_P210, p210_to_nv12 )
+            INIT_RGB_MATRIX( nv12 )
             break;
 
         case X264_CSP_I422:
-            //pf->convert[X264VFW_CSP_I422] = i422_to_i422;
+            pf->convert[X264VFW_CSP_I422] = i422_to_i422;
             pf->convert[X264VFW_CSP_YV16] = yv16_to_i422;
             pf->convert[X264VFW_CSP_YUYV] = yuyv_to_i422;
             pf->convert[X264VFW_CSP_UYVY] = uyvy_to_i422;
+            pf->convert[X264VFW_CSP_P210] = p210_to_i422;
+            pf->convert[X264VFW_CSP_V210] = v210_to_i422;
+            INIT_SIMD_HIGH_DEPTH( X264VFW_CSP_I422, i422_to_i422 )
+            INIT_SIMD_HIGH_DEPTH( X264VFW_CSP_YV16, yv16_to_i422 )
+            INIT_SIMD( X264VFW_CSP_P210, p210_to_i422 )
+            INIT_RGB_MATRIX( i422 )
             break;
 
         case X264_CSP_I444:
-            //pf->convert[X264VFW_CSP_I444] = i444_to_i444;
+            pf->convert[X264VFW_CSP_I444] = i444_to_i444;
             pf->convert[X264VFW_CSP_YV24] = yv24_to_i444;
+            pf->convert[X264VFW_CSP_Y416] = y416_to_i444;
+            INIT_SIMD_HIGH_DEPTH( X264VFW_CSP_I444, i444_to_i444 )
+            INIT_SIMD_HIGH_DEPTH( X264VFW_CSP_YV24, yv24_to_i444 )
+            INIT_RGB_MATRIX( i444 )
             break;
 
         case X264_CSP_BGR:
             pf->convert[X264VFW_CSP_BGR ] = bgr_to_bgr;
+            pf->convert[X264VFW_CSP_B48R] = b48r_to_bgr;
             break;
 
         case X264_CSP_BGRA:
             pf->convert[X264VFW_CSP_BGRA] = bgra_to_bgra;
+            pf->convert[X264VFW_CSP_B64A] = b64a_to_bgra;
             break;
     }
 }
+
+/* Byte offset of the column i_x in a plane of the input picture,
+ * -1 if i_x doesn't start a group of subsampled or packed pixels */
+static int src_column_offset( int i_csp, int i_plane, int i_x )
+{
+    if( i_x & 1 )
+        return -1;
+    switch( i_csp & X264VFW_CSP_MASK )
+    {
+        case X264VFW_CSP_I420:
+        case X264VFW_CSP_YV12:
+        case X264VFW_CSP_I422:
+        case X264VFW_CSP_YV16:
+            return i_plane ? i_x / 2 : i_x;
+        case X264VFW_CSP_I444:
+        case X264VFW_CSP_YV24:
+        case X264VFW_CSP_NV12:
+            return i_x;
+        case X264VFW_CSP_YUYV:
+        case X264VFW_CSP_UYVY:
+        case X264VFW_CSP_P010:
+        case X264VFW_CSP_P210:
+            return 2 * i_x;
+        case X264VFW_CSP_BGR:
+            return 3 * i_x;
+        case X264VFW_CSP_BGRA:
+            return 4 * i_x;
+        case X264VFW_CSP_B48R:
+            return 6 * i_x;
+        case X264VFW_CSP_Y416:
+        case X264VFW_CSP_B64A:
+            return 8 * i_x;
+        case X264VFW_CSP_V210:
+            return i_x % 6 ? -1 : i_x / 6 * 16;
+        default:
+            return -1;
+    }
+}
+
+/* Byte offset of the (even) column i_x in a plane of the output picture */
+static int dst_column_offset( int i_x264_csp, int i_plane, int i_x )
+{
+    switch( i_x264_csp & X264_CSP_MASK )
+    {
+        case X264_CSP_I420:
+        case X264_CSP_I422:
+            return (i_plane ? i_x / 2 : i_x) * (int)sizeof(pixel);
+        case X264_CSP_BGR:
+            return 3 * i_x * (int)sizeof(pixel);
+        case X264_CSP_BGRA:
+            return 4 * i_x * (int)sizeof(pixel);
+        default: /* I444, NV12 with interleaved chroma */
+            return i_x * (int)sizeof(pixel);
+    }
+}
+
+int x264vfw_csp_convert_rect( x264vfw_csp_function_t *pf, x264_image_t *img_dst, x264_image_t *img_src,
+                              int i_width, int i_height, int i_x0, int i_x1, int i_y0, int i_y1 )
+{
+    x264_image_t dst = *img_dst;
+    x264_image_t src = *img_src;
+    int i;
+
+    if( i_x1 > i_width )
+        return -1;
+    for( i = 0; i < src.i_plane; i++ )
+    {
+        int i_offset = src_column_offset( src.i_csp, i, i_x0 );
+        if( i_offset < 0 )
+            return -1;
+        src.plane[i] += i_offset;
+    }
+    for( i = 0; i < dst.i_plane; i++ )
+        dst.plane[i] += dst_column_offset( pf->i_x264_csp, i, i_x0 );
+    /* Vertical flipping only depends on the picture height so the columns can be moved freely */
+    return pf->convert[src.i_csp & X264VFW_CSP_MASK]( &dst, &src, i_x1 - i_x0, i_height, i_y0, i_y1 );
+}
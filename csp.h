@@ -30,8 +30,6 @@
 #define X264VFW_CSP_MASK           0x00ff  /* */
 #define X264VFW_CSP_NONE           0x0000  /* Invalid mode */
 #define X264VFW_CSP_I420           0x0001  /* yuv 4:2:0 planar */
-//#define X264VFW_CSP_I422         0x000?  /* yuv 4:2:2 planar */
-//#define X264VFW_CSP_I444         0x000?  /* yuv 4:4:4 planar */
 #define X264VFW_CSP_YV12           0x0002  /* yvu 4:2:0 planar */
 #define X264VFW_CSP_YV16           0x0003  /* yvu 4:2:2 planar */
 #define X264VFW_CSP_YV24           0x0004  /* yvu 4:4:4 planar */
@@ -40,16 +38,34 @@
 #define X264VFW_CSP_UYVY           0x0007  /* yuv 4:2:2 packed */
 #define X264VFW_CSP_BGR            0x0008  /* packed bgr 24bits */
 #define X264VFW_CSP_BGRA           0x0009  /* packed bgr 32bits */
-#define X264VFW_CSP_MAX            0x000a  /* end of list */
+#define X264VFW_CSP_P010           0x000a  /* yuv 4:2:0 16-bit (10 msb used), with one y plane and one packed u+v */
+#define X264VFW_CSP_P210           0x000b  /* yuv 4:2:2 16-bit (10 msb used), with one y plane and one packed u+v */
+#define X264VFW_CSP_V210           0x000c  /* yuv 4:2:2 packed 10-bit, 6 pixels in 16 bytes */
+#define X264VFW_CSP_Y416           0x000d  /* yuva 4:4:4 packed 16-bit */
+#define X264VFW_CSP_B48R           0x000e  /* packed rgb 48bits, big-endian */
+#define X264VFW_CSP_B64A           0x000f  /* packed argb 64bits, big-endian */
+#define X264VFW_CSP_I422           0x0010  /* yuv 4:2:2 planar */
+#define X264VFW_CSP_I444           0x0011  /* yuv 4:4:4 planar */
+#define X264VFW_CSP_MAX            0x0012  /* end of list */
 #define X264VFW_CSP_VFLIP          0x1000  /* the csp is vertically flipped */
 
-typedef int (*x264vfw_csp_t)( x264_image_t *, x264_image_t *, int i_width, int i_height );
+/* Convert rows [i_y0, i_y1) of the destination picture (i_height is the full picture height),
+ * disjoint row ranges can be converted concurrently; i_y0 and i_y1 must be even for 4:2:0 output */
+typedef int (*x264vfw_csp_t)( x264_image_t *, x264_image_t *, int i_width, int i_height, int i_y0, int i_y1 );
 
 typedef struct
 {
     x264vfw_csp_t convert[X264VFW_CSP_MAX];
+    int i_x264_csp;
 } x264vfw_csp_function_t;
 
-void x264vfw_csp_init( x264vfw_csp_function_t *pf, int i_x264_csp, int i_colmatrix, int b_fullrange );
+/* i_x264_csp must have X264_CSP_HIGH_DEPTH set with high bit depth builds of x264,
+ * cpu - x264 cpu flags (X264_CPU_*) used to select SIMD versions, 0 forces the C code */
+void x264vfw_csp_init( x264vfw_csp_function_t *pf, int i_x264_csp, int i_colmatrix, int b_fullrange, int cpu );
+
+/* Convert the rectangle [i_x0, i_x1) x [i_y0, i_y1) of the picture with the same converter,
+ * i_x0 must be even (a multiple of 6 for v210), returns -1 if it can't be done */
+int x264vfw_csp_convert_rect( x264vfw_csp_function_t *pf, x264_image_t *img_dst, x264_image_t *img_src,
+                              int i_width, int i_height, int i_x0, int i_x1, int i_y0, int i_y1 );
 
 #endif
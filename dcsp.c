@@ -0,0 +1,312 @@
+/*****************************************************************************
+ * dcsp.c: colorspace conversion functions of the decoder output
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "dcsp.h"
+
+#if HAVE_X86_SIMD
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+/* Every product is computed like pmulhw does: ((x << MUL_SHIFT) * k) >> 16 with the 4.12 coefficients
+ * gives x * k with FRAC_BITS fractional bits, so the C versions are bit-exact with the SIMD ones */
+#define COEF_BITS    12
+#define MUL_SHIFT    6
+#define FRAC_BITS    (COEF_BITS + MUL_SHIFT - 16)
+#define ROUND        (1 << (FRAC_BITS - 1))
+#define COEF( f )    ((int16_t)((f) * (1 << COEF_BITS) + 0.5))
+#define MULHI( x, k ) (((x) * (1 << MUL_SHIFT) * (k)) >> 16)
+
+static ALWAYS_INLINE uint8_t clip_uint8( int x )
+{
+    return x & ~255 ? (-x) >> 31 & 255 : x;
+}
+
+/* Point to the last row of the plane and negate stride so rows can be addressed top-down */
+static inline uint8_t *plane_vflip( uint8_t *dst, int *i_dst, int h )
+{
+    dst += (h - 1) * *i_dst;
+    *i_dst = -*i_dst;
+    return dst;
+}
+
+static int convert_fail( const x264vfw_dcsp_coefs_t *k, x264_image_t *img_dst, x264_image_t *img_src,
+                         int i_width, int i_height )
+{
+    return -1;
+}
+
+/* Row converters: i_arg is the output bytes per pixel for RGB and b_uyvy for packed yuv,
+ * c_step is 1 for I420 and 2 for NV12 (v points to the byte after u) */
+static ALWAYS_INLINE void rgb_row( const x264vfw_dcsp_coefs_t *k, uint8_t *d, uint8_t *y, uint8_t *u, uint8_t *v,
+                                   int i_width, int i_bpp, int c_step )
+{
+    int x;
+    for( x = 0; x < i_width; x++ )
+    {
+        int cu = u[x/2*c_step] - 128;
+        int cv = v[x/2*c_step] - 128;
+        int yt = MULHI( y[x] - k->y_off, k->y_k ) + ROUND;
+        d[0] = clip_uint8( (yt + MULHI( cu, k->u_b )) >> FRAC_BITS );
+        d[1] = clip_uint8( (yt - (MULHI( cu, k->u_g ) + MULHI( cv, k->v_g ))) >> FRAC_BITS );
+        d[2] = clip_uint8( (yt + MULHI( cv, k->v_r )) >> FRAC_BITS );
+        if( i_bpp == 4 )
+            d[3] = 255;
+        d += i_bpp;
+    }
+}
+
+static ALWAYS_INLINE void yuyv_row( const x264vfw_dcsp_coefs_t *k, uint8_t *d, uint8_t *y, uint8_t *u, uint8_t *v,
+                                    int i_width, int b_uyvy, int c_step )
+{
+    int x;
+    for( x = 0; x < i_width; x += 2 )
+    {
+        d[2*x + b_uyvy]     = y[x];
+        d[2*x + b_uyvy + 2] = y[x + 1 < i_width ? x + 1 : x];
+        d[2*x + 1 - b_uyvy] = u[x/2*c_step];
+        d[2*x + 3 - b_uyvy] = v[x/2*c_step];
+    }
+}
+
+#define DCSP_FRAME( name, target, c_step, row, i_arg )                                             \
+static target int name( const x264vfw_dcsp_coefs_t *k, x264_image_t *img_dst, x264_image_t *img_src, \
+                        int i_width, int i_height )                                                \
+{                                                                                                  \
+    uint8_t *dst  = img_dst->plane[0];                                                             \
+    int     i_dst = img_dst->i_stride[0];                                                          \
+    int     y;                                                                                     \
+                                                                                                   \
+    if( img_dst->i_csp & X264VFW_CSP_VFLIP )                                                       \
+        dst = plane_vflip( dst, &i_dst, i_height );                                                \
+    for( y = 0; y < i_height; y++ )                                                                \
+    {                                                                                              \
+        uint8_t *u = img_src->plane[1] + (y >> 1) * img_src->i_stride[1];                          \
+        uint8_t *v = c_step == 2 ? u + 1 : img_src->plane[2] + (y >> 1) * img_src->i_stride[2];    \
+        row( k, dst, img_src->plane[0] + y * img_src->i_stride[0], u, v, i_width, i_arg, c_step ); \
+        dst += i_dst;                                                                              \
+    }                                                                                              \
+    return 0;                                                                                      \
+}
+
+DCSP_FRAME( i420_to_bgr,  , 1, rgb_row,  3 )
+DCSP_FRAME( i420_to_bgra, , 1, rgb_row,  4 )
+DCSP_FRAME( i420_to_yuyv, , 1, yuyv_row, 0 )
+DCSP_FRAME( i420_to_uyvy, , 1, yuyv_row, 1 )
+DCSP_FRAME( nv12_to_bgr,  , 2, rgb_row,  3 )
+DCSP_FRAME( nv12_to_bgra, , 2, rgb_row,  4 )
+DCSP_FRAME( nv12_to_yuyv, , 2, yuyv_row, 0 )
+DCSP_FRAME( nv12_to_uyvy, , 2, yuyv_row, 1 )
+
+#if HAVE_X86_SIMD
+/* 8 chroma pairs as 16-bit words */
+static ALWAYS_INLINE TARGET_SSE2 void load_chroma_sse2( uint8_t *u, uint8_t *v, int c_step, __m128i *cu, __m128i *cv )
+{
+    if( c_step == 2 )
+    {
+        __m128i uv = _mm_loadu_si128( (__m128i *)u );
+        *cu = _mm_and_si128( uv, _mm_set1_epi16( 0x00ff ) );
+        *cv = _mm_srli_epi16( uv, 8 );
+    }
+    else
+    {
+        *cu = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i *)u ), _mm_setzero_si128() );
+        *cv = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i *)v ), _mm_setzero_si128() );
+    }
+}
+
+/* Luma terms plus the chroma term c of every pixel pair, saturated to bytes */
+static ALWAYS_INLINE TARGET_SSE2 __m128i rgb_pack_sse2( __m128i yl, __m128i yh, __m128i c, int b_sub )
+{
+    __m128i cl = _mm_unpacklo_epi16( c, c );
+    __m128i ch = _mm_unpackhi_epi16( c, c );
+    __m128i lo = b_sub ? _mm_sub_epi16( yl, cl ) : _mm_add_epi16( yl, cl );
+    __m128i hi = b_sub ? _mm_sub_epi16( yh, ch ) : _mm_add_epi16( yh, ch );
+    return _mm_packus_epi16( _mm_srai_epi16( lo, FRAC_BITS ), _mm_srai_epi16( hi, FRAC_BITS ) );
+}
+
+/* B, G and R bytes of 16 pixels */
+static ALWAYS_INLINE TARGET_SSE2 void yuv_to_rgb_block_sse2( const x264vfw_dcsp_coefs_t *k, __m128i y, __m128i cu, __m128i cv,
+                                                             __m128i *b, __m128i *g, __m128i *r )
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i c128  = _mm_set1_epi16( 128 );
+    const __m128i yoff  = _mm_set1_epi16( k->y_off );
+    const __m128i yk    = _mm_set1_epi16( k->y_k );
+    const __m128i round = _mm_set1_epi16( ROUND );
+    __m128i yl = _mm_slli_epi16( _mm_sub_epi16( _mm_unpacklo_epi8( y, zero ), yoff ), MUL_SHIFT );
+    __m128i yh = _mm_slli_epi16( _mm_sub_epi16( _mm_unpackhi_epi8( y, zero ), yoff ), MUL_SHIFT );
+    yl = _mm_add_epi16( _mm_mulhi_epi16( yl, yk ), round );
+    yh = _mm_add_epi16( _mm_mulhi_epi16( yh, yk ), round );
+    cu = _mm_slli_epi16( _mm_sub_epi16( cu, c128 ), MUL_SHIFT );
+    cv = _mm_slli_epi16( _mm_sub_epi16( cv, c128 ), MUL_SHIFT );
+
+    *b = rgb_pack_sse2( yl, yh, _mm_mulhi_epi16( cu, _mm_set1_epi16( k->u_b ) ), 0 );
+    *g = rgb_pack_sse2( yl, yh, _mm_add_epi16( _mm_mulhi_epi16( cu, _mm_set1_epi16( k->u_g ) ),
+                                               _mm_mulhi_epi16( cv, _mm_set1_epi16( k->v_g ) ) ), 1 );
+    *r = rgb_pack_sse2( yl, yh, _mm_mulhi_epi16( cv, _mm_set1_epi16( k->v_r ) ), 0 );
+}
+
+static ALWAYS_INLINE TARGET_SSE2 void store_bgra_sse2( uint8_t *d, __m128i b, __m128i g, __m128i r )
+{
+    const __m128i a = _mm_set1_epi8( -1 );
+    __m128i bg0 = _mm_unpacklo_epi8( b, g ), bg1 = _mm_unpackhi_epi8( b, g );
+    __m128i ra0 = _mm_unpacklo_epi8( r, a ), ra1 = _mm_unpackhi_epi8( r, a );
+    _mm_storeu_si128( (__m128i *)d,        _mm_unpacklo_epi16( bg0, ra0 ) );
+    _mm_storeu_si128( (__m128i *)(d + 16), _mm_unpackhi_epi16( bg0, ra0 ) );
+    _mm_storeu_si128( (__m128i *)(d + 32), _mm_unpacklo_epi16( bg1, ra1 ) );
+    _mm_storeu_si128( (__m128i *)(d + 48), _mm_unpackhi_epi16( bg1, ra1 ) );
+}
+
+/* BGRA dwords with the alpha bytes shuffled out, joined into 48 bytes */
+static ALWAYS_INLINE TARGET_SSSE3 void store_bgr_ssse3( uint8_t *d, __m128i b, __m128i g, __m128i r )
+{
+    const __m128i shuf = _mm_setr_epi8( 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 );
+    __m128i bg0 = _mm_unpacklo_epi8( b, g ), bg1 = _mm_unpackhi_epi8( b, g );
+    __m128i r0  = _mm_unpacklo_epi8( r, r ), r1  = _mm_unpackhi_epi8( r, r );
+    __m128i p0  = _mm_shuffle_epi8( _mm_unpacklo_epi16( bg0, r0 ), shuf );
+    __m128i p1  = _mm_shuffle_epi8( _mm_unpackhi_epi16( bg0, r0 ), shuf );
+    __m128i p2  = _mm_shuffle_epi8( _mm_unpacklo_epi16( bg1, r1 ), shuf );
+    __m128i p3  = _mm_shuffle_epi8( _mm_unpackhi_epi16( bg1, r1 ), shuf );
+    _mm_storeu_si128( (__m128i *)d,        _mm_or_si128( p0, _mm_slli_si128( p1, 12 ) ) );
+    _mm_storeu_si128( (__m128i *)(d + 16), _mm_or_si128( _mm_srli_si128( p1, 4 ), _mm_slli_si128( p2, 8 ) ) );
+    _mm_storeu_si128( (__m128i *)(d + 32), _mm_or_si128( _mm_srli_si128( p2, 8 ), _mm_slli_si128( p3, 4 ) ) );
+}
+
+#define RGB_ROW_SIMD( name, target, store )                                                                 \
+static ALWAYS_INLINE target void name( const x264vfw_dcsp_coefs_t *k, uint8_t *d, uint8_t *y, uint8_t *u, uint8_t *v, \
+                                       int i_width, int i_bpp, int c_step )                                 \
+{                                                                                                           \
+    int i_simd = i_width & ~15;                                                                             \
+    int x;                                                                                                  \
+    for( x = 0; x < i_simd; x += 16 )                                                                       \
+    {                                                                                                       \
+        __m128i cu, cv, b, g, r;                                                                            \
+        load_chroma_sse2( u + x/2*c_step, v + x/2*c_step, c_step, &cu, &cv );                               \
+        yuv_to_rgb_block_sse2( k, _mm_loadu_si128( (__m128i *)(y + x) ), cu, cv, &b, &g, &r );              \
+        store( d + x*i_bpp, b, g, r );                                                                      \
+    }                                                                                                       \
+    rgb_row( k, d + i_simd*i_bpp, y + i_simd, u + i_simd/2*c_step, v + i_simd/2*c_step,                     \
+             i_width - i_simd, i_bpp, c_step );                                                             \
+}
+
+RGB_ROW_SIMD( bgra_row_sse2, TARGET_SSE2,  store_bgra_sse2 )
+RGB_ROW_SIMD( bgr_row_ssse3, TARGET_SSSE3, store_bgr_ssse3 )
+
+/* Packed yuv only interleaves the planes */
+static ALWAYS_INLINE TARGET_SSE2 void yuyv_row_sse2( const x264vfw_dcsp_coefs_t *k, uint8_t *d, uint8_t *y, uint8_t *u, uint8_t *v,
+                                                     int i_width, int b_uyvy, int c_step )
+{
+    int i_simd = i_width & ~15;
+    int x;
+    for( x = 0; x < i_simd; x += 16 )
+    {
+        __m128i yy = _mm_loadu_si128( (__m128i *)(y + x) );
+        __m128i uv = c_step == 2 ? _mm_loadu_si128( (__m128i *)(u + x) )
+                                 : _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i *)(u + x/2) ),
+                                                      _mm_loadl_epi64( (__m128i *)(v + x/2) ) );
+        _mm_storeu_si128( (__m128i *)(d + 2*x),      b_uyvy ? _mm_unpacklo_epi8( uv, yy ) : _mm_unpacklo_epi8( yy, uv ) );
+        _mm_storeu_si128( (__m128i *)(d + 2*x + 16), b_uyvy ? _mm_unpackhi_epi8( uv, yy ) : _mm_unpackhi_epi8( yy, uv ) );
+    }
+    yuyv_row( k, d + 2*i_simd, y + i_simd, u + i_simd/2*c_step, v + i_simd/2*c_step, i_width - i_simd, b_uyvy, c_step );
+}
+
+DCSP_FRAME( i420_to_bgr_ssse3,  TARGET_SSSE3, 1, bgr_row_ssse3, 3 )
+DCSP_FRAME( i420_to_bgra_sse2,  TARGET_SSE2,  1, bgra_row_sse2, 4 )
+DCSP_FRAME( i420_to_yuyv_sse2,  TARGET_SSE2,  1, yuyv_row_sse2, 0 )
+DCSP_FRAME( i420_to_uyvy_sse2,  TARGET_SSE2,  1, yuyv_row_sse2, 1 )
+DCSP_FRAME( nv12_to_bgr_ssse3,  TARGET_SSSE3, 2, bgr_row_ssse3, 3 )
+DCSP_FRAME( nv12_to_bgra_sse2,  TARGET_SSE2,  2, bgra_row_sse2, 4 )
+DCSP_FRAME( nv12_to_yuyv_sse2,  TARGET_SSE2,  2, yuyv_row_sse2, 0 )
+DCSP_FRAME( nv12_to_uyvy_sse2,  TARGET_SSE2,  2, yuyv_row_sse2, 1 )
+
+#define INIT_DCSP_SIMD( src )                                             \
+    if( cpu & X264_CPU_SSE2 )                                             \
+    {                                                                     \
+        pf->convert[X264VFW_CSP_BGRA] = src##_to_bgra_sse2;               \
+        pf->convert[X264VFW_CSP_YUYV] = src##_to_yuyv_sse2;               \
+        pf->convert[X264VFW_CSP_UYVY] = src##_to_uyvy_sse2;               \
+    }                                                                     \
+    if( cpu & X264_CPU_SSSE3 )                                            \
+        pf->convert[X264VFW_CSP_BGR ] = src##_to_bgr_ssse3;
+#else
+#define INIT_DCSP_SIMD( src )
+#endif
+
+#define INIT_DCSP( src )                                                  \
+    pf->convert[X264VFW_CSP_BGR ] = src##_to_bgr;                         \
+    pf->convert[X264VFW_CSP_BGRA] = src##_to_bgra;                        \
+    pf->convert[X264VFW_CSP_YUYV] = src##_to_yuyv;                        \
+    pf->convert[X264VFW_CSP_UYVY] = src##_to_uyvy;                        \
+    INIT_DCSP_SIMD( src )
+
+void x264vfw_dcsp_init( x264vfw_dcsp_function_t *pf, int i_src_csp, int i_colmatrix, int b_fullrange, int cpu )
+{
+    /* TV Scale expands 16..235 luma and 16..240 chroma to the full range */
+    double ky = b_fullrange ? 1.0 : 255.0 / 219.0;
+    double kc = b_fullrange ? 1.0 : 255.0 / 224.0;
+    double kr, kb, kg;
+    int i;
+
+    switch( i_colmatrix )
+    {
+        case 1: /* BT.709 */
+            kr = 0.2126;
+            kb = 0.0722;
+            break;
+
+        case 9: /* BT.2020 */
+        case 10:
+            kr = 0.2627;
+            kb = 0.0593;
+            break;
+
+        default: /* BT.601 */
+            kr = 0.299;
+            kb = 0.114;
+            break;
+    }
+    kg = 1.0 - kr - kb;
+    pf->coefs.y_off = b_fullrange ? 0 : 16;
+    pf->coefs.y_k   = COEF( ky );
+    pf->coefs.v_r   = COEF( 2.0 * (1.0 - kr) * kc );
+    pf->coefs.u_g   = COEF( 2.0 * kb * (1.0 - kb) / kg * kc );
+    pf->coefs.v_g   = COEF( 2.0 * kr * (1.0 - kr) / kg * kc );
+    pf->coefs.u_b   = COEF( 2.0 * (1.0 - kb) * kc );
+
+    for( i = 0; i < X264VFW_CSP_MAX; i++ )
+        pf->convert[i] = convert_fail;
+    switch( i_src_csp & X264VFW_CSP_MASK )
+    {
+        case X264VFW_CSP_I420:
+            INIT_DCSP( i420 )
+            break;
+
+        case X264VFW_CSP_NV12:
+            INIT_DCSP( nv12 )
+            break;
+    }
+}
+
+int x264vfw_dcsp_convert( x264vfw_dcsp_function_t *pf, x264_image_t *img_dst, x264_image_t *img_src,
+                          int i_width, int i_height )
+{
+    return pf->convert[img_dst->i_csp & X264VFW_CSP_MASK]( &pf->coefs, img_dst, img_src, i_width, i_height );
+}
@@ -0,0 +1,57 @@
+/*****************************************************************************
+ * dcsp.h: colorspace conversion functions of the decoder output
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_DCSP_H
+#define X264VFW_DCSP_H
+
+#include "csp.h"
+
+/* YUV -> RGB coefficients in 4.12 fixed point */
+typedef struct
+{
+    int16_t y_off;
+    int16_t y_k;
+    int16_t v_r;
+    int16_t u_g;
+    int16_t v_g;
+    int16_t u_b;
+} x264vfw_dcsp_coefs_t;
+
+/* Convert the 8-bit decoded picture (X264VFW_CSP_I420 or X264VFW_CSP_NV12) to the output picture,
+ * X264VFW_CSP_VFLIP of the output csp is handled by the converter */
+typedef int (*x264vfw_dcsp_t)( const x264vfw_dcsp_coefs_t *, x264_image_t *, x264_image_t *, int i_width, int i_height );
+
+typedef struct
+{
+    x264vfw_dcsp_t convert[X264VFW_CSP_MAX]; /* indexed by the output csp */
+    x264vfw_dcsp_coefs_t coefs;
+} x264vfw_dcsp_function_t;
+
+/* i_src_csp - X264VFW_CSP_I420 or X264VFW_CSP_NV12, i_colmatrix - matrix coefficients of the
+ * stream (1: BT.709, 9 and 10: BT.2020, otherwise BT.601), the output keeps the source range
+ * for YUYV and UYVY, cpu - x264 cpu flags (X264_CPU_*) used to select SIMD versions, 0 forces the C code.
+ * Only BGR, BGRA, YUYV and UYVY outputs are supported, chroma is upsampled by repeating it */
+void x264vfw_dcsp_init( x264vfw_dcsp_function_t *pf, int i_src_csp, int i_colmatrix, int b_fullrange, int cpu );
+
+/* Returns -1 if the output csp isn't supported */
+int x264vfw_dcsp_convert( x264vfw_dcsp_function_t *pf, x264_image_t *img_dst, x264_image_t *img_src,
+                          int i_width, int i_height );
+
+#endif
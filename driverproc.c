@@ -131,6 +131,7 @@ LRESULT WINAPI attribute_align_arg DriverProc(DWORD_PTR dwDriverId, HDRVR hDrive
         case DRV_CLOSE:
             /* From xvid: x264vfw_compress_end/x264vfw_decompress_end don't always get called */
             x264vfw_compress_end(codec);
+            x264vfw_compress_release(codec);
 #if defined(HAVE_FFMPEG) && X264VFW_USE_DECODER
             x264vfw_decompress_end(codec);
 #endif
@@ -0,0 +1,216 @@
+/*****************************************************************************
+ * framediff.c: input frame change detection
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "framediff.h"
+#include "csp.h"
+
+#if HAVE_X86_SIMD
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+static int equal_c(const uint8_t *a, const uint8_t *b, int i_size)
+{
+    return !memcmp(a, b, i_size);
+}
+
+#if HAVE_X86_SIMD
+static TARGET_SSE2 int equal_sse2(const uint8_t *a, const uint8_t *b, int i_size)
+{
+    int i;
+
+    for (i = 0; i + 16 <= i_size; i += 16)
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                             _mm_loadu_si128((const __m128i *)(b + i)))) != 0xffff)
+            return 0;
+    return !memcmp(a + i, b + i, i_size - i);
+}
+
+static TARGET_AVX2 int equal_avx2(const uint8_t *a, const uint8_t *b, int i_size)
+{
+    int i;
+
+    for (i = 0; i + 32 <= i_size; i += 32)
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                                   _mm256_loadu_si256((const __m256i *)(b + i)))) != -1)
+            return 0;
+    return equal_sse2(a + i, b + i, i_size - i);
+}
+#endif
+
+/* Bytes of a tile row and log2 of the vertical chroma subsampling for every plane,
+ * returns the tile width in pixels or 0 for unknown colorspaces */
+static int tile_layout(int i_csp, int *i_tile_bytes, int *i_v_shift)
+{
+    i_v_shift[0] = i_v_shift[1] = i_v_shift[2] = 0;
+    switch (i_csp & X264VFW_CSP_MASK)
+    {
+        case X264VFW_CSP_I420:
+        case X264VFW_CSP_YV12:
+            i_v_shift[1] = i_v_shift[2] = 1;
+            /* fall through */
+        case X264VFW_CSP_I422:
+        case X264VFW_CSP_YV16:
+            i_tile_bytes[0] = 16;
+            i_tile_bytes[1] = i_tile_bytes[2] = 8;
+            return 16;
+
+        case X264VFW_CSP_I444:
+        case X264VFW_CSP_YV24:
+            i_tile_bytes[0] = i_tile_bytes[1] = i_tile_bytes[2] = 16;
+            return 16;
+
+        case X264VFW_CSP_NV12:
+            i_tile_bytes[0] = i_tile_bytes[1] = 16;
+            i_v_shift[1] = 1;
+            return 16;
+
+        case X264VFW_CSP_P010:
+            i_v_shift[1] = 1;
+            /* fall through */
+        case X264VFW_CSP_P210:
+            i_tile_bytes[0] = i_tile_bytes[1] = 32;
+            return 16;
+
+        case X264VFW_CSP_YUYV:
+        case X264VFW_CSP_UYVY:
+            i_tile_bytes[0] = 32;
+            return 16;
+
+        case X264VFW_CSP_BGR:
+            i_tile_bytes[0] = 48;
+            return 16;
+
+        case X264VFW_CSP_BGRA:
+            i_tile_bytes[0] = 64;
+            return 16;
+
+        case X264VFW_CSP_B48R:
+            i_tile_bytes[0] = 96;
+            return 16;
+
+        case X264VFW_CSP_Y416:
+        case X264VFW_CSP_B64A:
+            i_tile_bytes[0] = 128;
+            return 16;
+
+        case X264VFW_CSP_V210:
+            /* 48 pixels in 128 bytes */
+            i_tile_bytes[0] = 128;
+            return 48;
+
+        default:
+            return 0;
+    }
+}
+
+int x264vfw_framediff_init(x264vfw_framediff_t *fd, x264_image_t *img, int i_width, int i_height, int cpu)
+{
+    int i_v_shift[3];
+    int i;
+
+    memset(fd, 0, sizeof(x264vfw_framediff_t));
+    fd->i_tile_width = tile_layout(img->i_csp, fd->i_tile_bytes, i_v_shift);
+    if (!fd->i_tile_width)
+        return -1;
+    fd->i_planes = img->i_plane;
+    fd->i_tiles_x = (i_width + fd->i_tile_width - 1) / fd->i_tile_width;
+    fd->i_tiles_y = (i_height + X264VFW_TILE_HEIGHT - 1) / X264VFW_TILE_HEIGHT;
+    fd->map = malloc(fd->i_tiles_x * fd->i_tiles_y);
+    if (!fd->map)
+        return -1;
+    for (i = 0; i < fd->i_planes; i++)
+    {
+        fd->i_width[i] = img->i_stride[i];
+        fd->i_height[i] = (i_height + (1 << i_v_shift[i]) - 1) >> i_v_shift[i];
+        fd->i_tile_rows[i] = X264VFW_TILE_HEIGHT >> i_v_shift[i];
+        fd->prev[i] = malloc(fd->i_width[i] * fd->i_height[i]);
+        if (!fd->prev[i])
+        {
+            x264vfw_framediff_close(fd);
+            return -1;
+        }
+    }
+
+    fd->equal = equal_c;
+#if HAVE_X86_SIMD
+    if (cpu & X264_CPU_SSE2)
+        fd->equal = equal_sse2;
+    if (cpu & X264_CPU_AVX2)
+        fd->equal = equal_avx2;
+#endif
+    return 0;
+}
+
+void x264vfw_framediff_close(x264vfw_framediff_t *fd)
+{
+    int i;
+
+    free(fd->map);
+    for (i = 0; i < 3; i++)
+        free(fd->prev[i]);
+    memset(fd, 0, sizeof(x264vfw_framediff_t));
+}
+
+int x264vfw_framediff_update(x264vfw_framediff_t *fd, x264_image_t *img)
+{
+    int i, x, y;
+
+    memset(fd->map, !fd->b_valid, fd->i_tiles_x * fd->i_tiles_y);
+    for (i = 0; i < fd->i_planes; i++)
+    {
+        uint8_t *src = img->plane[i];
+        int i_src = img->i_stride[i];
+        int i_tile_bytes = fd->i_tile_bytes[i];
+
+        /* Tiles are counted from the top of the picture */
+        if (img->i_csp & X264VFW_CSP_VFLIP)
+        {
+            src += (fd->i_height[i] - 1) * i_src;
+            i_src = -i_src;
+        }
+        for (y = 0; y < fd->i_height[i]; y++, src += i_src)
+        {
+            uint8_t *map = fd->map + y / fd->i_tile_rows[i] * fd->i_tiles_x;
+            uint8_t *prev = fd->prev[i] + y * fd->i_width[i];
+
+            for (x = 0; x < fd->i_tiles_x; x++)
+            {
+                int i_offset = x * i_tile_bytes;
+                int i_size = X264_MIN(i_tile_bytes, fd->i_width[i] - i_offset);
+
+                if (i_size <= 0)
+                    break;
+                /* Rows of the tiles already known as changed are only copied */
+                if (map[x] || !fd->equal(src + i_offset, prev + i_offset, i_size))
+                {
+                    memcpy(prev + i_offset, src + i_offset, i_size);
+                    map[x] = 1;
+                }
+            }
+        }
+    }
+    fd->b_valid = 1;
+
+    fd->i_tiles_changed = 0;
+    for (i = 0; i < fd->i_tiles_x * fd->i_tiles_y; i++)
+        fd->i_tiles_changed += fd->map[i];
+    return fd->i_tiles_changed;
+}
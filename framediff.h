@@ -0,0 +1,55 @@
+/*****************************************************************************
+ * framediff.h: input frame change detection
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_FRAMEDIFF_H
+#define X264VFW_FRAMEDIFF_H
+
+#include "common.h"
+
+#define X264VFW_TILE_HEIGHT 16 /* tile height in pixels, the width is 16 pixels except for v210 */
+
+typedef struct
+{
+    int i_planes;
+    int i_tile_width;       /* pixels */
+    int i_tiles_x;
+    int i_tiles_y;
+    int i_tiles_changed;    /* in the last compared frame */
+    uint8_t *map;           /* [i_tiles_y][i_tiles_x], nonzero for the tiles changed in the last compared frame */
+
+    /* Copy of the previous input frame, top-down */
+    uint8_t *prev[3];
+    int i_width[3];         /* bytes */
+    int i_height[3];        /* rows */
+    int i_tile_bytes[3];
+    int i_tile_rows[3];
+    int b_valid;
+
+    int (*equal)(const uint8_t *a, const uint8_t *b, int i_size);
+} x264vfw_framediff_t;
+
+/* img - input picture as filled for the raw frame (X264VFW_CSP_*), cpu - x264 cpu flags (X264_CPU_*) */
+int x264vfw_framediff_init(x264vfw_framediff_t *fd, x264_image_t *img, int i_width, int i_height, int cpu);
+void x264vfw_framediff_close(x264vfw_framediff_t *fd);
+/* Compares the frame with the previous one, updates the tile map and the copy,
+ * returns the number of changed tiles (all of them for the first frame) */
+int x264vfw_framediff_update(x264vfw_framediff_t *fd, x264_image_t *img);
+
+#endif
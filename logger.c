@@ -0,0 +1,205 @@
+/*****************************************************************************
+ * logger.c: asynchronous log message queue
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "logger.h"
+#include <process.h>
+
+/* Bounded multi-producer single-consumer queue: record i_seq is equal to the write position
+ * when the record is free, to position + 1 when it is filled and to position + X264VFW_LOGGER_RECORDS
+ * after the consumer has written it out (i.e. free for the next lap). Positions wrap around. */
+typedef struct
+{
+    volatile LONG i_seq;
+    char msg[X264VFW_LOGGER_MSG_SIZE];
+} logger_record_t;
+
+struct x264vfw_logger_t
+{
+    logger_record_t record[X264VFW_LOGGER_RECORDS];
+    volatile LONG i_write;      /* next position to be taken by producers */
+    LONG i_read;                /* next position to be written out, consumer only */
+    volatile LONG i_dropped;    /* messages lost because the queue was full */
+    volatile LONG b_waiting;    /* consumer is going to sleep on wake */
+    volatile LONG b_exit;
+
+    x264vfw_logger_sink_t sink;
+    void *opaque;
+    HANDLE wake;                /* auto-reset */
+    HANDLE thread;
+};
+
+void x264vfw_log_format(char *buf, int i_size, const char *name, int i_level, const char *psz_fmt, va_list arg)
+{
+    char *s_level;
+    int i_len;
+
+    switch (i_level)
+    {
+        case X264_LOG_ERROR:
+            s_level = "error";
+            break;
+
+        case X264_LOG_WARNING:
+            s_level = "warning";
+            break;
+
+        case X264_LOG_INFO:
+            s_level = "info";
+            break;
+
+        case X264_LOG_DEBUG:
+            s_level = "debug";
+            break;
+
+        default:
+            s_level = "unknown";
+            break;
+    }
+    memset(buf, 0, i_size);
+    snprintf(buf, i_size - 1, "%s [%s]: ", name, s_level);
+    i_len = strlen(buf);
+    vsnprintf(buf + i_len, i_size - i_len - 1, psz_fmt, arg);
+}
+
+static int logger_ready(x264vfw_logger_t *logger)
+{
+    return logger->record[logger->i_read & (X264VFW_LOGGER_RECORDS - 1)].i_seq == (LONG)((ULONG)logger->i_read + 1);
+}
+
+static unsigned __stdcall attribute_align_arg logger_thread(void *arg)
+{
+    x264vfw_logger_t *logger = arg;
+
+    for (;;)
+    {
+        LONG i_dropped;
+
+        if (logger_ready(logger))
+        {
+            logger_record_t *record = &logger->record[logger->i_read & (X264VFW_LOGGER_RECORDS - 1)];
+
+            MemoryBarrier(); /* read the message only after its i_seq */
+            logger->sink(logger->opaque, record->msg);
+            InterlockedExchange(&record->i_seq, (LONG)((ULONG)logger->i_read + X264VFW_LOGGER_RECORDS));
+            logger->i_read = (LONG)((ULONG)logger->i_read + 1);
+            continue;
+        }
+        i_dropped = InterlockedExchange(&logger->i_dropped, 0);
+        if (i_dropped)
+        {
+            char msg[64];
+
+            snprintf(msg, sizeof(msg), "x264vfw [warning]: %d log messages dropped\n", (int)i_dropped);
+            logger->sink(logger->opaque, msg);
+            continue;
+        }
+        if (logger->b_exit)
+            break;
+
+        /* Producers only signal the event when they see b_waiting so recheck after setting it */
+        InterlockedExchange(&logger->b_waiting, 1);
+        if (logger_ready(logger) || logger->b_exit)
+        {
+            InterlockedExchange(&logger->b_waiting, 0);
+            continue;
+        }
+        WaitForSingleObject(logger->wake, INFINITE);
+    }
+    return 0;
+}
+
+int x264vfw_logger_init(x264vfw_logger_t **p_logger, x264vfw_logger_sink_t sink, void *opaque)
+{
+    x264vfw_logger_t *logger;
+    int i;
+
+    *p_logger = NULL;
+    logger = calloc(1, sizeof(x264vfw_logger_t));
+    if (!logger)
+        return -1;
+    for (i = 0; i < X264VFW_LOGGER_RECORDS; i++)
+        logger->record[i].i_seq = i;
+    logger->sink = sink;
+    logger->opaque = opaque;
+    logger->wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (logger->wake)
+        logger->thread = (HANDLE)_beginthreadex(NULL, 0, logger_thread, logger, 0, NULL);
+    if (!logger->thread)
+    {
+        if (logger->wake)
+            CloseHandle(logger->wake);
+        free(logger);
+        return -1;
+    }
+    *p_logger = logger;
+    return 0;
+}
+
+void x264vfw_logger_delete(x264vfw_logger_t *logger)
+{
+    if (!logger)
+        return;
+
+    InterlockedExchange(&logger->b_exit, 1);
+    SetEvent(logger->wake);
+    /* The sink may send messages to a window of this thread (e.g. LB_ADDSTRING) */
+    while (MsgWaitForMultipleObjects(1, &logger->thread, FALSE, INFINITE, QS_SENDMESSAGE) == WAIT_OBJECT_0 + 1)
+    {
+        MSG msg;
+        PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE | PM_QS_SENDMESSAGE);
+    }
+    CloseHandle(logger->thread);
+    CloseHandle(logger->wake);
+    free(logger);
+}
+
+void x264vfw_logger_write(x264vfw_logger_t *logger, const char *name, int i_level, const char *psz_fmt, va_list arg)
+{
+    logger_record_t *record;
+    LONG i_pos = logger->i_write;
+
+    for (;;)
+    {
+        LONG i_diff;
+
+        record = &logger->record[i_pos & (X264VFW_LOGGER_RECORDS - 1)];
+        i_diff = (LONG)((ULONG)record->i_seq - (ULONG)i_pos);
+        if (i_diff == 0)
+        {
+            LONG i_prev = InterlockedCompareExchange(&logger->i_write, (LONG)((ULONG)i_pos + 1), i_pos);
+            if (i_prev == i_pos)
+                break;
+            i_pos = i_prev;
+        }
+        else if (i_diff < 0)
+        {
+            /* Full: the consumer hasn't written out this record since the previous lap */
+            InterlockedIncrement(&logger->i_dropped);
+            return;
+        }
+        else
+            i_pos = logger->i_write;
+    }
+
+    x264vfw_log_format(record->msg, sizeof(record->msg), name, i_level, psz_fmt, arg);
+    InterlockedExchange(&record->i_seq, (LONG)((ULONG)i_pos + 1));
+    if (logger->b_waiting && InterlockedExchange(&logger->b_waiting, 0))
+        SetEvent(logger->wake);
+}
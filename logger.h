@@ -0,0 +1,46 @@
+/*****************************************************************************
+ * logger.h: asynchronous log message queue
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_LOGGER_H
+#define X264VFW_LOGGER_H
+
+#include "common.h"
+#include <stdarg.h>
+
+#define X264VFW_LOGGER_RECORDS  256  /* power of 2 */
+#define X264VFW_LOGGER_MSG_SIZE 2048
+
+typedef struct x264vfw_logger_t x264vfw_logger_t;
+
+/* Called by the consumer thread for every message in the order they were queued */
+typedef void (*x264vfw_logger_sink_t)(void *opaque, const char *msg);
+
+/* Format "name [level]: message" into buf */
+void x264vfw_log_format(char *buf, int i_size, const char *name, int i_level, const char *psz_fmt, va_list arg);
+
+int x264vfw_logger_init(x264vfw_logger_t **p_logger, x264vfw_logger_sink_t sink, void *opaque);
+/* Writes out the queued messages and stops the consumer thread,
+ * messages sent to windows of the calling thread are processed meanwhile */
+void x264vfw_logger_delete(x264vfw_logger_t *logger);
+/* Formats the message into a free record without locks or system calls (except for waking up
+ * the idle consumer), drops it if the queue is full. Can be called from any thread. */
+void x264vfw_logger_write(x264vfw_logger_t *logger, const char *name, int i_level, const char *psz_fmt, va_list arg);
+
+#endif
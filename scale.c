@@ -0,0 +1,325 @@
+/*****************************************************************************
+ * scale.c: area downscaler for the renditions
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "scale.h"
+#include <math.h>
+
+#if HAVE_X86_SIMD
+#include <emmintrin.h>
+#endif
+
+/* Filter coefficients sum up to 1 << SCALE_BITS */
+#define SCALE_BITS 14
+/* Extra precision of 8-bit samples between the vertical and the horizontal pass */
+#define SCALE_FRAC_8 6
+
+typedef struct
+{
+    int i_taps;
+    int *pos;               /* [i_dst] first source sample */
+    int16_t *coef;          /* [i_dst][i_taps] */
+} scale_filter_t;
+
+typedef void (*scale_vert_t)(uint16_t *dst, const uint8_t *src, intptr_t i_stride, const int16_t *coef, int i_taps, int i_width);
+
+struct x264vfw_scale_t
+{
+    int i_planes;
+    int b_high_depth;
+    int i_channels[3];          /* interleaved components of a plane */
+    int i_src_width[3];         /* pixels */
+    int i_dst_width[3];
+    int i_dst_height[3];
+    scale_filter_t h[3];
+    scale_filter_t v[3];
+    uint16_t *tmp;              /* one source row after the vertical pass */
+    scale_vert_t vert;
+};
+
+/* Number of planes, interleaved components and log2 of the chroma subsampling, 0 for unknown colorspaces */
+static int scale_layout(int i_csp, int *i_channels, int *i_h_shift, int *i_v_shift)
+{
+    i_channels[0] = i_channels[1] = i_channels[2] = 1;
+    i_h_shift[0] = i_h_shift[1] = i_h_shift[2] = 0;
+    i_v_shift[0] = i_v_shift[1] = i_v_shift[2] = 0;
+    switch (i_csp & X264_CSP_MASK)
+    {
+        case X264_CSP_I420:
+        case X264_CSP_YV12:
+            i_v_shift[1] = i_v_shift[2] = 1;
+            /* fall through */
+        case X264_CSP_I422:
+        case X264_CSP_YV16:
+            i_h_shift[1] = i_h_shift[2] = 1;
+            return 3;
+
+        case X264_CSP_I444:
+        case X264_CSP_YV24:
+            return 3;
+
+        case X264_CSP_NV12:
+            i_v_shift[1] = 1;
+            /* fall through */
+        case X264_CSP_NV16:
+            i_h_shift[1] = 1;
+            i_channels[1] = 2;
+            return 2;
+
+        case X264_CSP_BGR:
+        case X264_CSP_RGB:
+            i_channels[0] = 3;
+            return 1;
+
+        case X264_CSP_BGRA:
+            i_channels[0] = 4;
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+/* Each output sample covers i_src / i_dst input samples, the weight of an input sample is its share of that area */
+static int filter_init(scale_filter_t *f, int i_src, int i_dst)
+{
+    double f_ratio = (double)i_src / i_dst;
+    int i, t;
+
+    f->i_taps = X264_MIN((int)ceil(f_ratio) + 1, i_src);
+    f->pos = malloc(i_dst * sizeof(int));
+    f->coef = malloc(i_dst * f->i_taps * sizeof(int16_t));
+    if (!f->pos || !f->coef)
+        return -1;
+    for (i = 0; i < i_dst; i++)
+    {
+        double x0 = i * f_ratio;
+        double x1 = x0 + f_ratio;
+        int16_t *coef = f->coef + i * f->i_taps;
+        int i_first = X264_MIN((int)x0, i_src - f->i_taps);
+        int i_sum = 0;
+        int i_max = 0;
+
+        for (t = 0; t < f->i_taps; t++)
+        {
+            double a = x0 > i_first + t ? x0 : i_first + t;
+            double b = x1 < i_first + t + 1 ? x1 : i_first + t + 1;
+
+            coef[t] = b > a ? (int)((b - a) / f_ratio * (1 << SCALE_BITS) + 0.5) : 0;
+            i_sum += coef[t];
+            if (coef[t] > coef[i_max])
+                i_max = t;
+        }
+        /* Rounding must not change the brightness */
+        coef[i_max] += (1 << SCALE_BITS) - i_sum;
+        f->pos[i] = i_first;
+    }
+    return 0;
+}
+
+static void filter_close(scale_filter_t *f)
+{
+    free(f->pos);
+    free(f->coef);
+}
+
+static void vert8_c(uint16_t *dst, const uint8_t *src, intptr_t i_stride, const int16_t *coef, int i_taps, int i_width)
+{
+    int x, t;
+
+    for (x = 0; x < i_width; x++)
+    {
+        int i_sum = 1 << (SCALE_BITS - SCALE_FRAC_8 - 1);
+
+        for (t = 0; t < i_taps; t++)
+            i_sum += coef[t] * src[t * i_stride + x];
+        dst[x] = i_sum >> (SCALE_BITS - SCALE_FRAC_8);
+    }
+}
+
+static void vert16_c(uint16_t *dst, const uint8_t *src, intptr_t i_stride, const int16_t *coef, int i_taps, int i_width)
+{
+    int x, t;
+
+    for (x = 0; x < i_width; x++)
+    {
+        int i_sum = 1 << (SCALE_BITS - 1);
+
+        for (t = 0; t < i_taps; t++)
+            i_sum += coef[t] * ((const uint16_t *)(src + t * i_stride))[x];
+        dst[x] = i_sum >> SCALE_BITS;
+    }
+}
+
+#if HAVE_X86_SIMD
+/* Two source rows at a time: interleaved samples times a pair of coefficients with pmaddwd */
+static TARGET_SSE2 void vert8_sse2(uint16_t *dst, const uint8_t *src, intptr_t i_stride, const int16_t *coef, int i_taps, int i_width)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i round = _mm_set1_epi32(1 << (SCALE_BITS - SCALE_FRAC_8 - 1));
+    int x, t;
+
+    for (x = 0; x + 8 <= i_width; x += 8)
+    {
+        __m128i lo = round;
+        __m128i hi = round;
+
+        for (t = 0; t < i_taps; t += 2)
+        {
+            const uint8_t *a = src + t * i_stride + x;
+            int b_pair = t + 1 < i_taps;
+            __m128i k = _mm_set1_epi32((uint16_t)coef[t] | (b_pair ? coef[t + 1] << 16 : 0));
+            __m128i va = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)a), zero);
+            __m128i vb = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(b_pair ? a + i_stride : a)), zero);
+
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(va, vb), k));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(va, vb), k));
+        }
+        lo = _mm_srai_epi32(lo, SCALE_BITS - SCALE_FRAC_8);
+        hi = _mm_srai_epi32(hi, SCALE_BITS - SCALE_FRAC_8);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packs_epi32(lo, hi));
+    }
+    vert8_c(dst + x, src + x, i_stride, coef, i_taps, i_width - x);
+}
+#endif
+
+static void horz8_c(uint8_t *dst, const uint16_t *src, const scale_filter_t *f, int i_width, int i_channels)
+{
+    int x, c, t;
+
+    for (x = 0; x < i_width; x++)
+    {
+        const uint16_t *s = src + f->pos[x] * i_channels;
+        const int16_t *coef = f->coef + x * f->i_taps;
+
+        for (c = 0; c < i_channels; c++)
+        {
+            int i_sum = 1 << (SCALE_BITS + SCALE_FRAC_8 - 1);
+
+            for (t = 0; t < f->i_taps; t++)
+                i_sum += coef[t] * s[t * i_channels + c];
+            *dst++ = X264_MIN(i_sum >> (SCALE_BITS + SCALE_FRAC_8), 255);
+        }
+    }
+}
+
+static void horz16_c(uint16_t *dst, const uint16_t *src, const scale_filter_t *f, int i_width, int i_channels)
+{
+    int x, c, t;
+
+    for (x = 0; x < i_width; x++)
+    {
+        const uint16_t *s = src + f->pos[x] * i_channels;
+        const int16_t *coef = f->coef + x * f->i_taps;
+
+        for (c = 0; c < i_channels; c++)
+        {
+            int i_sum = 1 << (SCALE_BITS - 1);
+
+            for (t = 0; t < f->i_taps; t++)
+                i_sum += coef[t] * s[t * i_channels + c];
+            *dst++ = X264_MIN(i_sum >> SCALE_BITS, 65535);
+        }
+    }
+}
+
+int x264vfw_scale_init(x264vfw_scale_t **p_scale, int i_csp, int i_src_width, int i_src_height,
+                       int i_dst_width, int i_dst_height, int cpu)
+{
+    x264vfw_scale_t *scale;
+    int i_h_shift[3], i_v_shift[3];
+    int i_tmp = 0;
+    int i;
+
+    *p_scale = NULL;
+    if (i_dst_width <= 0 || i_dst_height <= 0 || i_dst_width > i_src_width || i_dst_height > i_src_height)
+        return -1;
+    scale = calloc(1, sizeof(x264vfw_scale_t));
+    if (!scale)
+        return -1;
+    scale->i_planes = scale_layout(i_csp, scale->i_channels, i_h_shift, i_v_shift);
+    scale->b_high_depth = (i_csp & X264_CSP_HIGH_DEPTH) != 0;
+    for (i = 0; i < scale->i_planes; i++)
+    {
+        int i_src_h = (i_src_height + (1 << i_v_shift[i]) - 1) >> i_v_shift[i];
+
+        scale->i_src_width[i] = (i_src_width + (1 << i_h_shift[i]) - 1) >> i_h_shift[i];
+        scale->i_dst_width[i] = (i_dst_width + (1 << i_h_shift[i]) - 1) >> i_h_shift[i];
+        scale->i_dst_height[i] = (i_dst_height + (1 << i_v_shift[i]) - 1) >> i_v_shift[i];
+        if (filter_init(&scale->h[i], scale->i_src_width[i], scale->i_dst_width[i]) < 0 ||
+            filter_init(&scale->v[i], i_src_h, scale->i_dst_height[i]) < 0)
+        {
+            x264vfw_scale_close(scale);
+            return -1;
+        }
+        i_tmp = X264_MAX(i_tmp, scale->i_src_width[i] * scale->i_channels[i]);
+    }
+    scale->tmp = malloc(i_tmp * sizeof(uint16_t));
+    if (!scale->i_planes || !scale->tmp)
+    {
+        x264vfw_scale_close(scale);
+        return -1;
+    }
+
+    scale->vert = scale->b_high_depth ? vert16_c : vert8_c;
+#if HAVE_X86_SIMD
+    if (!scale->b_high_depth && (cpu & X264_CPU_SSE2))
+        scale->vert = vert8_sse2;
+#endif
+    *p_scale = scale;
+    return 0;
+}
+
+void x264vfw_scale_close(x264vfw_scale_t *scale)
+{
+    int i;
+
+    if (!scale)
+        return;
+    for (i = 0; i < 3; i++)
+    {
+        filter_close(&scale->h[i]);
+        filter_close(&scale->v[i]);
+    }
+    free(scale->tmp);
+    free(scale);
+}
+
+void x264vfw_scale_image(x264vfw_scale_t *scale, x264_image_t *dst, const x264_image_t *src)
+{
+    int i, y;
+
+    for (i = 0; i < scale->i_planes; i++)
+    {
+        const scale_filter_t *v = &scale->v[i];
+        int i_samples = scale->i_src_width[i] * scale->i_channels[i];
+
+        for (y = 0; y < scale->i_dst_height[i]; y++)
+        {
+            uint8_t *row = dst->plane[i] + y * dst->i_stride[i];
+
+            scale->vert(scale->tmp, src->plane[i] + v->pos[y] * src->i_stride[i], src->i_stride[i],
+                        v->coef + y * v->i_taps, v->i_taps, i_samples);
+            if (scale->b_high_depth)
+                horz16_c((uint16_t *)row, scale->tmp, &scale->h[i], scale->i_dst_width[i], scale->i_channels[i]);
+            else
+                horz8_c(row, scale->tmp, &scale->h[i], scale->i_dst_width[i], scale->i_channels[i]);
+        }
+    }
+}
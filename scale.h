@@ -0,0 +1,36 @@
+/*****************************************************************************
+ * scale.h: area downscaler for the renditions
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_SCALE_H
+#define X264VFW_SCALE_H
+
+#include "common.h"
+
+typedef struct x264vfw_scale_t x264vfw_scale_t;
+
+/* i_csp - x264 colorspace of both pictures (X264_CSP_*, with X264_CSP_HIGH_DEPTH for 16-bit samples),
+ * the destination can't be larger than the source, cpu - x264 cpu flags (X264_CPU_*) */
+int x264vfw_scale_init(x264vfw_scale_t **p_scale, int i_csp, int i_src_width, int i_src_height,
+                       int i_dst_width, int i_dst_height, int cpu);
+void x264vfw_scale_close(x264vfw_scale_t *scale);
+/* Every output pixel is the average of the input area it covers, one instance can't be used by several threads at once */
+void x264vfw_scale_image(x264vfw_scale_t *scale, x264_image_t *dst, const x264_image_t *src);
+
+#endif
@@ -0,0 +1,107 @@
+/*****************************************************************************
+ * sidecar.c: per-frame encode statistics stream
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "sidecar.h"
+#include "x264cli.h"
+
+#define SIDECAR_BUFFER_SIZE (64 * 1024)
+
+struct x264vfw_sidecar_t
+{
+    FILE *fh;
+    char *buf;
+    int i_frame;                /* output frame number */
+    int64_t i_freq;             /* ticks per second */
+    int64_t i_last_flush;
+    int64_t submit[X264VFW_SIDECAR_DELAY];
+};
+
+static int64_t sidecar_now(void)
+{
+    LARGE_INTEGER count;
+
+    QueryPerformanceCounter(&count);
+    return count.QuadPart;
+}
+
+int x264vfw_sidecar_open(x264vfw_sidecar_t **p_sidecar, const char *filename)
+{
+    x264vfw_sidecar_t *sidecar;
+    LARGE_INTEGER freq;
+
+    *p_sidecar = NULL;
+    sidecar = calloc(1, sizeof(x264vfw_sidecar_t));
+    if (!sidecar)
+        return -1;
+    sidecar->buf = malloc(SIDECAR_BUFFER_SIZE);
+    sidecar->fh = x264vfw_fopen(filename, "wb");
+    if (!sidecar->buf || !sidecar->fh)
+    {
+        if (sidecar->fh)
+            fclose(sidecar->fh);
+        free(sidecar->buf);
+        free(sidecar);
+        return -1;
+    }
+    setvbuf(sidecar->fh, sidecar->buf, _IOFBF, SIDECAR_BUFFER_SIZE);
+    QueryPerformanceFrequency(&freq);
+    sidecar->i_freq = freq.QuadPart;
+    sidecar->i_last_flush = sidecar_now();
+    *p_sidecar = sidecar;
+    return 0;
+}
+
+int x264vfw_sidecar_close(x264vfw_sidecar_t *sidecar)
+{
+    int i_ret;
+
+    if (!sidecar)
+        return 0;
+    i_ret = ferror(sidecar->fh) ? -1 : 0;
+    if (fclose(sidecar->fh))
+        i_ret = -1;
+    free(sidecar->buf);
+    free(sidecar);
+    return i_ret;
+}
+
+void x264vfw_sidecar_submit(x264vfw_sidecar_t *sidecar, int64_t i_pts)
+{
+    sidecar->submit[i_pts & (X264VFW_SIDECAR_DELAY - 1)] = sidecar_now();
+}
+
+void x264vfw_sidecar_frame(x264vfw_sidecar_t *sidecar, const x264_picture_t *pic_out, int i_frame_size)
+{
+    static const char * const type_names[] = { "auto", "IDR", "I", "P", "Bref", "B", "key" };
+    int64_t i_now = sidecar_now();
+    int i_type = pic_out->i_type;
+
+    fprintf(sidecar->fh, "{\"frame\":%d,\"type\":\"%s\",\"keyframe\":%d,\"size\":%d,\"crf\":%.2f,"
+                         "\"pts\":%"PRId64",\"dts\":%"PRId64",\"latency_ms\":%.3f}\n",
+            sidecar->i_frame++, i_type >= 0 && i_type < (int)ARRAY_ELEMS(type_names) ? type_names[i_type] : "?",
+            pic_out->b_keyframe, i_frame_size, pic_out->prop.f_crf_avg, pic_out->i_pts, pic_out->i_dts,
+            (i_now - sidecar->submit[pic_out->i_pts & (X264VFW_SIDECAR_DELAY - 1)]) * 1e3 / sidecar->i_freq);
+    /* Let readers tailing the file see the records at least twice a second */
+    if (i_now - sidecar->i_last_flush >= sidecar->i_freq / 2)
+    {
+        fflush(sidecar->fh);
+        sidecar->i_last_flush = i_now;
+    }
+}
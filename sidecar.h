@@ -0,0 +1,41 @@
+/*****************************************************************************
+ * sidecar.h: per-frame encode statistics stream
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_SIDECAR_H
+#define X264VFW_SIDECAR_H
+
+#include "common.h"
+#include <x264.h>
+
+/* Submission times are kept for this many frames in flight (power of 2) */
+#define X264VFW_SIDECAR_DELAY 1024
+
+typedef struct x264vfw_sidecar_t x264vfw_sidecar_t;
+
+/* One JSON object per line, written through a large stdio buffer */
+int x264vfw_sidecar_open(x264vfw_sidecar_t **p_sidecar, const char *filename);
+/* Returns -1 if any record couldn't be written */
+int x264vfw_sidecar_close(x264vfw_sidecar_t *sidecar);
+/* Called when the picture with this i_pts is passed to the encoder */
+void x264vfw_sidecar_submit(x264vfw_sidecar_t *sidecar, int64_t i_pts);
+/* Called for every encoded frame, not thread-safe against itself */
+void x264vfw_sidecar_frame(x264vfw_sidecar_t *sidecar, const x264_picture_t *pic_out, int i_frame_size);
+
+#endif
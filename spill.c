@@ -0,0 +1,144 @@
+/*****************************************************************************
+ * spill.c: memory-mapped spill file of raw pictures
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "spill.h"
+#include "x264cli.h"
+
+/* Only one window of the file is mapped at a time, so a long encode doesn't exhaust the address space */
+#define SPILL_WINDOW_SIZE (64 * 1024 * 1024)
+/* The file is extended by this many windows at once */
+#define SPILL_GROW_WINDOWS 4
+
+struct x264vfw_spill_t
+{
+    HANDLE hFile;
+    HANDLE hMap;
+    int64_t i_map_size;         /* size of hMap (and the file) */
+    int64_t i_window_size;      /* a multiple of the allocation granularity */
+    int i_window_records;       /* whole records in a window */
+    int i_record_size;
+    int i_count;                /* written records */
+    int i_window;               /* mapped window or -1 */
+    uint8_t *view;
+};
+
+int x264vfw_spill_open(x264vfw_spill_t **p_spill, const char *filename, int i_record_size)
+{
+    x264vfw_spill_t *spill;
+    wchar_t filename_utf16[MAX_PATH];
+    SYSTEM_INFO si;
+    int64_t i_granularity;
+
+    *p_spill = NULL;
+    if (i_record_size <= 0 || !utf8_to_utf16(filename, filename_utf16))
+        return -1;
+    spill = calloc(1, sizeof(x264vfw_spill_t));
+    if (!spill)
+        return -1;
+    spill->hFile = CreateFileW(filename_utf16, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (spill->hFile == INVALID_HANDLE_VALUE)
+    {
+        free(spill);
+        return -1;
+    }
+    GetSystemInfo(&si);
+    i_granularity = si.dwAllocationGranularity;
+    spill->i_record_size = i_record_size;
+    spill->i_window_records = X264_MAX(SPILL_WINDOW_SIZE / i_record_size, 1);
+    spill->i_window_size = ((int64_t)spill->i_window_records * i_record_size + i_granularity - 1) / i_granularity * i_granularity;
+    spill->i_window = -1;
+    *p_spill = spill;
+    return 0;
+}
+
+static void spill_unmap(x264vfw_spill_t *spill)
+{
+    if (spill->view)
+        UnmapViewOfFile(spill->view);
+    spill->view = NULL;
+    spill->i_window = -1;
+}
+
+void x264vfw_spill_close(x264vfw_spill_t *spill)
+{
+    if (!spill)
+        return;
+    spill_unmap(spill);
+    if (spill->hMap)
+        CloseHandle(spill->hMap);
+    CloseHandle(spill->hFile);
+    free(spill);
+}
+
+/* Maps window i_window, extending the file first if b_grow is set */
+static int spill_map(x264vfw_spill_t *spill, int i_window, int b_grow)
+{
+    int64_t i_offset = i_window * spill->i_window_size;
+
+    if (spill->i_window == i_window)
+        return 0;
+    spill_unmap(spill);
+    if (i_offset + spill->i_window_size > spill->i_map_size)
+    {
+        /* A mapping object can't be resized, a larger one extends the file */
+        int64_t i_size = i_offset + spill->i_window_size * SPILL_GROW_WINDOWS;
+
+        if (!b_grow)
+            return -1;
+        if (spill->hMap)
+            CloseHandle(spill->hMap);
+        spill->hMap = CreateFileMappingW(spill->hFile, NULL, PAGE_READWRITE, (DWORD)(i_size >> 32), (DWORD)i_size, NULL);
+        if (!spill->hMap)
+        {
+            spill->i_map_size = 0;
+            return -1;
+        }
+        spill->i_map_size = i_size;
+    }
+    spill->view = MapViewOfFile(spill->hMap, FILE_MAP_WRITE, (DWORD)(i_offset >> 32), (DWORD)i_offset, spill->i_window_size);
+    if (!spill->view)
+        return -1;
+    spill->i_window = i_window;
+    return 0;
+}
+
+uint8_t *x264vfw_spill_append(x264vfw_spill_t *spill)
+{
+    int i_window = spill->i_count / spill->i_window_records;
+
+    if (spill_map(spill, i_window, 1) < 0)
+        return NULL;
+    return spill->view + (int64_t)(spill->i_count++ - i_window * spill->i_window_records) * spill->i_record_size;
+}
+
+int x264vfw_spill_count(x264vfw_spill_t *spill)
+{
+    return spill->i_count;
+}
+
+const uint8_t *x264vfw_spill_record(x264vfw_spill_t *spill, int i_record)
+{
+    int i_window = i_record / spill->i_window_records;
+
+    if (i_record < 0 || i_record >= spill->i_count || spill_map(spill, i_window, 0) < 0)
+        return NULL;
+    return spill->view + (int64_t)(i_record - i_window * spill->i_window_records) * spill->i_record_size;
+}
@@ -0,0 +1,38 @@
+/*****************************************************************************
+ * spill.h: memory-mapped spill file of raw pictures
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_SPILL_H
+#define X264VFW_SPILL_H
+
+#include "common.h"
+
+/* Records of a fixed size are written sequentially and read back sequentially after all of them are written.
+ * The file is temporary and is deleted by x264vfw_spill_close. */
+typedef struct x264vfw_spill_t x264vfw_spill_t;
+
+int x264vfw_spill_open(x264vfw_spill_t **p_spill, const char *filename, int i_record_size);
+void x264vfw_spill_close(x264vfw_spill_t *spill);
+/* Returns the memory of the next record to be filled by the caller (valid until the next call) or NULL on error */
+uint8_t *x264vfw_spill_append(x264vfw_spill_t *spill);
+int x264vfw_spill_count(x264vfw_spill_t *spill);
+/* Returns the memory of record i_record (valid until the next call) or NULL on error */
+const uint8_t *x264vfw_spill_record(x264vfw_spill_t *spill, int i_record);
+
+#endif
@@ -0,0 +1,151 @@
+/*****************************************************************************
+ * telemetry.c: live encoder counters in shared memory
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "telemetry.h"
+
+struct x264vfw_telemetry_t
+{
+    HANDLE hMap;
+    x264vfw_telemetry_block_t *block;
+    CRITICAL_SECTION cs;            /* serializes writers (the calling and the encoder thread) */
+    int64_t i_freq;
+    int64_t i_start;                /* 0 until the first frame */
+};
+
+static volatile LONG telemetry_instances = -1;
+
+int x264vfw_telemetry_open(x264vfw_telemetry_t **p_telemetry, uint32_t i_fps_num, uint32_t i_fps_den)
+{
+    x264vfw_telemetry_t *telemetry;
+    wchar_t name[64];
+    LARGE_INTEGER freq;
+    int i_instance = (unsigned long)InterlockedIncrement(&telemetry_instances) % X264VFW_TELEMETRY_INSTANCES;
+
+    *p_telemetry = NULL;
+    telemetry = calloc(1, sizeof(x264vfw_telemetry_t));
+    if (!telemetry)
+        return -1;
+    _snwprintf(name, ARRAY_ELEMS(name), X264VFW_TELEMETRY_NAME, GetCurrentProcessId(), i_instance);
+    name[ARRAY_ELEMS(name) - 1] = 0;
+    telemetry->hMap = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(x264vfw_telemetry_block_t), name);
+    if (!telemetry->hMap)
+    {
+        free(telemetry);
+        return -1;
+    }
+    telemetry->block = MapViewOfFile(telemetry->hMap, FILE_MAP_WRITE, 0, 0, sizeof(x264vfw_telemetry_block_t));
+    if (!telemetry->block)
+    {
+        CloseHandle(telemetry->hMap);
+        free(telemetry);
+        return -1;
+    }
+    InitializeCriticalSection(&telemetry->cs);
+    QueryPerformanceFrequency(&freq);
+    telemetry->i_freq = freq.QuadPart;
+
+    /* A reader may still hold the block of a previous CODEC with the same instance number */
+    InterlockedIncrement(&telemetry->block->i_seq);
+    telemetry->block->i_version = X264VFW_TELEMETRY_VERSION;
+    telemetry->block->i_size = sizeof(x264vfw_telemetry_block_t);
+    telemetry->block->b_closed = 0;
+    telemetry->block->i_pid = GetCurrentProcessId();
+    telemetry->block->i_instance = i_instance;
+    telemetry->block->i_fps_num = i_fps_num;
+    telemetry->block->i_fps_den = i_fps_den;
+    telemetry->block->i_frames_in = 0;
+    telemetry->block->i_frames_out = 0;
+    telemetry->block->i_frames_dropped = 0;
+    telemetry->block->i_bytes_out = 0;
+    telemetry->block->i_queued = 0;
+    telemetry->block->i_delayed = 0;
+    telemetry->block->f_elapsed = 0.0;
+    telemetry->block->f_encode_fps = 0.0;
+    telemetry->block->f_bitrate = 0.0;
+    InterlockedIncrement(&telemetry->block->i_seq);
+
+    *p_telemetry = telemetry;
+    return 0;
+}
+
+void x264vfw_telemetry_close(x264vfw_telemetry_t *telemetry)
+{
+    if (!telemetry)
+        return;
+    InterlockedIncrement(&telemetry->block->i_seq);
+    telemetry->block->b_closed = 1;
+    InterlockedIncrement(&telemetry->block->i_seq);
+    UnmapViewOfFile(telemetry->block);
+    CloseHandle(telemetry->hMap);
+    DeleteCriticalSection(&telemetry->cs);
+    free(telemetry);
+}
+
+int x264vfw_telemetry_instance(x264vfw_telemetry_t *telemetry)
+{
+    return telemetry->block->i_instance;
+}
+
+/* Called inside the seqlock write section */
+static void telemetry_rates(x264vfw_telemetry_t *telemetry)
+{
+    x264vfw_telemetry_block_t *block = telemetry->block;
+    LARGE_INTEGER count;
+
+    QueryPerformanceCounter(&count);
+    if (!telemetry->i_start)
+        telemetry->i_start = count.QuadPart;
+    block->f_elapsed = (double)(count.QuadPart - telemetry->i_start) / telemetry->i_freq;
+    block->f_encode_fps = block->f_elapsed > 0.0 ? block->i_frames_out / block->f_elapsed : 0.0;
+    block->f_bitrate = block->i_frames_out > 0 && block->i_fps_den > 0
+                       ? block->i_bytes_out * 8.0 / 1000.0 * block->i_fps_num / block->i_fps_den / block->i_frames_out
+                       : 0.0;
+}
+
+void x264vfw_telemetry_encoded(x264vfw_telemetry_t *telemetry, int i_frame_size, int i_delayed)
+{
+    x264vfw_telemetry_block_t *block = telemetry->block;
+
+    EnterCriticalSection(&telemetry->cs);
+    InterlockedIncrement(&block->i_seq);
+    if (i_frame_size > 0)
+    {
+        block->i_frames_out++;
+        block->i_bytes_out += i_frame_size;
+    }
+    block->i_delayed = i_delayed;
+    telemetry_rates(telemetry);
+    InterlockedIncrement(&block->i_seq);
+    LeaveCriticalSection(&telemetry->cs);
+}
+
+void x264vfw_telemetry_update(x264vfw_telemetry_t *telemetry, int b_input, int i_queued, int i_dropped)
+{
+    x264vfw_telemetry_block_t *block = telemetry->block;
+
+    EnterCriticalSection(&telemetry->cs);
+    InterlockedIncrement(&block->i_seq);
+    block->i_frames_in += b_input;
+    block->i_queued = i_queued;
+    block->i_frames_dropped = i_dropped;
+    telemetry_rates(telemetry);
+    InterlockedIncrement(&block->i_seq);
+    LeaveCriticalSection(&telemetry->cs);
+}
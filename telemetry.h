@@ -0,0 +1,64 @@
+/*****************************************************************************
+ * telemetry.h: live encoder counters in shared memory
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_TELEMETRY_H
+#define X264VFW_TELEMETRY_H
+
+#include "common.h"
+
+/* Every CODEC with --telemetry publishes a block named with its process id and instance number */
+#define X264VFW_TELEMETRY_NAME      L"Local\\x264vfw_telemetry_%lu_%d"
+#define X264VFW_TELEMETRY_VERSION   1
+#define X264VFW_TELEMETRY_INSTANCES 64
+
+/* The writer makes i_seq odd while it updates the counters, readers retry until they get the same even i_seq
+ * before and after copying the block */
+typedef struct
+{
+    uint32_t i_version;
+    uint32_t i_size;                /* sizeof(x264vfw_telemetry_block_t) */
+    volatile LONG i_seq;
+    uint32_t b_closed;              /* compression has ended */
+    uint32_t i_pid;
+    int32_t i_instance;
+    uint32_t i_fps_num;
+    uint32_t i_fps_den;
+    int64_t i_frames_in;            /* frames passed to x264vfw_compress */
+    int64_t i_frames_out;           /* encoded frames */
+    int64_t i_frames_dropped;
+    int64_t i_bytes_out;
+    int32_t i_queued;               /* converted pictures waiting for the encoder (--async-pics) */
+    int32_t i_delayed;              /* x264_encoder_delayed_frames */
+    double f_elapsed;               /* seconds since the first frame */
+    double f_encode_fps;            /* encoded frames per second of f_elapsed */
+    double f_bitrate;               /* kbit/s at the nominal frame rate */
+} x264vfw_telemetry_block_t;
+
+typedef struct x264vfw_telemetry_t x264vfw_telemetry_t;
+
+int x264vfw_telemetry_open(x264vfw_telemetry_t **p_telemetry, uint32_t i_fps_num, uint32_t i_fps_den);
+void x264vfw_telemetry_close(x264vfw_telemetry_t *telemetry);
+int x264vfw_telemetry_instance(x264vfw_telemetry_t *telemetry);
+/* After every x264_encoder_encode call (in the thread which made it), i_frame_size is 0 if there is no output */
+void x264vfw_telemetry_encoded(x264vfw_telemetry_t *telemetry, int i_frame_size, int i_delayed);
+/* After every x264vfw_compress call */
+void x264vfw_telemetry_update(x264vfw_telemetry_t *telemetry, int b_input, int i_queued, int i_dropped);
+
+#endif
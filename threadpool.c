@@ -0,0 +1,167 @@
+/*****************************************************************************
+ * threadpool.c: worker thread pool
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "threadpool.h"
+#include <process.h>
+
+typedef struct
+{
+    x264vfw_threadpool_t *pool;
+    HANDLE thread;
+    HANDLE start;   /* auto-reset, signaled by x264vfw_threadpool_run */
+    HANDLE done;    /* auto-reset, signaled by worker after the batch */
+} threadpool_worker_t;
+
+struct x264vfw_threadpool_t
+{
+    int i_workers;
+    threadpool_worker_t worker[X264VFW_THREADPOOL_MAX];
+    HANDLE done[X264VFW_THREADPOOL_MAX];
+
+    /* Current batch */
+    x264vfw_threadpool_func_t func;
+    void *arg;
+    int i_jobs;
+    volatile LONG i_next_job;
+    volatile LONG b_exit;
+};
+
+int x264vfw_cpu_num_processors(void)
+{
+    SYSTEM_INFO si;
+
+    GetSystemInfo(&si);
+    return X264_MAX((int)si.dwNumberOfProcessors, 1);
+}
+
+static void threadpool_do_jobs(x264vfw_threadpool_t *pool)
+{
+    int i_job;
+
+    while ((i_job = InterlockedIncrement(&pool->i_next_job) - 1) < pool->i_jobs)
+        pool->func(pool->arg, i_job);
+}
+
+static unsigned __stdcall attribute_align_arg threadpool_worker(void *arg)
+{
+    threadpool_worker_t *worker = arg;
+    x264vfw_threadpool_t *pool = worker->pool;
+
+    for (;;)
+    {
+        WaitForSingleObject(worker->start, INFINITE);
+        if (pool->b_exit)
+            break;
+        threadpool_do_jobs(pool);
+        SetEvent(worker->done);
+    }
+    return 0;
+}
+
+int x264vfw_threadpool_init(x264vfw_threadpool_t **p_pool, int i_threads)
+{
+    x264vfw_threadpool_t *pool;
+    int i;
+
+    *p_pool = NULL;
+    i_threads = X264_CLIP(i_threads, 1, X264VFW_THREADPOOL_MAX + 1);
+    pool = calloc(1, sizeof(x264vfw_threadpool_t));
+    if (!pool)
+        return -1;
+
+    for (i = 0; i < i_threads - 1; i++)
+    {
+        threadpool_worker_t *worker = &pool->worker[i];
+
+        worker->pool = pool;
+        worker->start = CreateEvent(NULL, FALSE, FALSE, NULL);
+        worker->done = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (worker->start && worker->done)
+            worker->thread = (HANDLE)_beginthreadex(NULL, 0, threadpool_worker, worker, 0, NULL);
+        if (!worker->thread)
+        {
+            if (worker->start)
+                CloseHandle(worker->start);
+            if (worker->done)
+                CloseHandle(worker->done);
+            break;
+        }
+        pool->done[i] = worker->done;
+        pool->i_workers++;
+    }
+
+    if (pool->i_workers < i_threads - 1)
+    {
+        x264vfw_threadpool_delete(pool);
+        return -1;
+    }
+    *p_pool = pool;
+    return 0;
+}
+
+void x264vfw_threadpool_delete(x264vfw_threadpool_t *pool)
+{
+    int i;
+
+    if (!pool)
+        return;
+
+    InterlockedExchange(&pool->b_exit, 1);
+    for (i = 0; i < pool->i_workers; i++)
+        SetEvent(pool->worker[i].start);
+    for (i = 0; i < pool->i_workers; i++)
+    {
+        WaitForSingleObject(pool->worker[i].thread, INFINITE);
+        CloseHandle(pool->worker[i].thread);
+        CloseHandle(pool->worker[i].start);
+        CloseHandle(pool->worker[i].done);
+    }
+    free(pool);
+}
+
+int x264vfw_threadpool_threads(x264vfw_threadpool_t *pool)
+{
+    return pool ? pool->i_workers + 1 : 1;
+}
+
+void x264vfw_threadpool_run(x264vfw_threadpool_t *pool, x264vfw_threadpool_func_t func, void *arg, int i_jobs)
+{
+    int i_wake;
+    int i;
+
+    if (!pool || pool->i_workers == 0 || i_jobs <= 1)
+    {
+        for (i = 0; i < i_jobs; i++)
+            func(arg, i);
+        return;
+    }
+
+    pool->func = func;
+    pool->arg = arg;
+    pool->i_jobs = i_jobs;
+    InterlockedExchange(&pool->i_next_job, 0);
+
+    /* The calling thread takes jobs too so only wake as many workers as can get one */
+    i_wake = X264_MIN(pool->i_workers, i_jobs - 1);
+    for (i = 0; i < i_wake; i++)
+        SetEvent(pool->worker[i].start);
+    threadpool_do_jobs(pool);
+    WaitForMultipleObjects(i_wake, pool->done, TRUE, INFINITE);
+}
@@ -0,0 +1,43 @@
+/*****************************************************************************
+ * threadpool.h: worker thread pool
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_THREADPOOL_H
+#define X264VFW_THREADPOOL_H
+
+#include "common.h"
+
+#define X264VFW_THREADPOOL_MAX 64 /* WaitForMultipleObjects limit */
+
+typedef struct x264vfw_threadpool_t x264vfw_threadpool_t;
+
+/* Job callback: arg is passed unchanged, i_job is in [0, i_jobs) */
+typedef void (*x264vfw_threadpool_func_t)(void *arg, int i_job);
+
+/* Number of logical processors */
+int x264vfw_cpu_num_processors(void);
+
+/* i_threads - total number of threads running jobs including the calling one */
+int x264vfw_threadpool_init(x264vfw_threadpool_t **p_pool, int i_threads);
+void x264vfw_threadpool_delete(x264vfw_threadpool_t *pool);
+int x264vfw_threadpool_threads(x264vfw_threadpool_t *pool);
+/* Runs func for every job index and returns when all of them are done */
+void x264vfw_threadpool_run(x264vfw_threadpool_t *pool, x264vfw_threadpool_func_t func, void *arg, int i_jobs);
+
+#endif
@@ -0,0 +1,730 @@
+/*****************************************************************************
+ * bench_csp.c: colorspace conversion benchmark and C/SIMD checker
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+/* Standalone host tool (no Windows or libx264 needed), build with "make bench_csp":
+ *   bench_csp check [filter]  - compare every SIMD converter against the C one (checkasm-style)
+ *   bench_csp bench [filter]  - cycles/pixel and GB/s from 480p to 8K with vflip off/on
+ * filter is a substring of the "src->dst" converter name, e.g. "bgra->",
+ * the decoder output converters are named "dec-src->dst", e.g. "dec-i420->bgra",
+ * the rendition scaler is checked as "scale->csp", e.g. "scale->nv12" */
+
+#include "csp.h"
+#include "dcsp.h"
+#include "scale.h"
+
+#ifdef _WIN32
+#include <intrin.h>
+#else
+#include <time.h>
+#if HAVE_X86_SIMD
+#include <x86intrin.h>
+#endif
+#endif
+
+#if X264_BIT_DEPTH > 8
+#define OUT_DEPTH X264_CSP_HIGH_DEPTH
+#define OUT_PIXEL_SIZE 2
+#else
+#define OUT_DEPTH 0
+#define OUT_PIXEL_SIZE 1
+#endif
+
+#define PAD 64 /* bytes after every row so that overwrites show up as mismatches */
+
+static const char * const src_names[X264VFW_CSP_MAX] =
+{
+    "none", "i420", "yv12", "yv16", "yv24", "nv12", "yuyv", "uyvy", "bgr", "bgra",
+    "p010", "p210", "v210", "y416", "b48r", "b64a", "i422", "i444"
+};
+
+static const struct
+{
+    const char *name;
+    int i_csp;
+} dst_list[] =
+{
+    { "i420", X264_CSP_I420 },
+    { "nv12", X264_CSP_NV12 },
+    { "i422", X264_CSP_I422 },
+    { "i444", X264_CSP_I444 },
+    { "bgr",  X264_CSP_BGR  },
+    { "bgra", X264_CSP_BGRA },
+};
+
+/* Decoder output converters, the pictures use the VFW layouts of src_layout */
+static const struct
+{
+    const char *name;
+    int i_csp;
+} dec_src_list[] =
+{
+    { "dec-i420", X264VFW_CSP_I420 },
+    { "dec-nv12", X264VFW_CSP_NV12 },
+};
+
+static const int dec_dst_list[] = { X264VFW_CSP_BGR, X264VFW_CSP_BGRA, X264VFW_CSP_YUYV, X264VFW_CSP_UYVY };
+
+static const struct
+{
+    const char *name;
+    int cpu;
+} cpu_list[] =
+{
+    { "sse2",  X264_CPU_SSE2 },
+    { "ssse3", X264_CPU_SSE2 | X264_CPU_SSSE3 },
+    { "avx2",  X264_CPU_SSE2 | X264_CPU_SSSE3 | X264_CPU_AVX2 },
+};
+
+static const struct
+{
+    int i_width;
+    int i_height;
+} res_list[] =
+{
+    {  640,  480 },
+    { 1280,  720 },
+    { 1920, 1080 },
+    { 3840, 2160 },
+    { 7680, 4320 },
+};
+
+typedef struct
+{
+    x264_image_t img;
+    uint8_t *buf;
+    size_t i_size;
+} picture_t;
+
+static int cpu_detect( void )
+{
+    int cpu = 0;
+#if HAVE_X86_SIMD && defined(__GNUC__)
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "sse2" ) )
+        cpu |= X264_CPU_SSE2;
+    if( __builtin_cpu_supports( "ssse3" ) )
+        cpu |= X264_CPU_SSSE3;
+    if( __builtin_cpu_supports( "avx2" ) )
+        cpu |= X264_CPU_AVX2;
+#elif HAVE_X86_SIMD
+    int info[4];
+    __cpuid( info, 1 );
+    if( info[3] & (1 << 26) )
+        cpu |= X264_CPU_SSE2;
+    if( info[2] & (1 << 9) )
+        cpu |= X264_CPU_SSSE3;
+    __cpuidex( info, 7, 0 );
+    if( info[1] & (1 << 5) )
+        cpu |= X264_CPU_AVX2;
+#endif
+    return cpu;
+}
+
+static double time_now( void )
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency( &freq );
+    QueryPerformanceCounter( &count );
+    return (double)count.QuadPart / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static uint64_t cycles_now( void )
+{
+#if HAVE_X86_SIMD
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Same layouts as the codec gets from VFW (see x264vfw_img_fill in codec.c) with PAD extra bytes per row */
+static int src_layout( x264_image_t *img, int i_csp, int i_width, int i_height, int *p_chroma_h )
+{
+    int i_chroma_h = i_height;
+
+    memset( img, 0, sizeof(x264_image_t) );
+    img->i_csp = i_csp;
+    switch( i_csp & X264VFW_CSP_MASK )
+    {
+        case X264VFW_CSP_I420:
+        case X264VFW_CSP_YV12:
+            i_chroma_h = i_height / 2;
+        case X264VFW_CSP_I422:
+        case X264VFW_CSP_YV16:
+            img->i_plane = 3;
+            img->i_stride[0] = i_width + PAD;
+            img->i_stride[1] = img->i_stride[2] = i_width / 2 + PAD;
+            break;
+        case X264VFW_CSP_I444:
+        case X264VFW_CSP_YV24:
+            img->i_plane = 3;
+            img->i_stride[0] = img->i_stride[1] = img->i_stride[2] = i_width + PAD;
+            break;
+        case X264VFW_CSP_NV12:
+            i_chroma_h = i_height / 2;
+            img->i_plane = 2;
+            img->i_stride[0] = img->i_stride[1] = i_width + PAD;
+            break;
+        case X264VFW_CSP_P010:
+            i_chroma_h = i_height / 2;
+        case X264VFW_CSP_P210:
+            img->i_plane = 2;
+            img->i_stride[0] = img->i_stride[1] = 2 * i_width + PAD;
+            break;
+        case X264VFW_CSP_YUYV:
+        case X264VFW_CSP_UYVY:
+            img->i_plane = 1;
+            img->i_stride[0] = 2 * i_width + PAD;
+            break;
+        case X264VFW_CSP_BGR:
+            img->i_plane = 1;
+            img->i_stride[0] = ((3 * i_width + 3) & ~3) + PAD;
+            break;
+        case X264VFW_CSP_BGRA:
+            img->i_plane = 1;
+            img->i_stride[0] = 4 * i_width + PAD;
+            break;
+        case X264VFW_CSP_V210:
+            img->i_plane = 1;
+            img->i_stride[0] = (i_width + 47) / 48 * 128 + PAD;
+            break;
+        case X264VFW_CSP_Y416:
+        case X264VFW_CSP_B64A:
+            img->i_plane = 1;
+            img->i_stride[0] = 8 * i_width + PAD;
+            break;
+        case X264VFW_CSP_B48R:
+            img->i_plane = 1;
+            img->i_stride[0] = 6 * i_width + PAD;
+            break;
+        default:
+            return -1;
+    }
+    *p_chroma_h = i_chroma_h;
+    return 0;
+}
+
+/* Odd sizes (scaler checks) round the subsampled chroma planes up */
+static int dst_layout( x264_image_t *img, int i_csp, int i_width, int i_height, int *p_chroma_h )
+{
+    int i_chroma_h = i_height;
+
+    memset( img, 0, sizeof(x264_image_t) );
+    img->i_csp = i_csp;
+    switch( i_csp & X264_CSP_MASK )
+    {
+        case X264_CSP_I420:
+            i_chroma_h = (i_height + 1) / 2;
+        case X264_CSP_I422:
+            img->i_plane = 3;
+            img->i_stride[0] = i_width * OUT_PIXEL_SIZE + PAD;
+            img->i_stride[1] = img->i_stride[2] = (i_width + 1) / 2 * OUT_PIXEL_SIZE + PAD;
+            break;
+        case X264_CSP_I444:
+            img->i_plane = 3;
+            img->i_stride[0] = img->i_stride[1] = img->i_stride[2] = i_width * OUT_PIXEL_SIZE + PAD;
+            break;
+        case X264_CSP_NV12:
+            i_chroma_h = (i_height + 1) / 2;
+            img->i_plane = 2;
+            img->i_stride[0] = i_width * OUT_PIXEL_SIZE + PAD;
+            img->i_stride[1] = (i_width + 1) / 2 * 2 * OUT_PIXEL_SIZE + PAD;
+            break;
+        case X264_CSP_BGR:
+            img->i_plane = 1;
+            img->i_stride[0] = 3 * i_width * OUT_PIXEL_SIZE + PAD;
+            break;
+        case X264_CSP_BGRA:
+            img->i_plane = 1;
+            img->i_stride[0] = 4 * i_width * OUT_PIXEL_SIZE + PAD;
+            break;
+        default:
+            return -1;
+    }
+    *p_chroma_h = i_chroma_h;
+    return 0;
+}
+
+static int picture_alloc( picture_t *pic, int b_src, int i_csp, int i_width, int i_height )
+{
+    int i_chroma_h;
+    int i;
+
+    if( (b_src ? src_layout : dst_layout)( &pic->img, i_csp, i_width, i_height, &i_chroma_h ) < 0 )
+        return -1;
+    pic->i_size = 0;
+    for( i = 0; i < pic->img.i_plane; i++ )
+        pic->i_size += (size_t)pic->img.i_stride[i] * (i ? i_chroma_h : i_height);
+    pic->buf = malloc( pic->i_size );
+    if( !pic->buf )
+        return -1;
+    pic->img.plane[0] = pic->buf;
+    for( i = 1; i < pic->img.i_plane; i++ )
+        pic->img.plane[i] = pic->img.plane[i-1] + (size_t)pic->img.i_stride[i-1] * (i > 1 ? i_chroma_h : i_height);
+    return 0;
+}
+
+static void picture_free( picture_t *pic )
+{
+    free( pic->buf );
+    pic->buf = NULL;
+}
+
+static uint32_t rand_state = 1;
+
+static uint32_t rand_next( void )
+{
+    rand_state = rand_state * 1664525 + 1013904223;
+    return rand_state >> 8;
+}
+
+static void fill_random( uint8_t *buf, size_t i_size )
+{
+    size_t i;
+    for( i = 0; i < i_size; i++ )
+        buf[i] = rand_next();
+}
+
+static int name_match( const char *filter, const char *src, const char *dst )
+{
+    char name[32];
+    if( !filter )
+        return 1;
+    snprintf( name, sizeof(name), "%s->%s", src, dst );
+    return strstr( name, filter ) != NULL;
+}
+
+/* Converts in row bands of random even height to also test the [i_y0, i_y1) entry points */
+static int convert_bands( x264vfw_csp_t convert, picture_t *dst, picture_t *src, int i_width, int i_height, int b_bands )
+{
+    int i_y0, i_y1;
+
+    memset( dst->buf, 0xAA, dst->i_size );
+    if( !b_bands )
+        return convert( &dst->img, &src->img, i_width, i_height, 0, i_height );
+    for( i_y0 = 0; i_y0 < i_height; i_y0 = i_y1 )
+    {
+        i_y1 = i_y0 + 2 + 2 * (rand_next() % 4);
+        i_y1 = X264_MIN( i_y1, i_height );
+        if( convert( &dst->img, &src->img, i_width, i_height, i_y0, i_y1 ) < 0 )
+            return -1;
+    }
+    return 0;
+}
+
+static int check( const char *filter, int cpu )
+{
+    int i_fails = 0;
+    int s, d, c, i;
+
+    for( d = 0; d < (int)ARRAY_ELEMS(dst_list); d++ )
+        for( s = 1; s < X264VFW_CSP_MAX; s++ )
+        {
+            int b_ok = 1, b_tested = 0;
+            if( !name_match( filter, src_names[s], dst_list[d].name ) )
+                continue;
+            for( i = 0; i < 64 && b_ok; i++ )
+            {
+                int i_width   = 2 + 2 * (rand_next() % 160);
+                int i_height  = 2 + 2 * (rand_next() % 24);
+                int i_vflip   = (i & 1) ? X264VFW_CSP_VFLIP : 0;
+                int i_matrix  = (i >> 1) & 1;
+                int b_range   = (i >> 2) & 1;
+                int i_out_csp = dst_list[d].i_csp | OUT_DEPTH;
+                x264vfw_csp_function_t ref_pf;
+                picture_t src, ref, out;
+
+                if( picture_alloc( &src, 1, s | i_vflip, i_width, i_height ) < 0 ||
+                    picture_alloc( &ref, 0, i_out_csp, i_width, i_height ) < 0 ||
+                    picture_alloc( &out, 0, i_out_csp, i_width, i_height ) < 0 )
+                {
+                    fprintf( stderr, "bench_csp: out of memory\n" );
+                    exit( 1 );
+                }
+                fill_random( src.buf, src.i_size );
+                x264vfw_csp_init( &ref_pf, i_out_csp, i_matrix, b_range, 0 );
+                if( convert_bands( ref_pf.convert[s], &ref, &src, i_width, i_height, 0 ) == 0 )
+                {
+                    for( c = 0; c < (int)ARRAY_ELEMS(cpu_list) && b_ok; c++ )
+                    {
+                        x264vfw_csp_function_t pf;
+                        if( (cpu_list[c].cpu & cpu) != cpu_list[c].cpu )
+                            continue;
+                        x264vfw_csp_init( &pf, i_out_csp, i_matrix, b_range, cpu_list[c].cpu );
+                        if( convert_bands( pf.convert[s], &out, &src, i_width, i_height, 1 ) < 0 ||
+                            memcmp( ref.buf, out.buf, ref.i_size ) )
+                        {
+                            printf( "  %s->%s %s: FAILED %dx%d vflip=%d matrix=%d fullrange=%d\n",
+                                    src_names[s], dst_list[d].name, cpu_list[c].name,
+                                    i_width, i_height, !!i_vflip, i_matrix, b_range );
+                            b_ok = 0;
+                        }
+                    }
+                    /* Changed tiles path of --static-frames */
+                    if( b_ok )
+                    {
+                        int i_x0 = 2 * (rand_next() % (i_width / 2));
+                        int i_x1 = i_x0 + 2 + 2 * (rand_next() % ((i_width - i_x0) / 2));
+                        int i_y0 = 2 * (rand_next() % (i_height / 2));
+                        int i_y1 = i_y0 + 2 + 2 * (rand_next() % ((i_height - i_y0) / 2));
+                        if( s == X264VFW_CSP_V210 )
+                        {
+                            i_x0 = i_x0 / 6 * 6;
+                            i_x1 = X264_MIN( (i_x1 + 5) / 6 * 6, i_width );
+                        }
+                        memcpy( out.buf, ref.buf, ref.i_size );
+                        x264vfw_csp_init( &ref_pf, i_out_csp, i_matrix, b_range, cpu );
+                        if( x264vfw_csp_convert_rect( &ref_pf, &out.img, &src.img, i_width, i_height, i_x0, i_x1, i_y0, i_y1 ) == 0 &&
+                            memcmp( ref.buf, out.buf, ref.i_size ) )
+                        {
+                            printf( "  %s->%s rect: FAILED %dx%d [%d,%d)x[%d,%d) vflip=%d\n",
+                                    src_names[s], dst_list[d].name, i_width, i_height,
+                                    i_x0, i_x1, i_y0, i_y1, !!i_vflip );
+                            b_ok = 0;
+                        }
+                    }
+                    b_tested = 1;
+                }
+                picture_free( &src );
+                picture_free( &ref );
+                picture_free( &out );
+            }
+            if( b_tested )
+                printf( "%s %s->%s\n", b_ok ? "ok    " : "FAILED", src_names[s], dst_list[d].name );
+            i_fails += !b_ok;
+        }
+    return i_fails;
+}
+
+static int check_dcsp( const char *filter, int cpu )
+{
+    static const int matrix_list[] = { 1, 6, 9 };
+    int i_fails = 0;
+    int s, d, c, i;
+
+    for( s = 0; s < (int)ARRAY_ELEMS(dec_src_list); s++ )
+        for( d = 0; d < (int)ARRAY_ELEMS(dec_dst_list); d++ )
+        {
+            const char *dst_name = src_names[dec_dst_list[d]];
+            int b_ok = 1;
+            if( !name_match( filter, dec_src_list[s].name, dst_name ) )
+                continue;
+            for( i = 0; i < 64 && b_ok; i++ )
+            {
+                int i_width  = 2 + 2 * (rand_next() % 160);
+                int i_height = 2 + 2 * (rand_next() % 24);
+                int i_vflip  = (i & 1) ? X264VFW_CSP_VFLIP : 0;
+                int i_matrix = matrix_list[(i >> 1) % 3];
+                int b_range  = (i >> 2) & 1;
+                x264vfw_dcsp_function_t ref_pf;
+                picture_t src, ref, out;
+
+                if( picture_alloc( &src, 1, dec_src_list[s].i_csp, i_width, i_height ) < 0 ||
+                    picture_alloc( &ref, 1, dec_dst_list[d] | i_vflip, i_width, i_height ) < 0 ||
+                    picture_alloc( &out, 1, dec_dst_list[d] | i_vflip, i_width, i_height ) < 0 )
+                {
+                    fprintf( stderr, "bench_csp: out of memory\n" );
+                    exit( 1 );
+                }
+                fill_random( src.buf, src.i_size );
+                memset( ref.buf, 0xAA, ref.i_size );
+                x264vfw_dcsp_init( &ref_pf, dec_src_list[s].i_csp, i_matrix, b_range, 0 );
+                x264vfw_dcsp_convert( &ref_pf, &ref.img, &src.img, i_width, i_height );
+                for( c = 0; c < (int)ARRAY_ELEMS(cpu_list) && b_ok; c++ )
+                {
+                    x264vfw_dcsp_function_t pf;
+                    if( (cpu_list[c].cpu & cpu) != cpu_list[c].cpu )
+                        continue;
+                    memset( out.buf, 0xAA, out.i_size );
+                    x264vfw_dcsp_init( &pf, dec_src_list[s].i_csp, i_matrix, b_range, cpu_list[c].cpu );
+                    if( x264vfw_dcsp_convert( &pf, &out.img, &src.img, i_width, i_height ) < 0 ||
+                        memcmp( ref.buf, out.buf, ref.i_size ) )
+                    {
+                        printf( "  %s->%s %s: FAILED %dx%d vflip=%d matrix=%d fullrange=%d\n",
+                                dec_src_list[s].name, dst_name, cpu_list[c].name,
+                                i_width, i_height, !!i_vflip, i_matrix, b_range );
+                        b_ok = 0;
+                    }
+                }
+                picture_free( &src );
+                picture_free( &ref );
+                picture_free( &out );
+            }
+            printf( "%s %s->%s\n", b_ok ? "ok    " : "FAILED", dec_src_list[s].name, dst_name );
+            i_fails += !b_ok;
+        }
+    return i_fails;
+}
+
+/* Rendition scaler: odd sizes, ratios from 1:1 down to 1-pixel destinations, upscales must be refused */
+static int check_scale( const char *filter, int cpu )
+{
+    int i_fails = 0;
+    int d, c, i;
+
+    for( d = 0; d < (int)ARRAY_ELEMS(dst_list); d++ )
+    {
+        int i_csp = dst_list[d].i_csp | OUT_DEPTH;
+        int b_ok = 1;
+        if( !name_match( filter, "scale", dst_list[d].name ) )
+            continue;
+        for( i = 0; i < 64 && b_ok; i++ )
+        {
+            int i_src_width  = 1 + rand_next() % 320;
+            int i_src_height = 1 + rand_next() % 48;
+            int i_dst_width  = 1 + rand_next() % i_src_width;
+            int i_dst_height = 1 + rand_next() % i_src_height;
+            x264vfw_scale_t *scale;
+            picture_t src, ref, out;
+
+            switch( i & 3 )
+            {
+                case 1: i_dst_width = i_src_width; i_dst_height = i_src_height; break;
+                case 2: i_dst_width = 1; break;
+                case 3: i_dst_height = 1; break;
+            }
+            if( x264vfw_scale_init( &scale, i_csp, i_dst_width, i_dst_height, i_src_width + 1, i_dst_height, 0 ) == 0 ||
+                x264vfw_scale_init( &scale, i_csp, i_dst_width, i_dst_height, i_dst_width, i_dst_height + 1, 0 ) == 0 )
+            {
+                printf( "  scale->%s: FAILED %dx%d upscale accepted\n", dst_list[d].name, i_dst_width, i_dst_height );
+                x264vfw_scale_close( scale );
+                b_ok = 0;
+                break;
+            }
+            if( picture_alloc( &src, 0, i_csp, i_src_width, i_src_height ) < 0 ||
+                picture_alloc( &ref, 0, i_csp, i_dst_width, i_dst_height ) < 0 ||
+                picture_alloc( &out, 0, i_csp, i_dst_width, i_dst_height ) < 0 ||
+                x264vfw_scale_init( &scale, i_csp, i_src_width, i_src_height, i_dst_width, i_dst_height, 0 ) < 0 )
+            {
+                fprintf( stderr, "bench_csp: out of memory\n" );
+                exit( 1 );
+            }
+            fill_random( src.buf, src.i_size );
+            memset( ref.buf, 0xAA, ref.i_size );
+            x264vfw_scale_image( scale, &ref.img, &src.img );
+            x264vfw_scale_close( scale );
+            for( c = 0; c < (int)ARRAY_ELEMS(cpu_list) && b_ok; c++ )
+            {
+                if( (cpu_list[c].cpu & cpu) != cpu_list[c].cpu )
+                    continue;
+                if( x264vfw_scale_init( &scale, i_csp, i_src_width, i_src_height, i_dst_width, i_dst_height, cpu_list[c].cpu ) < 0 )
+                {
+                    fprintf( stderr, "bench_csp: out of memory\n" );
+                    exit( 1 );
+                }
+                memset( out.buf, 0xAA, out.i_size );
+                x264vfw_scale_image( scale, &out.img, &src.img );
+                x264vfw_scale_close( scale );
+                if( memcmp( ref.buf, out.buf, ref.i_size ) )
+                {
+                    printf( "  scale->%s %s: FAILED %dx%d -> %dx%d\n", dst_list[d].name, cpu_list[c].name,
+                            i_src_width, i_src_height, i_dst_width, i_dst_height );
+                    b_ok = 0;
+                }
+            }
+            picture_free( &src );
+            picture_free( &ref );
+            picture_free( &out );
+        }
+        printf( "%s scale->%s\n", b_ok ? "ok    " : "FAILED", dst_list[d].name );
+        i_fails += !b_ok;
+    }
+    return i_fails;
+}
+
+static void bench_one( x264vfw_csp_t convert, picture_t *dst, picture_t *src, int i_width, int i_height,
+                       double *p_cpp, double *p_gbps )
+{
+    int i_iters = 0;
+    double t0, t1;
+    uint64_t c0, c1;
+
+    convert( &dst->img, &src->img, i_width, i_height, 0, i_height ); /* warm up */
+    t0 = time_now();
+    c0 = cycles_now();
+    do
+    {
+        convert( &dst->img, &src->img, i_width, i_height, 0, i_height );
+        i_iters++;
+        t1 = time_now();
+    } while( t1 - t0 < 0.25 || i_iters < 3 );
+    c1 = cycles_now();
+    *p_cpp = (double)(c1 - c0) / ((double)i_iters * i_width * i_height);
+    *p_gbps = (double)(src->i_size + dst->i_size) * i_iters / (t1 - t0) * 1e-9;
+}
+
+static void bench( const char *filter, int cpu )
+{
+    const char *cpu_name = "c";
+    int s, d, r, v, c;
+
+    for( c = 0; c < (int)ARRAY_ELEMS(cpu_list); c++ )
+        if( (cpu_list[c].cpu & cpu) == cpu_list[c].cpu )
+            cpu_name = cpu_list[c].name;
+    printf( "%-12s %-10s %-5s %10s %8s %11s %8s\n", "converter", "size", "vflip",
+            "c cyc/px", "c GB/s", "simd cyc/px", "GB/s" );
+    for( d = 0; d < (int)ARRAY_ELEMS(dst_list); d++ )
+        for( s = 1; s < X264VFW_CSP_MAX; s++ )
+        {
+            char name[32];
+            if( !name_match( filter, src_names[s], dst_list[d].name ) )
+                continue;
+            snprintf( name, sizeof(name), "%s->%s", src_names[s], dst_list[d].name );
+            for( r = 0; r < (int)ARRAY_ELEMS(res_list); r++ )
+                for( v = 0; v < 2; v++ )
+                {
+                    int i_width  = res_list[r].i_width;
+                    int i_height = res_list[r].i_height;
+                    int i_out_csp = dst_list[d].i_csp | OUT_DEPTH;
+                    x264vfw_csp_function_t pf_c, pf_simd;
+                    double c_cpp, c_gbps, simd_cpp, simd_gbps;
+                    picture_t src, dst;
+                    char size[16];
+
+                    x264vfw_csp_init( &pf_c, i_out_csp, 0, 0, 0 );
+                    x264vfw_csp_init( &pf_simd, i_out_csp, 0, 0, cpu );
+                    if( picture_alloc( &src, 1, s | (v ? X264VFW_CSP_VFLIP : 0), i_width, i_height ) < 0 ||
+                        picture_alloc( &dst, 0, i_out_csp, i_width, i_height ) < 0 )
+                    {
+                        fprintf( stderr, "bench_csp: out of memory\n" );
+                        exit( 1 );
+                    }
+                    fill_random( src.buf, src.i_size );
+                    if( pf_c.convert[s]( &dst.img, &src.img, i_width, i_height, 0, i_height ) == 0 )
+                    {
+                        bench_one( pf_c.convert[s], &dst, &src, i_width, i_height, &c_cpp, &c_gbps );
+                        snprintf( size, sizeof(size), "%dx%d", i_width, i_height );
+                        if( pf_simd.convert[s] != pf_c.convert[s] )
+                        {
+                            bench_one( pf_simd.convert[s], &dst, &src, i_width, i_height, &simd_cpp, &simd_gbps );
+                            printf( "%-12s %-10s %-5s %10.3f %8.2f %11.3f %8.2f (%s)\n", name, size, v ? "yes" : "no",
+                                    c_cpp, c_gbps, simd_cpp, simd_gbps, cpu_name );
+                        }
+                        else
+                            printf( "%-12s %-10s %-5s %10.3f %8.2f %11s %8s\n", name, size, v ? "yes" : "no",
+                                    c_cpp, c_gbps, "-", "-" );
+                        fflush( stdout );
+                    }
+                    picture_free( &src );
+                    picture_free( &dst );
+                }
+        }
+}
+
+static double dcsp_time( x264vfw_dcsp_function_t *pf, picture_t *dst, picture_t *src, int i_width, int i_height,
+                         double *p_cpp )
+{
+    int i_iters = 0;
+    double t0, t1;
+    uint64_t c0, c1;
+
+    x264vfw_dcsp_convert( pf, &dst->img, &src->img, i_width, i_height ); /* warm up */
+    t0 = time_now();
+    c0 = cycles_now();
+    do
+    {
+        x264vfw_dcsp_convert( pf, &dst->img, &src->img, i_width, i_height );
+        i_iters++;
+        t1 = time_now();
+    } while( t1 - t0 < 0.25 || i_iters < 3 );
+    c1 = cycles_now();
+    *p_cpp = (double)(c1 - c0) / ((double)i_iters * i_width * i_height);
+    return (double)(src->i_size + dst->i_size) * i_iters / (t1 - t0) * 1e-9;
+}
+
+static void bench_dcsp( const char *filter, int cpu )
+{
+    int s, d, r, v;
+
+    for( s = 0; s < (int)ARRAY_ELEMS(dec_src_list); s++ )
+        for( d = 0; d < (int)ARRAY_ELEMS(dec_dst_list); d++ )
+        {
+            const char *dst_name = src_names[dec_dst_list[d]];
+            char name[32];
+            if( !name_match( filter, dec_src_list[s].name, dst_name ) )
+                continue;
+            snprintf( name, sizeof(name), "%s->%s", dec_src_list[s].name, dst_name );
+            for( r = 0; r < (int)ARRAY_ELEMS(res_list); r++ )
+                for( v = 0; v < 2; v++ )
+                {
+                    int i_width  = res_list[r].i_width;
+                    int i_height = res_list[r].i_height;
+                    x264vfw_dcsp_function_t pf_c, pf_simd;
+                    double c_cpp, c_gbps, simd_cpp, simd_gbps;
+                    picture_t src, dst;
+                    char size[16];
+
+                    x264vfw_dcsp_init( &pf_c, dec_src_list[s].i_csp, 1, 0, 0 );
+                    x264vfw_dcsp_init( &pf_simd, dec_src_list[s].i_csp, 1, 0, cpu );
+                    if( picture_alloc( &src, 1, dec_src_list[s].i_csp, i_width, i_height ) < 0 ||
+                        picture_alloc( &dst, 1, dec_dst_list[d] | (v ? X264VFW_CSP_VFLIP : 0), i_width, i_height ) < 0 )
+                    {
+                        fprintf( stderr, "bench_csp: out of memory\n" );
+                        exit( 1 );
+                    }
+                    fill_random( src.buf, src.i_size );
+                    c_gbps = dcsp_time( &pf_c, &dst, &src, i_width, i_height, &c_cpp );
+                    snprintf( size, sizeof(size), "%dx%d", i_width, i_height );
+                    if( pf_simd.convert[dec_dst_list[d]] != pf_c.convert[dec_dst_list[d]] )
+                    {
+                        simd_gbps = dcsp_time( &pf_simd, &dst, &src, i_width, i_height, &simd_cpp );
+                        printf( "%-16s %-10s %-5s %10.3f %8.2f %11.3f %8.2f\n", name, size, v ? "yes" : "no",
+                                c_cpp, c_gbps, simd_cpp, simd_gbps );
+                    }
+                    else
+                        printf( "%-16s %-10s %-5s %10.3f %8.2f %11s %8s\n", name, size, v ? "yes" : "no",
+                                c_cpp, c_gbps, "-", "-" );
+                    fflush( stdout );
+                    picture_free( &src );
+                    picture_free( &dst );
+                }
+        }
+}
+
+int main( int argc, char **argv )
+{
+    const char *mode = argc > 1 ? argv[1] : "check";
+    const char *filter = argc > 2 ? argv[2] : NULL;
+    int cpu = cpu_detect();
+
+    printf( "bench_csp: bit depth %d, cpu:%s%s%s%s\n", X264_BIT_DEPTH,
+            cpu & X264_CPU_SSE2 ? " sse2" : "", cpu & X264_CPU_SSSE3 ? " ssse3" : "",
+            cpu & X264_CPU_AVX2 ? " avx2" : "", cpu ? "" : " none" );
+    if( !strcmp( mode, "check" ) )
+    {
+        int i_fails = check( filter, cpu ) + check_dcsp( filter, cpu ) + check_scale( filter, cpu );
+        printf( i_fails ? "bench_csp: %d converters FAILED\n" : "bench_csp: all converters ok\n", i_fails );
+        return i_fails != 0;
+    }
+    if( !strcmp( mode, "bench" ) )
+    {
+        bench( filter, cpu );
+        bench_dcsp( filter, cpu );
+        return 0;
+    }
+    fprintf( stderr, "usage: %s [check|bench] [filter]\n", argv[0] );
+    return 1;
+}
@@ -0,0 +1,153 @@
+/*****************************************************************************
+ * telemetry.c: prints the live counters published by x264vfw --telemetry
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+/* Build with "make x264vfw_telemetry":
+ *   x264vfw_telemetry <pid> [instance [interval_ms]]
+ * Without instance every encoder of the process is shown, interval_ms 0 prints the counters once. */
+
+#include "telemetry.h"
+
+typedef struct
+{
+    HANDLE hMap;
+    const x264vfw_telemetry_block_t *block;
+} reader_t;
+
+static int reader_open( reader_t *r, unsigned long pid, int i_instance )
+{
+    wchar_t name[64];
+
+    _snwprintf( name, ARRAY_ELEMS(name), X264VFW_TELEMETRY_NAME, pid, i_instance );
+    name[ARRAY_ELEMS(name) - 1] = 0;
+    r->hMap = OpenFileMappingW( FILE_MAP_READ, FALSE, name );
+    if( !r->hMap )
+        return -1;
+    r->block = MapViewOfFile( r->hMap, FILE_MAP_READ, 0, 0, sizeof(x264vfw_telemetry_block_t) );
+    if( !r->block )
+    {
+        CloseHandle( r->hMap );
+        return -1;
+    }
+    return 0;
+}
+
+static void reader_close( reader_t *r )
+{
+    UnmapViewOfFile( r->block );
+    CloseHandle( r->hMap );
+    r->hMap = NULL;
+}
+
+/* Seqlock read: retry while the writer is inside its update */
+static int reader_snapshot( reader_t *r, x264vfw_telemetry_block_t *out )
+{
+    int i_try;
+
+    for( i_try = 0; i_try < 1000; i_try++ )
+    {
+        LONG i_seq = r->block->i_seq;
+        MemoryBarrier();
+        if( !(i_seq & 1) )
+        {
+            memcpy( out, (const void *)r->block, sizeof(x264vfw_telemetry_block_t) );
+            MemoryBarrier();
+            if( r->block->i_seq == i_seq )
+                return 0;
+        }
+        Sleep( 0 );
+    }
+    return -1;
+}
+
+static void print_block( const x264vfw_telemetry_block_t *b )
+{
+    if( b->i_version != X264VFW_TELEMETRY_VERSION || b->i_size != sizeof(x264vfw_telemetry_block_t) )
+    {
+        printf( "[%d] unsupported telemetry version %u\n", b->i_instance, b->i_version );
+        return;
+    }
+    printf( "[%d] %8.1fs  in %8"PRId64"  out %8"PRId64"  dropped %6"PRId64"  queued %2d  delayed %3d  "
+            "%7.2f fps  %9.2f kb/s%s\n",
+            b->i_instance, b->f_elapsed, b->i_frames_in, b->i_frames_out, b->i_frames_dropped,
+            b->i_queued, b->i_delayed, b->f_encode_fps, b->f_bitrate, b->b_closed ? "  (ended)" : "" );
+}
+
+int main( int argc, char **argv )
+{
+    reader_t reader[X264VFW_TELEMETRY_INSTANCES] = {{ 0 }};
+    unsigned long pid;
+    int i_first = 0, i_last = X264VFW_TELEMETRY_INSTANCES - 1;
+    int i_interval = 1000;
+    int i, i_open = 0;
+
+    if( argc < 2 )
+    {
+        fprintf( stderr, "usage: %s <pid> [instance [interval_ms]]\n", argv[0] );
+        return 1;
+    }
+    pid = strtoul( argv[1], NULL, 10 );
+    if( argc > 2 )
+        i_first = i_last = atoi( argv[2] );
+    if( argc > 3 )
+        i_interval = atoi( argv[3] );
+    if( i_first < 0 || i_first >= X264VFW_TELEMETRY_INSTANCES )
+    {
+        fprintf( stderr, "instance must be in 0..%d\n", X264VFW_TELEMETRY_INSTANCES - 1 );
+        return 1;
+    }
+
+    for( i = i_first; i <= i_last; i++ )
+        i_open += !reader_open( &reader[i], pid, i );
+    if( !i_open )
+    {
+        fprintf( stderr, "no x264vfw telemetry found for process %lu (is --telemetry set?)\n", pid );
+        return 1;
+    }
+
+    for( ;; )
+    {
+        int b_running = 0;
+
+        for( i = i_first; i <= i_last; i++ )
+        {
+            x264vfw_telemetry_block_t b;
+
+            if( !reader[i].hMap )
+                continue;
+            if( reader_snapshot( &reader[i], &b ) < 0 )
+            {
+                printf( "[%d] busy\n", i );
+                b_running = 1;
+                continue;
+            }
+            print_block( &b );
+            b_running |= !b.b_closed;
+        }
+        fflush( stdout );
+        if( !i_interval || !b_running )
+            break;
+        Sleep( i_interval );
+    }
+
+    for( i = i_first; i <= i_last; i++ )
+        if( reader[i].hMap )
+            reader_close( &reader[i] );
+    return 0;
+}
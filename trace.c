@@ -0,0 +1,167 @@
+/*****************************************************************************
+ * trace.c: per-stage timing spans
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "trace.h"
+#include "x264cli.h"
+
+const char * const x264vfw_trace_stage_names[X264VFW_TRACE_STAGES] =
+{
+    "compress", "diff", "convert", "encode", "mux", "copy", "flush",
+    "decompress", "decode", "scale"
+};
+
+typedef struct
+{
+    int64_t *duration;          /* in ticks */
+    int i_count;
+    int i_alloc;
+} trace_stage_t;
+
+struct x264vfw_trace_t
+{
+    CRITICAL_SECTION cs;
+    FILE *fh;
+    int b_csv;
+    int b_first;                /* no JSON event written yet */
+    int64_t i_freq;             /* ticks per second */
+    int64_t i_origin;
+    DWORD i_pid;
+    trace_stage_t stage[X264VFW_TRACE_STAGES];
+};
+
+int64_t x264vfw_trace_now(void)
+{
+    LARGE_INTEGER count;
+
+    QueryPerformanceCounter(&count);
+    return count.QuadPart;
+}
+
+int x264vfw_trace_open(x264vfw_trace_t **p_trace, const char *filename)
+{
+    x264vfw_trace_t *trace;
+    LARGE_INTEGER freq;
+
+    *p_trace = NULL;
+    trace = calloc(1, sizeof(x264vfw_trace_t));
+    if (!trace)
+        return -1;
+    trace->fh = x264vfw_fopen(filename, "wb");
+    if (!trace->fh)
+    {
+        free(trace);
+        return -1;
+    }
+    trace->b_csv = !strcasecmp(get_filename_extension((char *)filename), "csv");
+    trace->b_first = 1;
+    QueryPerformanceFrequency(&freq);
+    trace->i_freq = freq.QuadPart;
+    trace->i_origin = x264vfw_trace_now();
+    trace->i_pid = GetCurrentProcessId();
+    InitializeCriticalSection(&trace->cs);
+    if (trace->b_csv)
+        fprintf(trace->fh, "frame,stage,thread,start_us,duration_us\n");
+    else
+        fprintf(trace->fh, "{\"traceEvents\":[\n");
+    *p_trace = trace;
+    return 0;
+}
+
+void x264vfw_trace_close(x264vfw_trace_t *trace)
+{
+    int i;
+
+    if (!trace)
+        return;
+    if (!trace->b_csv)
+        fprintf(trace->fh, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,\"args\":{\"name\":\"x264vfw\"}}\n]}\n",
+                trace->b_first ? "" : ",\n", (unsigned long)trace->i_pid);
+    fclose(trace->fh);
+    for (i = 0; i < X264VFW_TRACE_STAGES; i++)
+        free(trace->stage[i].duration);
+    DeleteCriticalSection(&trace->cs);
+    free(trace);
+}
+
+void x264vfw_trace_span(x264vfw_trace_t *trace, int i_stage, int i_frame, int64_t i_start)
+{
+    int64_t i_end = x264vfw_trace_now();
+    trace_stage_t *stage = &trace->stage[i_stage];
+    double f_start = (i_start - trace->i_origin) * 1e6 / trace->i_freq;
+    double f_duration = (i_end - i_start) * 1e6 / trace->i_freq;
+    unsigned long i_tid = GetCurrentThreadId();
+
+    EnterCriticalSection(&trace->cs);
+    if (stage->i_count == stage->i_alloc)
+    {
+        int i_alloc = stage->i_alloc ? stage->i_alloc * 2 : 1024;
+        int64_t *duration = realloc(stage->duration, i_alloc * sizeof(int64_t));
+        if (duration)
+        {
+            stage->duration = duration;
+            stage->i_alloc = i_alloc;
+        }
+    }
+    if (stage->i_count < stage->i_alloc)
+        stage->duration[stage->i_count++] = i_end - i_start;
+
+    if (trace->b_csv)
+        fprintf(trace->fh, "%d,%s,%lu,%.3f,%.3f\n", i_frame, x264vfw_trace_stage_names[i_stage], i_tid, f_start, f_duration);
+    else
+    {
+        fprintf(trace->fh, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%lu,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f",
+                trace->b_first ? "" : ",\n", x264vfw_trace_stage_names[i_stage], (unsigned long)trace->i_pid, i_tid, f_start, f_duration);
+        if (i_frame >= 0)
+            fprintf(trace->fh, ",\"args\":{\"frame\":%d}", i_frame);
+        fprintf(trace->fh, "}");
+        trace->b_first = 0;
+    }
+    LeaveCriticalSection(&trace->cs);
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+    int64_t i_a = *(const int64_t *)a;
+    int64_t i_b = *(const int64_t *)b;
+    return (i_a > i_b) - (i_a < i_b);
+}
+
+int x264vfw_trace_stats(x264vfw_trace_t *trace, int i_stage, double *p_min, double *p_avg, double *p_p99)
+{
+    trace_stage_t *stage = &trace->stage[i_stage];
+    double f_sum = 0.0;
+    int i_count;
+    int i;
+
+    EnterCriticalSection(&trace->cs);
+    i_count = stage->i_count;
+    if (i_count > 0)
+    {
+        /* Order doesn't matter for the statistics so sort in place */
+        qsort(stage->duration, i_count, sizeof(int64_t), compare_int64);
+        for (i = 0; i < i_count; i++)
+            f_sum += stage->duration[i];
+        *p_min = stage->duration[0] * 1e3 / trace->i_freq;
+        *p_avg = f_sum / i_count * 1e3 / trace->i_freq;
+        *p_p99 = stage->duration[(i_count * 99 + 99) / 100 - 1] * 1e3 / trace->i_freq;
+    }
+    LeaveCriticalSection(&trace->cs);
+    return i_count;
+}
@@ -0,0 +1,62 @@
+/*****************************************************************************
+ * trace.h: per-stage timing spans
+ *****************************************************************************
+ * Copyright (C) 2017 x264vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_TRACE_H
+#define X264VFW_TRACE_H
+
+#include "common.h"
+
+enum
+{
+    X264VFW_TRACE_COMPRESS,     /* whole x264vfw_compress call */
+    X264VFW_TRACE_DIFF,         /* --static-frames comparison */
+    X264VFW_TRACE_CONVERT,      /* colorspace conversion */
+    X264VFW_TRACE_ENCODE,       /* x264_encoder_encode */
+    X264VFW_TRACE_MUX,          /* cli_output.write_frame */
+    X264VFW_TRACE_COPY,         /* copy of the encoded frame into the VFW output buffer */
+    X264VFW_TRACE_FLUSH,        /* delayed frames at x264vfw_compress_end */
+    X264VFW_TRACE_DECOMPRESS,   /* whole x264vfw_decompress call */
+    X264VFW_TRACE_DECODE,       /* avcodec_send_packet/avcodec_receive_frame */
+    X264VFW_TRACE_SCALE,        /* sws_scale (or plane copy) into the VFW output buffer */
+    X264VFW_TRACE_STAGES
+};
+
+extern const char * const x264vfw_trace_stage_names[X264VFW_TRACE_STAGES];
+
+typedef struct x264vfw_trace_t x264vfw_trace_t;
+
+/* Writes CSV if filename ends with ".csv" and Chrome trace event JSON (chrome://tracing) otherwise */
+int x264vfw_trace_open(x264vfw_trace_t **p_trace, const char *filename);
+void x264vfw_trace_close(x264vfw_trace_t *trace);
+int64_t x264vfw_trace_now(void);
+/* Adds the span [i_start, now) of the stage, thread-safe; i_frame < 0 if not known */
+void x264vfw_trace_span(x264vfw_trace_t *trace, int i_stage, int i_frame, int64_t i_start);
+/* Duration statistics of the stage in milliseconds, returns the number of spans */
+int x264vfw_trace_stats(x264vfw_trace_t *trace, int i_stage, double *p_min, double *p_avg, double *p_p99);
+
+/* Disabled tracing (NULL trace) costs a pointer check per stage */
+#define X264VFW_TRACE_START(trace) ((trace) ? x264vfw_trace_now() : 0)
+#define X264VFW_TRACE_END(trace, i_stage, i_frame, i_start)              \
+    do {                                                                  \
+        if (trace)                                                        \
+            x264vfw_trace_span(trace, i_stage, i_frame, i_start);         \
+    } while (0)
+
+#endif
@@ -41,6 +41,15 @@
 #endif
 
 #include "csp.h"
+#include "dcsp.h"
+#include "framediff.h"
+#include "logger.h"
+#include "scale.h"
+#include "sidecar.h"
+#include "spill.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "threadpool.h"
 #include "x264cli.h"
 #include "output/output.h"
 #include "resource.h"
@@ -57,8 +66,10 @@
 #define FOURCC_IYUV mmioFOURCC('I','Y','U','V')
 #define FOURCC_YV12 mmioFOURCC('Y','V','1','2')
 /* YUV 4:2:2 planar */
+#define FOURCC_Y42B mmioFOURCC('Y','4','2','B')
 #define FOURCC_YV16 mmioFOURCC('Y','V','1','6')
 /* YUV 4:4:4 planar */
+#define FOURCC_444P mmioFOURCC('4','4','4','P')
 #define FOURCC_YV24 mmioFOURCC('Y','V','2','4')
 /* YUV 4:2:0, with one Y plane and one packed U+V */
 #define FOURCC_NV12 mmioFOURCC('N','V','1','2')
@@ -67,6 +78,16 @@
 #define FOURCC_YUY2 mmioFOURCC('Y','U','Y','2')
 #define FOURCC_UYVY mmioFOURCC('U','Y','V','Y')
 #define FOURCC_HDYC mmioFOURCC('H','D','Y','C')
+/* YUV 4:2:0 and 4:2:2 16-bit (10-bit), with one Y plane and one packed U+V */
+#define FOURCC_P010 mmioFOURCC('P','0','1','0')
+#define FOURCC_P210 mmioFOURCC('P','2','1','0')
+/* YUV 4:2:2 10-bit packed */
+#define FOURCC_V210 mmioFOURCC('v','2','1','0')
+/* YUVA 4:4:4 16-bit packed */
+#define FOURCC_Y416 mmioFOURCC('Y','4','1','6')
+/* RGB 48-bit and ARGB 64-bit big-endian */
+#define FOURCC_B48R mmioFOURCC('b','4','8','r')
+#define FOURCC_B64A mmioFOURCC('b','6','4','a')
 
 #define X264VFW_WEBSITE "http://sourceforge.net/projects/x264vfw/"
 
@@ -82,6 +103,20 @@
 #define MAX_OUTPUT_SIZE  X264_MAX(MAX_OUTPUT_PATH, MAX_PATH)
 #define MAX_CMDLINE      4096
 
+#define MAX_CSP_AUTO_THREADS 8  /* colorspace conversion threads with --csp-threads 0 */
+#define MIN_CSP_BAND_HEIGHT  64 /* rows per colorspace conversion thread */
+#define MAX_ASYNC_PICS       16 /* converted pictures queued ahead of the encoder thread */
+#define SPEED_BUFFER_FRAMES  30 /* --speed-control reserve in frame durations */
+#define SPEED_HOLD_FRAMES    10 /* --speed-control frames between steps */
+#define DEADLINE_IDR_DROPS   5  /* --deadline drops in a row after which the next frame is IDR */
+#define MAX_RENDITIONS       4  /* --rendition encoders besides the primary one */
+#define MAX_DECODER_QUEUE    32 /* decoded frames waiting to be shown */
+#define DECODER_ADAPT_LEVELS 3  /* --decoder-adaptive quality reductions */
+#define DECODER_ADAPT_HOLD   16 /* --decoder-adaptive frames between level changes */
+#define DECODER_ADAPT_HIGH   0.9  /* decode time / call period above which quality is reduced */
+#define DECODER_ADAPT_LOW    0.6  /* and below which it is restored */
+#define DECODER_ADAPT_SMOOTH 0.125 /* weight of the last frame in the averages */
+
 #define COUNT_PRESET     10
 #define COUNT_TUNE       7
 #define COUNT_PROFILE    7
@@ -180,6 +215,41 @@ typedef struct {
     int linesize[4];
 } VFWPicture;
 
+typedef struct x264vfw_async_t x264vfw_async_t;
+typedef struct x264vfw_speed_t x264vfw_speed_t;
+
+/* Compression sessions with the same key get the same encoder parameters */
+typedef struct
+{
+    CONFIG config;
+    LONG i_width;
+    LONG i_height;
+    WORD i_bit_count;
+    DWORD input_fourcc;
+    DWORD output_fourcc;
+    int i_frame_total;
+    uint32_t i_fps_num;
+    uint32_t i_fps_den;
+} x264vfw_reuse_key_t;
+
+/* Extra encoder fed with the downscaled pictures of the primary one (--rendition) */
+typedef struct
+{
+    int i_width;
+    int i_height;
+    int i_bitrate;                      /* kbit/s */
+    char *file;                         /* only valid during x264vfw_compress_begin */
+    x264_t *h;
+    x264vfw_scale_t *scale;
+    x264_picture_t pic;
+    cli_output_t output;
+    hnd_t hout;
+    cli_output_opt_t output_opt;
+    int i_frames;
+    int64_t i_bytes;
+    int b_error;
+} x264vfw_rendition_t;
+
 /* CODEC: VFW codec instance */
 typedef struct
 {
@@ -207,6 +277,45 @@ typedef struct
     int b_warn_frame_loss;
     int b_flush_delayed;
 
+    /* Encoder kept open by x264vfw_compress_end for the next session with the same key */
+    int b_encoder_reuse;
+    x264_t *reuse_h;
+    x264vfw_reuse_key_t reuse_key;
+    x264_picture_t reuse_pic;           /* conv_pic of the previous session */
+    int64_t reuse_pts;                  /* next timestamp in the timeline of reuse_h */
+    int64_t i_pts_base;                 /* timestamp of the first frame of this session in the encoder timeline */
+    int b_force_idr;
+    int b_encoder_flushed;              /* x264_encoder_encode got NULL, the encoder can't be reused */
+
+    /* Speed control */
+    float f_speed;                      /* 0 - disabled, fraction of the frame rate to keep up with */
+    x264vfw_speed_t *speed;
+
+    /* Deadline frame dropping */
+    int i_deadline;                     /* 0 - disabled, maximum lag in ms */
+    double f_deadline_frame;            /* frame duration in QueryPerformanceCounter ticks */
+    double f_deadline_limit;            /* i_deadline in ticks */
+    int64_t i_deadline_origin;          /* when frame 0 was due, 0 - not yet */
+    int i_deadline_run;                 /* frames dropped in a row */
+    int i_deadline_drops;
+    int b_deadline_idr;                 /* the next submitted picture is IDR */
+
+    /* Two passes in one session (--spill-2pass): the pictures of the first pass are spilled
+     * to a file and encoded again by x264vfw_compress_end */
+    char *spill_file;                   /* only valid during x264vfw_compress_begin */
+    x264vfw_spill_t *spill;
+    x264_param_t spill_param;           /* parameters of the second pass */
+    char *spill_stats;                  /* stats file name of spill_param */
+    char *spill_output;                 /* cli_output_file for the second pass */
+    int spill_planes;                   /* picture layout in a spill record */
+    int spill_stride[4];
+    int spill_rows[4];
+
+    /* Renditions encoded in parallel with the primary encoder (only the primary one goes to VFW) */
+    int i_renditions;
+    x264vfw_rendition_t rendition[MAX_RENDITIONS];
+    x264vfw_threadpool_t *rendition_pool;
+
     /* Preset/Tuning/Profile */
     const char *preset;
     const char *tune;
@@ -220,10 +329,35 @@ typedef struct
     /* Colorspace conversion */
     x264vfw_csp_function_t csp;
     x264_picture_t conv_pic;
+    int i_csp_threads;                  /* 0 - auto */
+    int b_convert_nv12;                 /* convert to NV12 instead of I420 */
+    x264vfw_threadpool_t *csp_pool;     /* splits conversion into row bands */
+
+    /* Pipelined compress (conversion in the calling thread, encoding in its own thread) */
+    int i_async_pics;                   /* 0 - disabled */
+    x264vfw_async_t *async;
+
+    /* Static (unchanged) input frames */
+    int i_static_frames;                /* STATIC_FRAMES_* */
+    x264vfw_framediff_t framediff;
+    int i_static_count;
+
+    /* Per-stage timing (--trace) */
+    char *trace_file;                   /* only valid during x264vfw_compress_begin */
+    x264vfw_trace_t *trace;
+
+    /* Per-frame statistics (--stats-sidecar) */
+    char *sidecar_file;                 /* only valid during x264vfw_compress_begin */
+    x264vfw_sidecar_t *sidecar;
+
+    /* Live counters in shared memory (--telemetry) */
+    int b_telemetry;
+    x264vfw_telemetry_t *telemetry;
 
     /* Log console */
     HWND hCons;
     int b_visible;
+    x264vfw_logger_t *logger;           /* writes messages to the console in its own thread */
 
     /* CLI output */
     int b_cli_output;
@@ -241,13 +375,31 @@ typedef struct
     AVCodecContext     *decoder_context;
     AVFrame            *decoder_frame;
     void               *decoder_extradata;
+    int                decoder_extradata_size;
     void               *decoder_buf;
     DWORD              decoder_buf_size;
     AVPacket           decoder_pkt;
     enum AVPixelFormat decoder_pix_fmt;
     int                decoder_vflip;
     int                decoder_swap_UV;
+    int                decoder_threads;        /* --decoder-threads, 0 - auto */
+    int                decoder_thread_type;    /* FF_THREAD_SLICE or FF_THREAD_FRAME */
+    int                decoder_fast_convert;   /* --decoder-convert fast */
+    x264vfw_dcsp_function_t decoder_dcsp;
+    int                decoder_dcsp_src;       /* source csp decoder_dcsp is set up for */
+    int                decoder_adaptive;       /* --decoder-adaptive */
+    int                decoder_level;          /* quality reductions in use, 0..DECODER_ADAPT_LEVELS */
+    int                decoder_level_frames;   /* frames since the last level change */
+    int64_t            i_decoder_last_call;    /* QueryPerformanceCounter at the previous call, 0 - none yet */
+    double             f_decoder_period;       /* smoothed time between the calls */
+    double             f_decoder_busy;         /* smoothed decode time */
+    AVFrame            *decoder_queue[MAX_DECODER_QUEUE]; /* decoded frames not shown yet, oldest first */
+    int                decoder_queue_first;
+    int                decoder_queue_count;
+    AVFrame            *decoder_shown;         /* shown again while the decoder has no new frame */
+    int64_t            decoder_in;             /* packets sent to the decoder */
     struct SwsContext  *sws;
+    x264vfw_trace_t    *decoder_trace;
 #endif
 } CODEC;
 
@@ -258,6 +410,7 @@ LRESULT x264vfw_compress_query(CODEC *, BITMAPINFO *, BITMAPINFO *);
 LRESULT x264vfw_compress_begin(CODEC *, BITMAPINFO *, BITMAPINFO *);
 LRESULT x264vfw_compress(CODEC *, ICCOMPRESS *);
 LRESULT x264vfw_compress_end(CODEC *);
+void x264vfw_compress_release(CODEC *);
 LRESULT x264vfw_compress_frames_info(CODEC *, ICCOMPRESSFRAMES *);
 void x264vfw_default_compress_frames_info(CODEC *);
 